@@ -4,10 +4,19 @@ if(CCACHE_PROGRAM)
     set_property(GLOBAL PROPERTY RULE_LAUNCH_COMPILE "${CCACHE_PROGRAM}")
 endif()
 
-# set cpu arch flags
-set(CPU_FLAGS "-msse -msse2 -msse3 -mssse3 -msse4 -msse4a -msse4.1 -msse4.2 -mavx -mavx2 -mavx512f -mavx512bw -mavx512vl")
+# per instruction set flags, only applied to the matching kernel sources so the
+# library runs on any x86-64 cpu and picks the best kernels at load time
+set(SSE41_FLAGS "-msse4.1")
+set(AVX2_FLAGS "-mavx2")
+set(AVX512_FLAGS "-mavx512f -mavx512bw -mavx512cd -mavx512dq -mavx512vl")
 
-set(CMAKE_CXX_FLAGS "${CMAKE_CXX_FLAGS} -Wall -fno-omit-frame-pointer -DXXH_STATIC_LINKING_ONLY=1 ${CPU_FLAGS}")
+set(CMAKE_CXX_FLAGS "${CMAKE_CXX_FLAGS} -Wall -fno-omit-frame-pointer -DXXH_STATIC_LINKING_ONLY=1")
+if(ENABLE_STATS)
+    set(CMAKE_CXX_FLAGS "${CMAKE_CXX_FLAGS} -DLLB_STATS")
+endif()
+if(INLINE_HOT_PATH)
+    set(CMAKE_CXX_FLAGS "${CMAKE_CXX_FLAGS} -DLLB_INLINE_HOT_PATH")
+endif()
 set(CMAKE_CXX_FLAGS_DEBUG "${CMAKE_CXX_FLAGS_DEBUG} -DDEBUG -O0 -ggdb -g3")
 set(CMAKE_CXX_FLAGS_RELEASE "${CMAKE_CXX_FLAGS_RELEASE} -DNDEBUG -Ofast")
 
@@ -1,5 +1,9 @@
 option(BUILD_TESTS "Comple and run tests" OFF)
 option(BUILD_PERF_TESTS "Compile and run performance tests" OFF)
+option(BUILD_TOOLS "Compile the llb-count command line tool" OFF)
+option(ENABLE_STATS "Count and time sketch operations, see include/Stats.h" OFF)
+option(INLINE_HOT_PATH "Define add_hash() and add() inline in the headers" OFF)
+option(ENABLE_LTO "Build llb_static with link time optimization" OFF)
 option(RUN_FORMATTER "Format codebase" OFF)
 option(GENERATE_DOCS "Build documentation" OFF)
 option(RUN_CLANG_TIDY "Run clang tidy on codebase" OFF)
@@ -0,0 +1,63 @@
+/**
+ * ConcurrentLogLogBeta.h
+ */
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+#include "LogLogBeta.h"
+
+namespace llb {
+// A dense byte register sketch that any number of threads can add to, merge
+// into and estimate at the same time. Registers are raised with an atomic
+// fetch-max, so a warm sketch mostly just loads the register and moves on.
+// cardinality() and merge_into() work on a copy of the registers taken with
+// atomic loads while they may be raised. The copy isn't one point in time,
+// but registers only grow, so it lands between the sketch before and after
+// the adds it overlaps with
+class ConcurrentLogLogBeta {
+public:
+  ConcurrentLogLogBeta(double error_rate = constants::k_default_error_rate,
+                       Hasher hasher = Hasher{}) noexcept;
+
+  void add(const std::string &value) {
+    add(reinterpret_cast<const uint8_t *>(value.data()), value.size());
+  }
+
+  void add(const char *value, uint64_t length) {
+    add(reinterpret_cast<const uint8_t *>(value), length);
+  }
+
+  void add(const uint8_t *value, uint64_t length);
+
+  void add_hash(uint64_t hash);
+
+  void add_hashes(const uint64_t *hashes, uint64_t count);
+
+  uint64_t cardinality() const;
+
+  // merge_me must not be written to during the merge. More precise sketches
+  // are folded down as they are merged, false if merge_me is less precise or
+  // hashed with another hasher
+  bool merge(const LogLogBeta &merge_me);
+
+  // Merges the registers as they are now into a regular sketch, false if it
+  // is hashed with another hasher
+  bool merge_into(LogLogBeta *sketch) const;
+
+  const Hasher &hasher() const { return m_sketch.hasher(); }
+
+  uint64_t register_count() const { return m_sketch.register_count(); }
+
+  uint8_t register_at(uint64_t index) const;
+
+private:
+  void raise_register(uint64_t index, uint8_t rank);
+
+  // The registers copied one atomic load at a time into a regular sketch
+  LogLogBeta snapshot() const;
+
+  LogLogBeta m_sketch;
+};
+} // namespace llb
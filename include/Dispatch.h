@@ -0,0 +1,22 @@
+/**
+ * Dispatch.h
+ */
+#pragma once
+
+#include <cstdint>
+
+namespace llb {
+enum class InstructionSet : uint8_t { scalar, sse41, avx2, avx512 };
+
+// Best instruction set the running cpu supports, detected once via cpuid
+InstructionSet detected_instruction_set() noexcept;
+
+// Instruction set of the kernels currently used by cardinality() and merge()
+InstructionSet active_instruction_set() noexcept;
+
+// Force the kernels of a specific instruction set, returns false if the cpu
+// can not run them
+bool set_instruction_set(InstructionSet instruction_set) noexcept;
+
+const char *instruction_set_name(InstructionSet instruction_set) noexcept;
+} // namespace llb
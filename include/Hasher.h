@@ -0,0 +1,65 @@
+/**
+ * Hasher.h
+ */
+#pragma once
+
+#include <cstdint>
+
+namespace llb {
+namespace constants {
+// Seed of the XXH3 hashes values are added with by default, recorded when
+// serializing
+constexpr uint64_t k_hash_seed = 0UL;
+} // namespace constants
+
+// How values are hashed before they are added. Every function hashes a key as
+// its bytes, so add(uint64_t) and add(Uuid) set the same registers as adding
+// their 8 or 16 little endian bytes. xxh3 is XXH3_64bits and xxh3_128_low the
+// low half of XXH3_128bits, both seeded. splitmix64 runs 8 and 16 byte values
+// through the SplitMix64 finalizer, once per 8 bytes, and hashes values of
+// any other length with XXH3. It is meant for integer ids that are already
+// well spread, everything else is better off with xxh3
+enum class HashFunction : uint8_t { xxh3, xxh3_128_low, splitmix64 };
+
+// A 16 byte key such as a UUID
+struct Uuid {
+  uint8_t bytes[16];
+};
+
+class Hasher {
+public:
+  constexpr Hasher(HashFunction function = HashFunction::xxh3,
+                   uint64_t seed = constants::k_hash_seed) noexcept
+      : m_function{function}, m_seed{seed} {}
+
+  HashFunction function() const { return m_function; }
+
+  uint64_t seed() const { return m_seed; }
+
+  uint64_t hash(const uint8_t *value, uint64_t length) const;
+
+  uint64_t hash(uint64_t key) const;
+
+  uint64_t hash(const Uuid &key) const;
+
+  // Batch forms, hashing 4 or 8 keys per vector with the active kernels
+  void hash(const uint64_t *keys, uint64_t count, uint64_t *hashes) const;
+
+  void hash(const Uuid *keys, uint64_t count, uint64_t *hashes) const;
+
+  bool operator==(const Hasher &other) const {
+    return m_function == other.m_function && m_seed == other.m_seed;
+  }
+
+  bool operator!=(const Hasher &other) const { return !(*this == other); }
+
+  // False for an id that isn't a HashFunction, like one read from a buffer
+  static bool valid_function(uint8_t function) {
+    return function <= static_cast<uint8_t>(HashFunction::splitmix64);
+  }
+
+private:
+  HashFunction m_function;
+  uint64_t m_seed;
+};
+} // namespace llb
@@ -5,20 +5,121 @@
 
 #include <cstdint>
 #include <string>
+#include <vector>
+
+#include "Dispatch.h"
+#include "Hasher.h"
+
+// With LLB_INLINE_HOT_PATH defined, -DINLINE_HOT_PATH=ON, add_hash() and
+// add() are defined inline in LogLogBetaInline.h so they inline into callers
+// and their loops. Without it they are exported from the library like every
+// other member, keeping the shared library's ABI
+#ifdef LLB_INLINE_HOT_PATH
+#define LLB_HOT_INLINE inline
+#else
+#define LLB_HOT_INLINE
+#endif
 
 namespace llb {
 namespace constants {
 constexpr uint32_t k_minimum_precision = 8U;
+constexpr uint32_t k_maximum_precision = 26U;
 constexpr uint32_t k_default_precision = 14U;
 constexpr double k_default_error_rate = 0.01;
 constexpr uint32_t k_default_alignment = 1024U;
+
+// Sparse entries pack (register index << k_sparse_rank_bits | rank)
+constexpr uint32_t k_sparse_rank_bits = 6U;
+// Unsorted sparse entries buffered before they are merged into the sorted list
+constexpr uint32_t k_sparse_buffer_size = 64U;
+// A sparse sketch is promoted to dense registers once it holds more than
+// register_count / k_sparse_promote_divisor entries
+constexpr uint32_t k_sparse_promote_divisor = 8U;
+
+// Values hashed and split into index and rank per step of a batch add
+constexpr uint32_t k_batch_size = 256U;
+
+// Registers every input is merged into before moving on in a multi-way merge,
+// small enough that the tile stays in L1
+constexpr uint32_t k_merge_tile_registers = 8192U;
+
+// Counts in a rank histogram, one per possible register rank
+constexpr uint32_t k_rank_histogram_size = 64U;
+
+// LogLog-Beta's alpha is k_alpha1 / (1 + k_alpha2 / register_count)
+constexpr double k_alpha1 = 0.7213;
+constexpr double k_alpha2 = 1.079;
 } // namespace constants
 
+enum class Representation : uint8_t { dense, sparse };
+
+// byte keeps one rank per byte, packed6 keeps 6 bits per rank and packed4
+// keeps a 4 bit offset from a shared base rank per register, with ranks 15 or
+// more above the base kept exactly in an overflow list
+enum class RegisterLayout : uint8_t { byte, packed6, packed4 };
+
+// loglog_beta is the LogLog-Beta estimate from the register sum, its beta
+// correction fitted at precision 14. ertl is Ertl's improved estimator from
+// the histogram of register ranks, which corrects for the zero and saturated
+// registers analytically and so holds its accuracy at every precision
+enum class Estimator : uint8_t { loglog_beta, ertl };
+
+// inclusion_exclusion estimates an intersection as |A| + |B| - |A u B| from
+// one pass over both sketches. maximum_likelihood fits the values only in A,
+// only in B and in both to the histograms of the register pairs, as in Ertl's
+// joint estimation, which is far less noisy for small overlaps and costs a
+// few hundred likelihood evaluations more
+enum class JointEstimator : uint8_t { inclusion_exclusion, maximum_likelihood };
+
+namespace kernels {
+struct KernelTable;
+} // namespace kernels
+
+namespace serialization {
+struct Header;
+} // namespace serialization
+
+struct DenseRegisters;
+class MappedRegisterFile;
+class RegisterStorage;
+class LogLogBetaView;
+class ThreadPool;
+class ConcurrentLogLogBeta;
+template <uint32_t P> class LogLogBetaFixed;
+
 class LogLogBeta {
 public:
-  LogLogBeta(double error_rate = constants::k_default_error_rate) noexcept;
+  // Values are hashed with hasher, which is recorded when serializing and
+  // must match for sketches to be merged or estimated together
+  LogLogBeta(double error_rate = constants::k_default_error_rate,
+             Representation representation = Representation::dense,
+             RegisterLayout layout = RegisterLayout::byte,
+             Hasher hasher = Hasher{}) noexcept;
+
+  // Registers come from storage, such as a LogLogBetaArena, which must
+  // outlive this sketch
+  LogLogBeta(RegisterStorage &storage,
+             double error_rate = constants::k_default_error_rate,
+             Representation representation = Representation::dense,
+             RegisterLayout layout = RegisterLayout::byte,
+             Hasher hasher = Hasher{}) noexcept;
+
+  // A dense sketch on the registers of slot of file, as the sketches that
+  // used the slot before left them, so reopening the file brings sketches
+  // back with no rebuild or deserialize. Precision, layout and hasher are
+  // the file's, and slot must be below file.slot_count(). fold_to() and
+  // deserialize() move the registers off the file to the heap
+  LogLogBeta(MappedRegisterFile &file, uint64_t slot) noexcept;
+
   ~LogLogBeta() noexcept;
 
+  // Moves take the registers, leaving the moved from sketch empty and sparse
+  LogLogBeta(LogLogBeta &&other) noexcept;
+  LogLogBeta &operator=(LogLogBeta &&other) noexcept;
+
+  LogLogBeta(const LogLogBeta &) = delete;
+  LogLogBeta &operator=(const LogLogBeta &) = delete;
+
   void add(const std::string &value) {
     add(reinterpret_cast<const uint8_t *>(value.data()), value.size());
   }
@@ -29,43 +130,328 @@ public:
 
   void add(const uint8_t *value, uint64_t length);
 
+  // Typed keys, hashed as their little endian bytes. Unlike add_hash() the
+  // key is hashed first
+  void add(uint64_t key) { add_hash(m_hasher.hash(key)); }
+
+  void add(const Uuid &key) { add_hash(m_hasher.hash(key)); }
+
   void add_hash(uint64_t hash);
 
-#ifdef __AVX512F__
+  // Batch adds, same result as adding each value in turn
+  void add_hashes(const uint64_t *hashes, uint64_t count);
+
+  void add_many(const uint8_t *const *values, const uint64_t *lengths,
+                uint64_t count);
+
+  // count values stored back to back in buffer, value i is
+  // [offsets[i], offsets[i + 1])
+  void add_many(const uint8_t *buffer, const uint64_t *offsets,
+                uint64_t count);
+
+  void add_many(const std::vector<std::string> &values);
+
+  // Batches of typed keys, hashed several to a vector
+  void add_keys(const uint64_t *keys, uint64_t count);
+
+  void add_keys(const Uuid *keys, uint64_t count);
+
   uint64_t cardinality() const;
-#elif
-  uint64_t cardinality() const { return cardinality_nonavx(); }
-#endif
+
+  uint64_t cardinality(Estimator estimator) const;
 
   uint64_t cardinality_nonavx() const;
 
-#ifdef __AVX512F__
-  void merge(const LogLogBeta &merge_me);
-#elif
-  void merge(const LogLogBeta &merge_me) { merge_nonavx(merge_me); }
-#endif
+  // cardinalities[i] = sketches[i]->cardinality(), fetching up to 16KB of
+  // each sketch's registers while the one before it is summed
+  static void cardinality_batch(const LogLogBeta *const *sketches,
+                                uint64_t count, uint64_t *cardinalities);
+
+  static void cardinality_batch(const std::vector<const LogLogBeta *> &sketches,
+                                uint64_t *cardinalities) {
+    cardinality_batch(sketches.data(), sketches.size(), cardinalities);
+  }
+
+  // Number of registers holding each rank, histogram[rank] for every rank
+  // below constants::k_rank_histogram_size
+  void rank_histogram(uint64_t *histogram) const;
+
+  // Keeps the register sum and zero count up to date as registers are raised
+  // so cardinality() doesn't rescan the registers, at the cost of some extra
+  // work on adds that raise a register. Sparse sketches are still summed from
+  // their entries, and cardinality_nonavx() always rescans
+  void set_incremental_estimate(bool enabled);
+
+  bool incremental_estimate() const { return m_incremental; }
+
+  // Records which registers are raised from now on, for serialize_changes().
+  // Like the incremental estimate, adds then take the per register path, and
+  // merges go register by register instead of through the kernels
+  void set_change_tracking(bool enabled);
+
+  bool change_tracking() const { return m_tracking; }
+
+  // Registers marked changed since tracking started or the last
+  // serialize_changes(), all of them after a fold or deserialize
+  uint64_t changed_register_count() const;
+
+  // The registers raised since tracking started or the last call, in the
+  // serialized form as delta coded entries of their new ranks, then starts
+  // over. Replicas apply it with merge(LogLogBetaView), which raises just
+  // those registers. Empty when tracking is off
+  std::vector<uint8_t> serialize_changes();
+
+  // Sketches of different precisions merge at the lower of the two, this
+  // sketch is folded down first when it is the more precise one. False, with
+  // nothing merged, when merge_me is hashed with another hasher
+  bool merge(const LogLogBeta &merge_me);
 
   void merge_nonavx(const LogLogBeta &merge_me);
 
+  // False if the view is invalid or built with a different hasher
+  bool merge(const LogLogBetaView &merge_me);
+
+  // Merges every sketch, walking the registers a tile at a time so each tile
+  // is written once however many sketches there are. False, with nothing
+  // merged, when any of them is hashed with another hasher
+  bool merge_all(const LogLogBeta *const *sketches, uint64_t count);
+
+  bool merge_all(const std::vector<const LogLogBeta *> &sketches) {
+    return merge_all(sketches.data(), sketches.size());
+  }
+
+  // Estimate of the union of the sketches without building the merged
+  // sketch, 0 when they aren't all hashed with the same hasher
+  static uint64_t union_cardinality(const LogLogBeta *const *sketches,
+                                    uint64_t count);
+
+  static uint64_t
+  union_cardinality(const std::vector<const LogLogBeta *> &sketches) {
+    return union_cardinality(sketches.data(), sketches.size());
+  }
+
+  // Same as above with the registers split into chunks run across pool,
+  // serial below pool.min_parallel_registers() registers
+  uint64_t cardinality(ThreadPool &pool) const;
+
+  bool merge(const LogLogBeta &merge_me, ThreadPool &pool);
+
+  bool merge_all(const LogLogBeta *const *sketches, uint64_t count,
+                 ThreadPool &pool);
+
+  static uint64_t union_cardinality(const LogLogBeta *const *sketches,
+                                    uint64_t count, ThreadPool &pool);
+
+  // Estimates of the values in both a and b and of the values in a but not
+  // in b, without building their union. Sketches of different precisions
+  // are compared at the lower one, sketches of different hashers give 0
+  static uint64_t intersection_cardinality(
+      const LogLogBeta &a, const LogLogBeta &b,
+      JointEstimator estimator = JointEstimator::inclusion_exclusion);
+
+  static uint64_t difference_cardinality(
+      const LogLogBeta &a, const LogLogBeta &b,
+      JointEstimator estimator = JointEstimator::inclusion_exclusion);
+
+  // Versioned and checksummed binary form, readable in place with
+  // LogLogBetaView. compress writes dense registers as delta coded entries
+  // when that is smaller, which views then decode on every call
+  std::vector<uint8_t> serialize(bool compress = false) const;
+
+  // Replaces this sketch with a serialized one, hasher included, false if
+  // the buffer is truncated or corrupt
+  bool deserialize(const uint8_t *buffer, uint64_t size);
+
+  // Lowers the precision to precision_bits, leaving the registers a sketch of
+  // that precision would have for the same values. False if precision_bits is
+  // above the current precision or below the minimum
+  bool fold_to(uint32_t precision_bits);
+
+  uint32_t precision_bits() const { return m_precision_bits; }
+
+  const Hasher &hasher() const { return m_hasher; }
+
+  bool is_sparse() const { return m_registers == nullptr; }
+
+  RegisterLayout layout() const { return m_layout; }
+
+  uint64_t register_count() const { return m_register_count; }
+
+  // Rank held by a register, whatever the representation and layout
+  uint8_t register_at(uint64_t index) const;
+
 protected:
-#ifdef __AVX512F__
+  friend class ConcurrentLogLogBeta;
+  friend class LogLogBetaTable;
+  friend class LogLogBetaView;
+  friend class ShardedLogLogBeta;
+  friend class SlidingLogLogBeta;
+  template <uint32_t P> friend class LogLogBetaFixed;
+
+  // Sum and merge of dense byte registers with the active kernels
+  static void sum_byte_registers(const uint8_t *registers,
+                                 uint64_t register_count, double *sum,
+                                 uint64_t *zero_count);
+
+  static void merge_byte_registers(uint8_t *registers,
+                                   const uint8_t *merge_me,
+                                   uint64_t register_count);
+
+  // Merges dense byte registers of another precision or the same
+  void merge_byte_registers(const uint8_t *registers,
+                            uint32_t precision_bits);
+
   void sum_registers(double *sum, uint64_t *zero_count) const;
-#elif
-  void sum_registers(double *sum, uint64_t *zero_count) const {
-    sum_registers_nonavx(sum, zero_count);
-  }
-#endif
 
   void sum_registers_nonavx(double *sum, uint64_t *zero_count) const;
 
   static double beta(uint64_t zero_count);
 
+  static uint64_t estimate(uint64_t register_count, double sum,
+                           uint64_t zero_count);
+
+  static uint64_t ertl_estimate(uint64_t register_count,
+                                uint32_t precision_bits,
+                                const uint64_t *histogram);
+
 private:
+  void reset(uint32_t precision_bits, RegisterLayout layout);
+
+  void sum_registers(const kernels::KernelTable &kernel_table, double *sum,
+                     uint64_t *zero_count, ThreadPool *pool = nullptr) const;
+
+  void rank_histogram(const kernels::KernelTable &kernel_table,
+                      uint64_t *histogram, ThreadPool *pool = nullptr) const;
+
+  void merge(const LogLogBeta &merge_me,
+             const kernels::KernelTable &kernel_table,
+             ThreadPool *pool = nullptr);
+
+  bool merge_all(const LogLogBeta *const *sketches, uint64_t count,
+                 ThreadPool *pool);
+
+  // Whether view's entries decode to the end and are all registers of view,
+  // checked before anything is changed so corrupt input leaves no trace
+  static bool valid_entries(const LogLogBetaView &view);
+
+  // Whether every sketch is hashed with the same hasher as first
+  static bool same_hasher(const LogLogBeta &first,
+                          const LogLogBeta *const *sketches, uint64_t count);
+
+  static uint64_t union_cardinality(const LogLogBeta *const *sketches,
+                                    uint64_t count, ThreadPool *pool);
+
+  // Cardinalities of the values only in a, only in b and in both
+  static void joint_cardinality(const LogLogBeta &a, const LogLogBeta &b,
+                                JointEstimator estimator,
+                                double *cardinalities);
+
+  // Dense byte registers of sketch at precision_bits, its own registers when
+  // it already has them and otherwise scratch's
+  static const uint8_t *byte_registers(const LogLogBeta &sketch,
+                                       uint32_t precision_bits,
+                                       LogLogBeta *scratch);
+
+  void merge_dense(const DenseRegisters &merge_me,
+                   const kernels::KernelTable &kernel_table,
+                   ThreadPool *pool = nullptr);
+
+  // Merges registers shift bits more precise than these
+  void merge_folded(const DenseRegisters &merge_me, uint32_t shift,
+                    const kernels::KernelTable &kernel_table);
+
+  // Adds a sparse entry, or raises its register once dense
+  void add_entry(uint32_t entry);
+
+  void add_index_ranks(const uint32_t *indices, const uint8_t *ranks,
+                       uint64_t count);
+
+  void add_sparse(uint64_t index, uint8_t rank);
+
+  void compact_sparse();
+
+  void to_dense();
+
+  uint64_t register_bytes() const;
+
+  // Bytes of the m_registers allocation, registers plus kernel padding
+  uint64_t allocation_bytes() const;
+
+  void release_registers(uint8_t *registers, uint64_t bytes);
+
+  DenseRegisters dense_registers() const;
+
+  // First byte holding bits of a register
+  const uint8_t *register_address(uint64_t index) const;
+
+  void raise_register(uint64_t index, uint8_t rank);
+
+  // Counts an add_hash() of rank to index in the stats, before it's applied
+  void count_add(uint64_t index, uint8_t rank) const;
+
+  // Moves the incremental sum and zero count from one rank to another and
+  // marks the register changed
+  void register_raised(uint64_t index, uint8_t from, uint8_t to);
+
+  void mark_changed(uint64_t index) {
+    m_changed[index / 64] |= 1UL << (index % 64);
+  }
+
+  bool changed(uint64_t index) const {
+    return ((m_changed[index / 64] >> (index % 64)) & 1UL) != 0;
+  }
+
+  void mark_all_changed();
+
+  // Header of a serialized sketch up to the encoding and payload
+  serialization::Header serialization_header() const;
+
+  // Recomputes the incremental sum and zero count from the registers
+  void sync_estimate(const kernels::KernelTable &kernel_table,
+                     ThreadPool *pool = nullptr);
+
+  void raise_packed4(uint64_t index, uint8_t rank);
+
+  void set_packed4_offset(uint64_t index, uint8_t offset);
+
+  void rebase_packed4(const kernels::KernelTable &kernel_table);
+
+  void merge_packed4(const DenseRegisters &merge_me,
+                     const kernels::KernelTable &kernel_table);
+
   uint32_t m_precision_bits;
   uint32_t m_max_precision_bits;
 
   uint64_t m_register_count;
-  double m_alpha;
   uint8_t *m_registers;
+  RegisterLayout m_layout;
+  Hasher m_hasher;
+  // Registers come from the heap when null
+  RegisterStorage *m_storage;
+
+  // packed4 only, the rank every offset is relative to, the number of zero
+  // offsets and the sorted (index << 6 | rank) entries of overflowed registers
+  uint8_t m_base;
+  uint32_t m_zero_offsets;
+  std::vector<uint32_t> m_overflow;
+
+  // Used instead of m_registers while the sketch is sparse, the first
+  // m_sparse_sorted entries are sorted by index with one entry per index
+  std::vector<uint32_t> m_sparse;
+  uint32_t m_sparse_sorted;
+
+  // Register sum and zero count of dense registers, kept while m_incremental
+  bool m_incremental;
+  double m_sum;
+  uint64_t m_zero_count;
+
+  // One bit per register raised since the last serialize_changes(), kept
+  // while m_tracking
+  bool m_tracking;
+  std::vector<uint64_t> m_changed;
 };
 } // namespace llb
+
+#ifdef LLB_INLINE_HOT_PATH
+#include "LogLogBetaInline.h"
+#endif
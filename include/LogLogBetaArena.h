@@ -0,0 +1,71 @@
+/**
+ * LogLogBetaArena.h
+ */
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "RegisterStorage.h"
+
+namespace llb {
+namespace constants {
+// Alignment of register blocks handed out by an arena, enough for the
+// aligned stores of every kernel
+constexpr uint64_t k_arena_alignment = 64U;
+// Bytes reserved at a time by an arena, blocks larger than this get a slab
+// of their own
+constexpr uint64_t k_arena_slab_bytes = 1UL << 20;
+} // namespace constants
+
+// Hands out register blocks for sketches constructed with it, carved from
+// large slabs instead of one aligned allocation per sketch. Blocks given back
+// by destroyed sketches are kept on a free list per size and reused by the
+// next sketch of that size. Not thread safe, and every sketch using the arena
+// must be destroyed before the arena or a reset()
+class LogLogBetaArena : public RegisterStorage {
+public:
+  explicit LogLogBetaArena(
+      uint64_t slab_bytes = constants::k_arena_slab_bytes) noexcept;
+  ~LogLogBetaArena() noexcept override;
+
+  LogLogBetaArena(const LogLogBetaArena &) = delete;
+  LogLogBetaArena &operator=(const LogLogBetaArena &) = delete;
+
+  // bytes rounded up to the alignment, uninitialized
+  uint8_t *allocate(uint64_t bytes) override;
+
+  void deallocate(uint8_t *block, uint64_t bytes) override;
+
+  // Takes back every block at once while keeping the slabs, so the next
+  // window of sketches is carved from the same memory
+  void reset();
+
+  // Bytes of the slabs reserved so far
+  uint64_t reserved_bytes() const { return m_reserved_bytes; }
+
+  // Bytes of blocks handed out and not given back
+  uint64_t used_bytes() const { return m_used_bytes; }
+
+private:
+  struct Slab {
+    uint8_t *data;
+    uint64_t size;
+  };
+
+  struct FreeList {
+    uint64_t bytes;
+    uint8_t *head;
+  };
+
+  uint64_t m_slab_bytes;
+  std::vector<Slab> m_slabs;
+  // Slab blocks are carved from and the bytes of it already carved
+  uint64_t m_slab_ix;
+  uint64_t m_slab_offset;
+  // Free blocks link to the next one through their first bytes
+  std::vector<FreeList> m_free_lists;
+  uint64_t m_reserved_bytes;
+  uint64_t m_used_bytes;
+};
+} // namespace llb
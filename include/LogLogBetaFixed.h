@@ -0,0 +1,102 @@
+/**
+ * LogLogBetaFixed.h
+ */
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+
+#include "LogLogBeta.h"
+
+namespace llb {
+// A dense byte sketch whose precision is fixed at compile time. The index
+// shift, rank sentinel, register count and alpha are constants and the
+// registers live inline, so add_hash() is a few inlined instructions with no
+// representation or layout checks. Registers take 2^P bytes of the object
+// itself, so sketches of high precision belong on the heap, not the stack
+template <uint32_t P> class LogLogBetaFixed {
+public:
+  static_assert(P >= constants::k_minimum_precision &&
+                    P <= constants::k_maximum_precision,
+                "precision out of range");
+
+  static constexpr uint32_t k_precision_bits = P;
+  static constexpr uint64_t k_register_count = 1UL << P;
+  static constexpr uint32_t k_index_shift = 64U - P;
+  static constexpr uint64_t k_rank_sentinel = 1UL << (P - 1);
+  static constexpr double k_alpha =
+      constants::k_alpha1 /
+      (1.0 + constants::k_alpha2 / static_cast<double>(k_register_count));
+
+  LogLogBetaFixed() noexcept : m_registers{} {}
+
+  void add(const std::string &value) {
+    add(reinterpret_cast<const uint8_t *>(value.data()), value.size());
+  }
+
+  void add(const char *value, uint64_t length) {
+    add(reinterpret_cast<const uint8_t *>(value), length);
+  }
+
+  void add(const uint8_t *value, uint64_t length) {
+    add_hash(Hasher{}.hash(value, length));
+  }
+
+  void add_hash(uint64_t hash) {
+    const auto rank = static_cast<uint8_t>(
+        __builtin_clzll((hash << P) | k_rank_sentinel) + 1);
+    auto &reg = m_registers[hash >> k_index_shift];
+    reg = reg < rank ? rank : reg;
+  }
+
+  void add_hashes(const uint64_t *hashes, uint64_t count) {
+    for (auto hash_ix = 0UL; hash_ix < count; hash_ix += 1) {
+      add_hash(hashes[hash_ix]);
+    }
+  }
+
+  // Through the dispatched kernels like the sum, a loop of the baseline
+  // instruction set unrolled at compile time is about half as fast as the
+  // AVX2 and AVX-512 kernels picked at load time
+  void merge(const LogLogBetaFixed &merge_me) {
+    LogLogBeta::merge_byte_registers(m_registers, merge_me.m_registers,
+                                     k_register_count);
+  }
+
+  // Merges into a runtime sketch, folding whichever side is more precise.
+  // Values are hashed with the default Hasher, so false when sketch isn't
+  bool merge_into(LogLogBeta &sketch) const {
+    if (sketch.hasher() != Hasher{}) {
+      return false;
+    }
+    sketch.merge_byte_registers(m_registers, P);
+    return true;
+  }
+
+  uint64_t cardinality() const {
+    double sum = 0.0;
+    uint64_t zero_count = 0;
+    LogLogBeta::sum_byte_registers(m_registers, k_register_count, &sum,
+                                   &zero_count);
+    return static_cast<uint64_t>(
+        (k_alpha * k_register_count * (k_register_count - zero_count)) /
+        (LogLogBeta::beta(zero_count) + sum));
+  }
+
+  void clear() { std::fill_n(m_registers, k_register_count, uint8_t{0}); }
+
+  uint32_t precision_bits() const { return P; }
+
+  uint64_t register_count() const { return k_register_count; }
+
+  uint8_t register_at(uint64_t index) const { return m_registers[index]; }
+
+  const uint8_t *registers() const { return m_registers; }
+
+private:
+  // Padded like the runtime sketch's registers, kernels may load a vector
+  // past the end
+  alignas(64) uint8_t m_registers[k_register_count + 64];
+};
+} // namespace llb
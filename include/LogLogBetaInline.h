@@ -0,0 +1,38 @@
+/**
+ * LogLogBetaInline.h
+ */
+#pragma once
+
+#include "LogLogBeta.h"
+#include "Stats.h"
+
+// The insertion path. LogLogBeta.h includes it with LLB_INLINE_HOT_PATH so
+// it inlines into callers, otherwise it's compiled into the library once
+
+LLB_HOT_INLINE void llb::LogLogBeta::add(const uint8_t *value,
+                                         uint64_t length) {
+  add_hash(m_hasher.hash(value, length));
+}
+
+LLB_HOT_INLINE void llb::LogLogBeta::add_hash(uint64_t hash) {
+  // Count leading zeros, the rank kernels::hash_rank() gives
+  const auto val = static_cast<uint8_t>(
+      __builtin_clzll((hash << m_precision_bits) |
+                      (1UL << (m_precision_bits - 1))) +
+      1);
+
+  const auto k = hash >> m_max_precision_bits;
+  if (k_stats_enabled) {
+    count_add(k, val);
+  }
+  if (m_registers == nullptr) {
+    add_sparse(k, val);
+    return;
+  }
+  if (m_layout != RegisterLayout::byte || m_incremental || m_tracking) {
+    raise_register(k, val);
+    return;
+  }
+
+  m_registers[k] = m_registers[k] < val ? val : m_registers[k];
+}
@@ -0,0 +1,108 @@
+/**
+ * LogLogBetaTable.h
+ */
+#pragma once
+
+#include <cstdint>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "LogLogBeta.h"
+
+namespace llb {
+namespace constants {
+// Values of a keyed batch add sorted by key together
+constexpr uint32_t k_table_batch_size = 4096U;
+} // namespace constants
+
+// Distinct counts of many keys at once, like COUNT(DISTINCT value) GROUP BY
+// key. Keys are 64 bit, hash other keys first. Every key's byte registers sit
+// in one contiguous block of rows, and with Representation::sparse keys start
+// as sorted (index, rank) entries and only get a row once they are large.
+// Registers match a LogLogBeta of the same precision fed the key's values.
+// Not thread safe
+class LogLogBetaTable {
+public:
+  LogLogBetaTable(double error_rate = constants::k_default_error_rate,
+                  Representation representation = Representation::sparse)
+      noexcept;
+  ~LogLogBetaTable() noexcept;
+
+  LogLogBetaTable(const LogLogBetaTable &) = delete;
+  LogLogBetaTable &operator=(const LogLogBetaTable &) = delete;
+
+  void add_hash(uint64_t key, uint64_t hash) { add_hashes(&key, &hash, 1); }
+
+  // Adds hashes[i] to keys[i], sorting the values by key first so each key's
+  // registers are updated together
+  void add_hashes(const uint64_t *keys, const uint64_t *hashes,
+                  uint64_t count);
+
+  // 0 for keys never added to
+  uint64_t cardinality(uint64_t key) const;
+
+  // Merges every key of merge_me, adding the ones missing here. False if the
+  // tables have different precisions
+  bool merge(const LogLogBetaTable &merge_me);
+
+  // Keys with the highest cardinality and their cardinality, highest first
+  std::vector<std::pair<uint64_t, uint64_t>> top_k(uint64_t k) const;
+
+  uint64_t key_count() const { return m_keys.size(); }
+
+  // Keys in the order they were first added
+  const std::vector<uint64_t> &keys() const { return m_keys; }
+
+  bool contains(uint64_t key) const { return m_slots.count(key) != 0; }
+
+  bool is_sparse(uint64_t key) const;
+
+  uint32_t precision_bits() const { return m_precision_bits; }
+
+  uint64_t register_count() const { return m_register_count; }
+
+  uint8_t register_at(uint64_t key, uint64_t index) const;
+
+private:
+  // Slot of a key, added if missing
+  uint32_t slot(uint64_t key);
+
+  uint64_t cardinality_of(uint32_t slot) const;
+
+  uint8_t *row(uint32_t slot) const {
+    return &m_registers[static_cast<uint64_t>(m_rows[slot]) *
+                        m_register_count];
+  }
+
+  // Adds (index << 6 | rank) entries to a slot
+  void add_entries(uint32_t slot, const uint32_t *entries, uint64_t count);
+
+  // Entries of a sparse slot with one per index, sorted by index
+  std::vector<uint32_t> sorted_entries(uint32_t slot) const;
+
+  void to_dense(uint32_t slot);
+
+  uint32_t m_precision_bits;
+  uint64_t m_register_count;
+  Representation m_representation;
+
+  std::unordered_map<uint64_t, uint32_t> m_slots;
+  std::vector<uint64_t> m_keys;
+
+  // Row of every slot's registers, k_sparse_row while it is sparse
+  std::vector<uint32_t> m_rows;
+  uint8_t *m_registers;
+  uint32_t m_row_count;
+  uint32_t m_row_capacity;
+
+  // Entries of every sparse slot, the first m_sparse_sorted of them sorted by
+  // index with one entry per index, like a sparse LogLogBeta
+  std::vector<std::vector<uint32_t>> m_sparse;
+  std::vector<uint32_t> m_sparse_sorted;
+
+  // (slot << 32 | entry) values of the batch being added
+  std::vector<uint64_t> m_batch;
+  std::vector<uint64_t> m_scratch;
+};
+} // namespace llb
@@ -0,0 +1,61 @@
+/**
+ * LogLogBetaView.h
+ */
+#pragma once
+
+#include <cstdint>
+
+#include "LogLogBeta.h"
+
+namespace llb {
+// A read only sketch over a buffer written by LogLogBeta::serialize, for
+// example a mapped file or a network buffer. Nothing is copied, the buffer
+// must outlive the view
+class LogLogBetaView {
+public:
+  LogLogBetaView(const uint8_t *buffer, uint64_t size) noexcept;
+
+  // False when the buffer is truncated or not a supported format version
+  bool valid() const { return m_payload != nullptr; }
+
+  // Hashes the whole payload, so touches every page of it
+  bool verify_checksum() const;
+
+  // Bytes the serialized sketch takes up from the start of the buffer
+  uint64_t serialized_size() const;
+
+  uint32_t precision_bits() const { return m_precision_bits; }
+
+  uint64_t register_count() const { return 1UL << m_precision_bits; }
+
+  RegisterLayout layout() const { return m_layout; }
+
+  bool is_sparse() const { return m_sparse; }
+
+  const Hasher &hasher() const { return m_hasher; }
+
+  uint64_t hash_seed() const { return m_hasher.seed(); }
+
+  uint64_t cardinality() const;
+
+  uint8_t register_at(uint64_t index) const;
+
+private:
+  friend class LogLogBeta;
+
+  DenseRegisters dense_registers() const;
+
+  const uint8_t *m_buffer;
+  const uint8_t *m_payload;
+  uint32_t m_precision_bits;
+  RegisterLayout m_layout;
+  bool m_sparse;
+  uint8_t m_base;
+  Hasher m_hasher;
+  uint64_t m_payload_bytes;
+  uint64_t m_overflow_count;
+
+  // The payload is delta coded entries rather than registers
+  bool m_entries;
+};
+} // namespace llb
@@ -0,0 +1,88 @@
+/**
+ * MappedRegisterFile.h
+ */
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+#include "Hasher.h"
+#include "LogLogBeta.h"
+#include "RegisterStorage.h"
+
+namespace llb {
+// A memory mapped file of fixed size slots, each holding the dense registers
+// of one sketch, for sketch sets larger than the heap budget. Sketches built
+// with LogLogBeta(file, slot) update the mapping in place, so the OS pages
+// out cold sketches and reopening the file after a restart brings every
+// sketch back as it was. Only layouts whose registers are self contained,
+// byte and packed6, can be mapped. Not thread safe, and every sketch on the
+// file must be destroyed before the file or close()
+class MappedRegisterFile : public RegisterStorage {
+public:
+  MappedRegisterFile() noexcept;
+  ~MappedRegisterFile() noexcept override;
+
+  MappedRegisterFile(const MappedRegisterFile &) = delete;
+  MappedRegisterFile &operator=(const MappedRegisterFile &) = delete;
+
+  // Creates path with slot_count zeroed slots, or reopens it as it was,
+  // growing it to slot_count slots. False, leaving nothing open, when the
+  // file holds another precision, layout or hasher, or can't be mapped
+  bool open(const std::string &path, uint32_t precision_bits,
+            uint64_t slot_count,
+            RegisterLayout layout = RegisterLayout::byte,
+            Hasher hasher = Hasher{});
+
+  // Unmaps the file without waiting for the writes
+  void close();
+
+  bool is_open() const { return m_mapping != nullptr; }
+
+  // Writes the changed pages back and waits for them, false on an I/O error
+  bool checkpoint();
+
+  // Asks for transparent huge pages behind the slots and reads them in, for
+  // hot sketches. Huge pages need a kernel and file system that support
+  // them for files, elsewhere this just reads the slots in
+  void set_hot(uint64_t first_slot, uint64_t slot_count);
+
+  // Lets the OS drop the slots' pages from memory once they are written
+  void set_cold(uint64_t first_slot, uint64_t slot_count);
+
+  uint8_t *slot(uint64_t slot_ix) const {
+    return m_slots + slot_ix * m_slot_bytes;
+  }
+
+  uint64_t slot_count() const { return m_slot_count; }
+
+  // Registers plus the padding kernels read past them, a multiple of 64
+  uint64_t slot_bytes() const { return m_slot_bytes; }
+
+  uint32_t precision_bits() const { return m_precision_bits; }
+
+  RegisterLayout layout() const { return m_layout; }
+
+  const Hasher &hasher() const { return m_hasher; }
+
+  // Slots are never handed out this way, sketches that move their registers
+  // off the file get heap blocks and slots are never freed
+  uint8_t *allocate(uint64_t bytes) override;
+
+  void deallocate(uint8_t *block, uint64_t bytes) override;
+
+private:
+  // madvise()s the whole pages under slot_count slots from first_slot on
+  void advise(uint64_t first_slot, uint64_t slot_count, int advice);
+
+  uint8_t *m_mapping;
+  uint64_t m_mapping_bytes;
+  uint8_t *m_slots;
+  uint64_t m_slot_bytes;
+  uint64_t m_slot_count;
+  uint32_t m_precision_bits;
+  RegisterLayout m_layout;
+  Hasher m_hasher;
+  int m_fd;
+};
+} // namespace llb
@@ -0,0 +1,20 @@
+/**
+ * RegisterStorage.h
+ */
+#pragma once
+
+#include <cstdint>
+
+namespace llb {
+// Where a sketch's dense registers come from, passed to its constructor.
+// Sketches constructed without one use aligned heap blocks
+class RegisterStorage {
+public:
+  virtual ~RegisterStorage() noexcept = default;
+
+  // A block of at least bytes, 64 byte aligned and uninitialized
+  virtual uint8_t *allocate(uint64_t bytes) = 0;
+
+  virtual void deallocate(uint8_t *block, uint64_t bytes) = 0;
+};
+} // namespace llb
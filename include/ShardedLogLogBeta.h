@@ -0,0 +1,95 @@
+/**
+ * ShardedLogLogBeta.h
+ */
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "LogLogBeta.h"
+
+namespace llb {
+namespace constants {
+// Hashes each producer to shard ring holds, a power of two
+constexpr uint64_t k_shard_ring_size = 1UL << 14;
+// Most shards a sharded sketch is split into
+constexpr uint32_t k_maximum_shards = 64U;
+} // namespace constants
+
+// A dense byte sketch whose registers are split into shard_count contiguous
+// ranges, each owned by one worker thread. Producers route every hash by its
+// top bits to the owning shard through a single producer, single consumer
+// ring per producer and shard, so each worker raises only its own slice of
+// the registers with plain stores: no atomics on registers, no per thread
+// copies and no merge at the end
+class ShardedLogLogBeta {
+public:
+  // shard_count is rounded down to a power of two. producer_count threads
+  // can add at once, each with its own producer_ix below producer_count
+  ShardedLogLogBeta(double error_rate, uint32_t shard_count,
+                    uint32_t producer_count = 1U,
+                    Hasher hasher = Hasher{}) noexcept;
+  ~ShardedLogLogBeta() noexcept;
+
+  ShardedLogLogBeta(const ShardedLogLogBeta &) = delete;
+  ShardedLogLogBeta &operator=(const ShardedLogLogBeta &) = delete;
+
+  // Hands the hashes to their shards and returns without waiting for them
+  // to be applied, blocking only while a ring is full. A producer_ix must
+  // not be used from two threads at once
+  void add_hashes(uint32_t producer_ix, const uint64_t *hashes,
+                  uint64_t count);
+
+  // Waits until the shards have applied every hash added so far
+  void drain() const;
+
+  // Both drain first, and like register_at() must not overlap with adds
+  uint64_t cardinality() const;
+
+  // False if sketch is hashed with another hasher
+  bool merge_into(LogLogBeta *sketch) const;
+
+  const Hasher &hasher() const { return m_sketch.hasher(); }
+
+  uint32_t shard_count() const { return 1U << m_shard_bits; }
+
+  uint32_t producer_count() const { return m_producer_count; }
+
+  uint64_t register_count() const { return m_sketch.register_count(); }
+
+  uint8_t register_at(uint64_t index) const {
+    return m_sketch.register_at(index);
+  }
+
+private:
+  struct Ring {
+    // Hashes pushed, written by the producer
+    alignas(64) std::atomic<uint64_t> head;
+    // The producer's last read of tail
+    uint64_t cached_tail;
+    // Hashes applied, written by the shard
+    alignas(64) std::atomic<uint64_t> tail;
+    alignas(64) uint64_t hashes[constants::k_shard_ring_size];
+  };
+
+  Ring &ring(uint32_t producer_ix, uint32_t shard_ix) const {
+    return m_rings[producer_ix * shard_count() + shard_ix];
+  }
+
+  void work(uint32_t shard_ix);
+
+  // Applies the hashes waiting in ring, false if there were none
+  bool apply(Ring *ring);
+
+  LogLogBeta m_sketch;
+  uint32_t m_shard_bits;
+  uint32_t m_producer_count;
+  // Producer major, every shard's rings from one producer are adjacent
+  std::unique_ptr<Ring[]> m_rings;
+  std::vector<std::thread> m_threads;
+  std::atomic<bool> m_stop;
+};
+} // namespace llb
@@ -0,0 +1,98 @@
+/**
+ * SlidingLogLogBeta.h
+ */
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "LogLogBeta.h"
+
+namespace llb {
+namespace constants {
+// Updates of a register kept in the flat slot arrays, registers with more are
+// kept in a map instead
+constexpr uint32_t k_sliding_slots = 8U;
+} // namespace constants
+
+// Distinct counts over sliding time windows, like the last 5 minutes or the
+// last hour of a stream. Instead of a ring of per bucket sketches every
+// register keeps the (timestamp, rank) pairs that could still be its maximum
+// in some window: a pair is dropped once a later pair has at least its rank,
+// so ranks fall as timestamps rise and the list stays a handful of entries
+// long. The cost of a query is one walk over the registers whatever the
+// window, and pairs older than max_window are dropped as registers are
+// updated. Timestamps are in whatever unit the caller uses. Not thread safe
+class SlidingLogLogBeta {
+public:
+  SlidingLogLogBeta(uint64_t max_window,
+                    double error_rate = constants::k_default_error_rate)
+      noexcept;
+
+  void add(const std::string &value, uint64_t timestamp) {
+    add(reinterpret_cast<const uint8_t *>(value.data()), value.size(),
+        timestamp);
+  }
+
+  void add(const uint8_t *value, uint64_t length, uint64_t timestamp);
+
+  void add_hash(uint64_t hash, uint64_t timestamp);
+
+  void add_hashes(const uint64_t *hashes, const uint64_t *timestamps,
+                  uint64_t count);
+
+  // Estimate of the values added in (now - window, now], now being the latest
+  // timestamp added. Windows past max_window count from max_window
+  uint64_t cardinality(uint64_t window) const {
+    return cardinality(window, m_now);
+  }
+
+  // Same as above for a later now, earlier ones count from the latest
+  // timestamp added since updates outdone by later ones are gone
+  uint64_t cardinality(uint64_t window, uint64_t now) const;
+
+  // Adds the registers of the window to sketch. Values are hashed with the
+  // default Hasher, so false if sketch isn't or has another precision
+  bool merge_into(uint64_t window, uint64_t now, LogLogBeta *sketch) const;
+
+  uint64_t latest_timestamp() const { return m_now; }
+
+  uint64_t max_window() const { return m_max_window; }
+
+  uint32_t precision_bits() const { return m_precision_bits; }
+
+  uint64_t register_count() const { return m_counts.size(); }
+
+private:
+  struct Update {
+    uint64_t timestamp;
+    uint8_t rank;
+  };
+
+  void add_index_rank(uint64_t index, uint8_t rank, uint64_t timestamp);
+
+  // First timestamp of the window ending at now
+  uint64_t window_start(uint64_t window, uint64_t now) const;
+
+  // Highest rank of every register from since on, the rank of its oldest
+  // update from then as ranks fall while timestamps rise
+  void window_registers(uint64_t since, uint8_t *registers) const;
+
+  uint64_t m_max_window;
+  double m_error_rate;
+  uint32_t m_precision_bits;
+  uint32_t m_max_precision_bits;
+  uint64_t m_now;
+
+  // Updates of every register that could still be its maximum, oldest first.
+  // Slot s of register i is at s * register_count + i so a window query
+  // walks each slot's timestamps in order, most only needing the first
+  std::vector<uint64_t> m_timestamps;
+  std::vector<uint8_t> m_ranks;
+  std::vector<uint8_t> m_counts;
+  // Registers with more than k_sliding_slots updates, counted as k_spilled
+  std::unordered_map<uint64_t, std::vector<Update>> m_spilled;
+};
+} // namespace llb
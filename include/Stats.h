@@ -0,0 +1,44 @@
+/**
+ * Stats.h
+ */
+#pragma once
+
+#include <cstdint>
+
+namespace llb {
+// Stats are only counted when the library is built with LLB_STATS defined,
+// -DENABLE_STATS=ON, otherwise the counting compiles away and every snapshot
+// is zero
+#ifdef LLB_STATS
+constexpr bool k_stats_enabled = true;
+#else
+constexpr bool k_stats_enabled = false;
+#endif
+
+// What the sketches did. Counters only grow, so a rate is the difference of
+// two snapshots. Cycles are time stamp counter cycles on x86 and nanoseconds
+// elsewhere
+struct Stats {
+  // Hashes added to sketches and how many of them raised a dense register.
+  // Few raises per hash means the registers are saturated or a few hot keys
+  // repeat
+  uint64_t hashes_added;
+  uint64_t registers_raised;
+
+  uint64_t merges;
+  uint64_t merge_cycles;
+
+  uint64_t cardinalities;
+  uint64_t cardinality_cycles;
+
+  // Register sums and merges run by the kernels of each instruction set,
+  // indexed by InstructionSet
+  uint64_t kernel_runs[4];
+};
+
+// The calling thread's counters
+Stats thread_stats() noexcept;
+
+// Every thread's counters summed, including threads that have exited
+Stats process_stats() noexcept;
+} // namespace llb
@@ -0,0 +1,83 @@
+/**
+ * ThreadPool.h
+ */
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace llb {
+namespace constants {
+// Registers per task of a parallel merge or estimate, a multiple of every
+// layout's block size so chunks start on cache line boundaries
+constexpr uint64_t k_parallel_chunk_registers = 1UL << 16;
+// Sketches with fewer registers than this are merged and estimated serially
+constexpr uint64_t k_parallel_min_registers = 1UL << 18;
+} // namespace constants
+
+// Fixed set of threads that run the chunks of parallel merges and estimates.
+// Idle threads take the next chunk from a shared counter, so a thread that
+// is slow to wake or gets preempted just ends up doing fewer chunks
+class ThreadPool {
+public:
+  // thread_count counts the calling thread, 0 uses one per hardware thread
+  explicit ThreadPool(uint32_t thread_count = 0U) noexcept;
+  ~ThreadPool() noexcept;
+
+  ThreadPool(const ThreadPool &) = delete;
+  ThreadPool &operator=(const ThreadPool &) = delete;
+
+  // Pool shared by callers that don't bring their own, started on first use
+  static ThreadPool &shared();
+
+  uint32_t thread_count() const {
+    return static_cast<uint32_t>(m_threads.size()) + 1;
+  }
+
+  uint64_t min_parallel_registers() const { return m_min_parallel_registers; }
+
+  void set_min_parallel_registers(uint64_t register_count) {
+    m_min_parallel_registers = register_count;
+  }
+
+  // Runs task(0) to task(task_count - 1) across the pool and the calling
+  // thread, returning once all are done. Runs from several threads take
+  // turns, and a task must not run the pool it is running on
+  void run(uint64_t task_count, const std::function<void(uint64_t)> &task);
+
+private:
+  void work();
+
+  void run_tasks();
+
+  std::vector<std::thread> m_threads;
+  uint64_t m_min_parallel_registers;
+
+  std::mutex m_run_mutex;
+  std::mutex m_mutex;
+  std::condition_variable m_wake;
+  std::condition_variable m_done;
+  uint64_t m_generation;
+  uint32_t m_active;
+  bool m_stop;
+
+  const std::function<void(uint64_t)> *m_task;
+  uint64_t m_task_count;
+  std::atomic<uint64_t> m_next_task;
+};
+
+// Chunks register_count registers are split into on pool, 1 without a pool or
+// when they are too few to be worth splitting
+uint64_t chunk_count(const ThreadPool *pool, uint64_t register_count);
+
+// Runs task(chunk_ix, first_register, chunk_registers) for every chunk, on
+// the pool when there is more than one
+void run_chunks(ThreadPool *pool, uint64_t chunk_count,
+                uint64_t register_count,
+                const std::function<void(uint64_t, uint64_t, uint64_t)> &task);
+} // namespace llb
@@ -1,8 +1,25 @@
 #include "xxhash.h"
+#include "ConcurrentLogLogBeta.h"
 #include "LogLogBeta.h"
+#include "LogLogBetaArena.h"
+#include "LogLogBetaFixed.h"
+#include "LogLogBetaTable.h"
+#include "LogLogBetaView.h"
+#include "MappedRegisterFile.h"
+#include "ShardedLogLogBeta.h"
+#include "SlidingLogLogBeta.h"
+#include "ThreadPool.h"
 #include "PerfHelpers.h"
 #include <benchmark/benchmark.h>
 
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <unordered_map>
+
 #include <emmintrin.h>
 #include <immintrin.h>
 #include <xmmintrin.h>
@@ -126,6 +143,822 @@ static void MergeNonAvx(benchmark::State &state) {
   }
 }
 
+static void CardinalityLayout(benchmark::State &state,
+                              llb::RegisterLayout layout) {
+  const auto count = 10000;
+  llb::LogLogBeta llb{llb::constants::k_default_error_rate,
+                      llb::Representation::dense, layout};
+  for (auto ix = 0u; ix < count; ++ix) {
+    llb.add(random_string((random() % llb::k_string_length) + 1));
+  }
+
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(llb.cardinality());
+  }
+}
+
+static void MergeLayout(benchmark::State &state, llb::RegisterLayout layout) {
+  uint64_t count = 10000;
+
+  llb::LogLogBeta llb1{llb::constants::k_default_error_rate,
+                       llb::Representation::dense, layout};
+  llb::LogLogBeta llb2{llb::constants::k_default_error_rate,
+                       llb::Representation::dense, layout};
+  for (auto ix = 0u; ix < count; ++ix) {
+    llb1.add(random_string((random() % llb::k_string_length) + 1));
+    llb2.add(random_string((random() % llb::k_string_length) + 1));
+  }
+
+  for (auto _ : state) {
+    llb1.merge(llb2);
+  }
+}
+
+// Ingest of a batch of values into a sketch of precision state.range(0), the
+// loop versions are the per value baseline for the batch APIs
+static const size_t k_batch_values = 100000;
+
+static void AddHashLoop(benchmark::State &state) {
+  llb::LogLogBeta llb{error_rate_for(state.range(0))};
+  const auto hashes = random_hashes(k_batch_values);
+
+  for (auto _ : state) {
+    for (const auto hash : hashes) {
+      llb.add_hash(hash);
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * hashes.size());
+}
+
+// Hashes made in the caller's loop, a splitmix64 of a counter, so the loop
+// is all add_hash() and whatever of it the build lets the compiler inline
+static void CallerHashLoop(benchmark::State &state) {
+  llb::LogLogBeta llb{error_rate_for(state.range(0))};
+  auto counter = 0UL;
+
+  for (auto _ : state) {
+    for (auto ix = 0UL; ix < k_batch_values; ++ix) {
+      auto hash = (counter += 0x9E3779B97F4A7C15UL);
+      hash = (hash ^ (hash >> 30)) * 0xBF58476D1CE4E5B9UL;
+      hash = (hash ^ (hash >> 27)) * 0x94D049BB133111EBUL;
+      llb.add_hash(hash ^ (hash >> 31));
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * k_batch_values);
+}
+
+static void AddHashes(benchmark::State &state) {
+  llb::LogLogBeta llb{error_rate_for(state.range(0))};
+  const auto hashes = random_hashes(k_batch_values);
+
+  for (auto _ : state) {
+    llb.add_hashes(hashes.data(), hashes.size());
+  }
+  state.SetItemsProcessed(state.iterations() * hashes.size());
+}
+
+static void AddStringLoop(benchmark::State &state) {
+  llb::LogLogBeta llb{error_rate_for(state.range(0))};
+  std::vector<std::string> strs;
+  for (auto ix = 0u; ix < k_batch_values; ++ix) {
+    strs.push_back(random_string((random() % llb::k_string_length) + 1));
+  }
+
+  for (auto _ : state) {
+    for (const auto &str : strs) {
+      llb.add(str);
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * strs.size());
+}
+
+static void AddManyContiguous(benchmark::State &state) {
+  llb::LogLogBeta llb{error_rate_for(state.range(0))};
+  std::string buffer;
+  std::vector<uint64_t> offsets{0};
+  for (auto ix = 0u; ix < k_batch_values; ++ix) {
+    buffer += random_string((random() % llb::k_string_length) + 1);
+    offsets.push_back(buffer.size());
+  }
+
+  for (auto _ : state) {
+    llb.add_many(reinterpret_cast<const uint8_t *>(buffer.data()),
+                 offsets.data(), k_batch_values);
+  }
+  state.SetItemsProcessed(state.iterations() * k_batch_values);
+}
+
+static void Deserialize(benchmark::State &state) {
+  llb::LogLogBeta llb;
+  const auto hashes = random_hashes(100000);
+  llb.add_hashes(hashes.data(), hashes.size());
+  const auto buffer = llb.serialize();
+
+  for (auto _ : state) {
+    llb::LogLogBeta loaded;
+    loaded.deserialize(buffer.data(), buffer.size());
+    benchmark::DoNotOptimize(loaded.cardinality());
+  }
+}
+
+static void ViewCardinality(benchmark::State &state) {
+  llb::LogLogBeta llb;
+  const auto hashes = random_hashes(100000);
+  llb.add_hashes(hashes.data(), hashes.size());
+  const auto buffer = llb.serialize();
+
+  for (auto _ : state) {
+    const llb::LogLogBetaView view{buffer.data(), buffer.size()};
+    benchmark::DoNotOptimize(view.cardinality());
+  }
+}
+
+static void AddHashesIncremental(benchmark::State &state) {
+  llb::LogLogBeta llb{error_rate_for(state.range(0))};
+  llb.set_incremental_estimate(true);
+  const auto hashes = random_hashes(k_batch_values);
+
+  for (auto _ : state) {
+    llb.add_hashes(hashes.data(), hashes.size());
+  }
+  state.SetItemsProcessed(state.iterations() * hashes.size());
+}
+
+// A cold sketch, every value raises a register
+static void AddHashesColdIncremental(benchmark::State &state) {
+  const auto hashes = random_hashes(k_batch_values);
+
+  for (auto _ : state) {
+    state.PauseTiming();
+    llb::LogLogBeta llb{error_rate_for(state.range(0))};
+    llb.set_incremental_estimate(state.range(1) != 0);
+    state.ResumeTiming();
+    llb.add_hashes(hashes.data(), hashes.size());
+  }
+  state.SetItemsProcessed(state.iterations() * hashes.size());
+}
+
+static void CardinalityIncremental(benchmark::State &state) {
+  llb::LogLogBeta llb{error_rate_for(state.range(0))};
+  llb.set_incremental_estimate(true);
+  const auto hashes = random_hashes(k_batch_values);
+  llb.add_hashes(hashes.data(), hashes.size());
+
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(llb.cardinality());
+  }
+}
+
+static void CardinalityRescan(benchmark::State &state) {
+  llb::LogLogBeta llb{error_rate_for(state.range(0))};
+  const auto hashes = random_hashes(k_batch_values);
+  llb.add_hashes(hashes.data(), hashes.size());
+
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(llb.cardinality());
+  }
+}
+
+// Sketches with a few thousand values each, like hourly rollups
+static std::vector<std::unique_ptr<llb::LogLogBeta>>
+merge_inputs(int64_t count, int64_t precision_bits) {
+  std::vector<std::unique_ptr<llb::LogLogBeta>> sketches;
+  for (auto sketch_ix = 0; sketch_ix < count; ++sketch_ix) {
+    sketches.emplace_back(
+        new llb::LogLogBeta{error_rate_for(precision_bits)});
+    const auto hashes = random_hashes(5000);
+    sketches.back()->add_hashes(hashes.data(), hashes.size());
+  }
+  return sketches;
+}
+
+static void MergeManyPairwise(benchmark::State &state) {
+  const auto sketches = merge_inputs(state.range(0), state.range(1));
+
+  for (auto _ : state) {
+    llb::LogLogBeta merged{error_rate_for(state.range(1))};
+    for (const auto &sketch : sketches) {
+      merged.merge(*sketch);
+    }
+    benchmark::DoNotOptimize(merged.register_at(0));
+  }
+  state.SetItemsProcessed(state.iterations() * sketches.size());
+}
+
+static void MergeMany(benchmark::State &state) {
+  const auto sketches = merge_inputs(state.range(0), state.range(1));
+  std::vector<const llb::LogLogBeta *> inputs;
+  for (const auto &sketch : sketches) {
+    inputs.push_back(sketch.get());
+  }
+
+  for (auto _ : state) {
+    llb::LogLogBeta merged{error_rate_for(state.range(1))};
+    merged.merge_all(inputs);
+    benchmark::DoNotOptimize(merged.register_at(0));
+  }
+  state.SetItemsProcessed(state.iterations() * sketches.size());
+}
+
+static void UnionCardinality(benchmark::State &state) {
+  const auto sketches = merge_inputs(state.range(0), state.range(1));
+  std::vector<const llb::LogLogBeta *> inputs;
+  for (const auto &sketch : sketches) {
+    inputs.push_back(sketch.get());
+  }
+
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(llb::LogLogBeta::union_cardinality(inputs));
+  }
+  state.SetItemsProcessed(state.iterations() * sketches.size());
+}
+
+// Merges a sketch range(0) bits more precise, folding it on the fly
+static void MergeFolded(benchmark::State &state) {
+  llb::LogLogBeta llb;
+  llb::LogLogBeta merge_me{
+      error_rate_for(llb::constants::k_default_precision + state.range(0))};
+  const auto hashes = random_hashes(k_batch_values);
+  merge_me.add_hashes(hashes.data(), hashes.size());
+
+  for (auto _ : state) {
+    llb.merge(merge_me);
+  }
+  state.SetBytesProcessed(state.iterations() * merge_me.register_count());
+}
+
+// range(0) is the precision and range(1) the pool's thread count
+static void ParallelCardinality(benchmark::State &state) {
+  llb::ThreadPool pool{static_cast<uint32_t>(state.range(1))};
+  llb::LogLogBeta llb{error_rate_for(state.range(0))};
+  const auto hashes = random_hashes(k_batch_values);
+  llb.add_hashes(hashes.data(), hashes.size());
+
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(llb.cardinality(pool));
+  }
+  state.SetBytesProcessed(state.iterations() * llb.register_count());
+}
+
+static void ParallelMerge(benchmark::State &state) {
+  llb::ThreadPool pool{static_cast<uint32_t>(state.range(1))};
+  llb::LogLogBeta llb{error_rate_for(state.range(0))};
+  llb::LogLogBeta merge_me{error_rate_for(state.range(0))};
+  const auto hashes = random_hashes(k_batch_values);
+  merge_me.add_hashes(hashes.data(), hashes.size());
+
+  for (auto _ : state) {
+    llb.merge(merge_me, pool);
+  }
+  state.SetBytesProcessed(state.iterations() * llb.register_count());
+}
+
+static void ParallelUnionCardinality(benchmark::State &state) {
+  llb::ThreadPool pool{static_cast<uint32_t>(state.range(1))};
+  const auto sketches = merge_inputs(16, state.range(0));
+  std::vector<const llb::LogLogBeta *> inputs;
+  for (const auto &sketch : sketches) {
+    inputs.push_back(sketch.get());
+  }
+
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(llb::LogLogBeta::union_cardinality(
+        inputs.data(), inputs.size(), pool));
+  }
+  state.SetBytesProcessed(state.iterations() * inputs.size() *
+                          inputs[0]->register_count());
+}
+
+// Builds and drops a table of small per-key sketches, one value each
+static void SketchTableHeap(benchmark::State &state) {
+  const auto error_rate = error_rate_for(llb::constants::k_minimum_precision);
+  std::vector<llb::LogLogBeta> sketches;
+  sketches.reserve(state.range(0));
+
+  for (auto _ : state) {
+    for (auto sketch_ix = 0; sketch_ix < state.range(0); ++sketch_ix) {
+      sketches.emplace_back(error_rate);
+      sketches.back().add_hash(sketch_ix);
+    }
+    sketches.clear();
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+// Same as above with the registers carved from an arena, reset per window
+static void SketchTableArena(benchmark::State &state) {
+  const auto error_rate = error_rate_for(llb::constants::k_minimum_precision);
+  llb::LogLogBetaArena arena;
+  std::vector<llb::LogLogBeta> sketches;
+  sketches.reserve(state.range(0));
+
+  for (auto _ : state) {
+    for (auto sketch_ix = 0; sketch_ix < state.range(0); ++sketch_ix) {
+      sketches.emplace_back(arena, error_rate);
+      sketches.back().add_hash(sketch_ix);
+    }
+    sketches.clear();
+    arena.reset();
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+// Values spread over state.range(0) keys, the first key of every ten taking
+// half of them so a few keys go dense while most stay small
+static std::pair<std::vector<uint64_t>, std::vector<uint64_t>>
+keyed_values(int64_t key_count) {
+  const auto hashes = random_hashes(1 << 20);
+  std::vector<uint64_t> keys;
+  for (auto hash_ix = 0UL; hash_ix < hashes.size(); ++hash_ix) {
+    const auto key = hashes[hash_ix] % key_count;
+    keys.push_back(hash_ix % 2 == 0 ? key - key % 10 : key);
+  }
+  return {keys, hashes};
+}
+
+static void KeyedAddMap(benchmark::State &state) {
+  const auto values = keyed_values(state.range(0));
+  const auto error_rate = error_rate_for(12);
+
+  for (auto _ : state) {
+    std::unordered_map<uint64_t, llb::LogLogBeta> sketches;
+    for (auto value_ix = 0UL; value_ix < values.first.size(); ++value_ix) {
+      auto it = sketches.find(values.first[value_ix]);
+      if (it == sketches.end()) {
+        it = sketches
+                 .emplace(values.first[value_ix],
+                          llb::LogLogBeta{error_rate,
+                                          llb::Representation::sparse})
+                 .first;
+      }
+      it->second.add_hash(values.second[value_ix]);
+    }
+    benchmark::DoNotOptimize(sketches.size());
+  }
+  state.SetItemsProcessed(state.iterations() * values.first.size());
+}
+
+static void KeyedAddTable(benchmark::State &state) {
+  const auto values = keyed_values(state.range(0));
+  const auto error_rate = error_rate_for(12);
+
+  for (auto _ : state) {
+    llb::LogLogBetaTable table{error_rate};
+    table.add_hashes(values.first.data(), values.second.data(),
+                     values.first.size());
+    benchmark::DoNotOptimize(table.key_count());
+  }
+  state.SetItemsProcessed(state.iterations() * values.first.size());
+}
+
+// Last hour distinct count kept as a ring of state.range(0) bucket sketches
+// merged on every query
+static void WindowRingCardinality(benchmark::State &state) {
+  const auto hashes = random_hashes(1 << 20);
+  std::vector<llb::LogLogBeta> buckets(state.range(0));
+  for (auto hash_ix = 0UL; hash_ix < hashes.size(); ++hash_ix) {
+    buckets[hash_ix * buckets.size() / hashes.size()].add_hash(hashes[hash_ix]);
+  }
+
+  for (auto _ : state) {
+    llb::LogLogBeta merged;
+    for (const auto &bucket : buckets) {
+      merged.merge(bucket);
+    }
+    benchmark::DoNotOptimize(merged.cardinality());
+  }
+}
+
+// Same stream with one timestamp per bucket in a sliding sketch
+static void SlidingCardinality(benchmark::State &state) {
+  const auto hashes = random_hashes(1 << 20);
+  std::vector<uint64_t> timestamps;
+  for (auto hash_ix = 0UL; hash_ix < hashes.size(); ++hash_ix) {
+    timestamps.push_back(hash_ix * state.range(0) / hashes.size());
+  }
+  llb::SlidingLogLogBeta sliding{static_cast<uint64_t>(state.range(0))};
+  sliding.add_hashes(hashes.data(), timestamps.data(), hashes.size());
+
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(sliding.cardinality(state.range(0)));
+  }
+}
+
+static void SlidingAddHashes(benchmark::State &state) {
+  const auto hashes = random_hashes(1 << 20);
+  std::vector<uint64_t> timestamps;
+  for (auto hash_ix = 0UL; hash_ix < hashes.size(); ++hash_ix) {
+    timestamps.push_back(hash_ix * 3600 / hashes.size());
+  }
+
+  for (auto _ : state) {
+    llb::SlidingLogLogBeta sliding{3600};
+    sliding.add_hashes(hashes.data(), timestamps.data(), hashes.size());
+    benchmark::DoNotOptimize(sliding.latest_timestamp());
+  }
+  state.SetItemsProcessed(state.iterations() * hashes.size());
+}
+
+// |A n B| by hand, copying A into a union sketch to estimate it
+static void IntersectionByUnion(benchmark::State &state) {
+  const auto hashes = random_hashes(200000);
+  llb::LogLogBeta a;
+  a.add_hashes(hashes.data(), 150000);
+  llb::LogLogBeta b;
+  b.add_hashes(&hashes[50000], 150000);
+
+  for (auto _ : state) {
+    llb::LogLogBeta merged;
+    merged.merge(a);
+    merged.merge(b);
+    benchmark::DoNotOptimize(a.cardinality() + b.cardinality() -
+                             merged.cardinality());
+  }
+}
+
+static void IntersectionCardinality(benchmark::State &state,
+                                    llb::JointEstimator estimator) {
+  const auto hashes = random_hashes(200000);
+  llb::LogLogBeta a;
+  a.add_hashes(hashes.data(), 150000);
+  llb::LogLogBeta b;
+  b.add_hashes(&hashes[50000], 150000);
+
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(
+        llb::LogLogBeta::intersection_cardinality(a, b, estimator));
+  }
+}
+
+static void CardinalityEstimator(benchmark::State &state,
+                                 llb::Estimator estimator) {
+  llb::LogLogBeta llb{error_rate_for(state.range(0))};
+  const auto hashes = random_hashes(k_batch_values);
+  llb.add_hashes(hashes.data(), hashes.size());
+
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(llb.cardinality(estimator));
+  }
+}
+
+// Every thread adds its own hashes into one shared sketch
+static void ConcurrentAdd(benchmark::State &state) {
+  static llb::ConcurrentLogLogBeta llb;
+  thread_local const auto hashes = random_hashes(k_batch_values);
+
+  for (auto _ : state) {
+    llb.add_hashes(hashes.data(), hashes.size());
+  }
+  state.SetItemsProcessed(state.iterations() * hashes.size());
+}
+
+// Every thread adds into its own sketch and merges it into a shared one per
+// batch, standing in for merging at query time
+static void PerThreadAddMerge(benchmark::State &state) {
+  static llb::LogLogBeta shared;
+  static std::mutex shared_mutex;
+  thread_local const auto hashes = random_hashes(k_batch_values);
+  thread_local llb::LogLogBeta llb;
+
+  for (auto _ : state) {
+    llb.add_hashes(hashes.data(), hashes.size());
+    std::lock_guard<std::mutex> lock(shared_mutex);
+    shared.merge(llb);
+  }
+  state.SetItemsProcessed(state.iterations() * hashes.size());
+}
+
+// The fixed precision sketch against the runtime one at the same precision,
+// state.range(0) for the runtime sketches and P for the fixed ones
+static void MergePrecision(benchmark::State &state) {
+  llb::LogLogBeta llb1{error_rate_for(state.range(0))};
+  llb::LogLogBeta llb2{error_rate_for(state.range(0))};
+  const auto hashes = random_hashes(k_batch_values);
+  llb1.add_hashes(hashes.data(), hashes.size() / 2);
+  llb2.add_hashes(&hashes[hashes.size() / 2], hashes.size() / 2);
+
+  for (auto _ : state) {
+    llb1.merge(llb2);
+  }
+}
+
+static void CardinalityPrecision(benchmark::State &state) {
+  llb::LogLogBeta llb{error_rate_for(state.range(0))};
+  const auto hashes = random_hashes(k_batch_values);
+  llb.add_hashes(hashes.data(), hashes.size());
+
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(llb.cardinality());
+  }
+}
+
+template <uint32_t P> static void FixedAddHashLoop(benchmark::State &state) {
+  auto llb = std::make_unique<llb::LogLogBetaFixed<P>>();
+  const auto hashes = random_hashes(k_batch_values);
+
+  for (auto _ : state) {
+    for (const auto hash : hashes) {
+      llb->add_hash(hash);
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * hashes.size());
+}
+
+template <uint32_t P> static void FixedMerge(benchmark::State &state) {
+  auto llb1 = std::make_unique<llb::LogLogBetaFixed<P>>();
+  auto llb2 = std::make_unique<llb::LogLogBetaFixed<P>>();
+  const auto hashes = random_hashes(k_batch_values);
+  llb1->add_hashes(hashes.data(), hashes.size() / 2);
+  llb2->add_hashes(&hashes[hashes.size() / 2], hashes.size() / 2);
+
+  for (auto _ : state) {
+    llb1->merge(*llb2);
+    benchmark::ClobberMemory();
+  }
+}
+
+template <uint32_t P> static void FixedCardinality(benchmark::State &state) {
+  auto llb = std::make_unique<llb::LogLogBetaFixed<P>>();
+  const auto hashes = random_hashes(k_batch_values);
+  llb->add_hashes(hashes.data(), hashes.size());
+
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(llb->cardinality());
+  }
+}
+
+// Integer and UUID keys hashed one at a time and in SIMD batches
+static void AddKeyLoop(benchmark::State &state, llb::HashFunction function) {
+  llb::LogLogBeta llb{llb::constants::k_default_error_rate,
+                      llb::Representation::dense, llb::RegisterLayout::byte,
+                      llb::Hasher{function}};
+  const auto keys = random_hashes(k_batch_values);
+
+  for (auto _ : state) {
+    for (const auto key : keys) {
+      llb.add(key);
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * keys.size());
+}
+
+static void AddKeys(benchmark::State &state, llb::HashFunction function) {
+  llb::LogLogBeta llb{llb::constants::k_default_error_rate,
+                      llb::Representation::dense, llb::RegisterLayout::byte,
+                      llb::Hasher{function}};
+  const auto keys = random_hashes(k_batch_values);
+
+  for (auto _ : state) {
+    llb.add_keys(keys.data(), keys.size());
+  }
+  state.SetItemsProcessed(state.iterations() * keys.size());
+}
+
+static void AddUuids(benchmark::State &state, llb::HashFunction function) {
+  llb::LogLogBeta llb{llb::constants::k_default_error_rate,
+                      llb::Representation::dense, llb::RegisterLayout::byte,
+                      llb::Hasher{function}};
+  const auto words = random_hashes(k_batch_values * 2);
+  std::vector<llb::Uuid> uuids(k_batch_values);
+  std::memcpy(uuids.data(), words.data(), uuids.size() * sizeof(llb::Uuid));
+
+  for (auto _ : state) {
+    llb.add_keys(uuids.data(), uuids.size());
+  }
+  state.SetItemsProcessed(state.iterations() * uuids.size());
+}
+
+// Hashes for the multi-core ingests, too many to make from random strings
+static std::vector<uint64_t> ingest_hashes() {
+  std::mt19937_64 generator{1};
+  std::vector<uint64_t> hashes(1UL << 22);
+  for (auto &hash : hashes) {
+    hash = generator();
+  }
+  return hashes;
+}
+
+// One sketch of precision range(0) ingested on range(1) cores: that many
+// producers route hashes to that many shards
+static void ShardedIngest(benchmark::State &state) {
+  const auto cores = static_cast<uint32_t>(state.range(1));
+  llb::ThreadPool pool{cores};
+  llb::ShardedLogLogBeta llb{error_rate_for(state.range(0)), cores, cores};
+  const auto hashes = ingest_hashes();
+  const auto part = hashes.size() / cores;
+
+  for (auto _ : state) {
+    pool.run(cores, [&](uint64_t producer_ix) {
+      llb.add_hashes(static_cast<uint32_t>(producer_ix),
+                     &hashes[producer_ix * part], part);
+    });
+    benchmark::DoNotOptimize(llb.cardinality());
+  }
+  state.SetItemsProcessed(state.iterations() * part * cores);
+  state.counters["sketch_mb"] =
+      static_cast<double>(llb.register_count()) / (1 << 20);
+}
+
+// The same ingest with a full copy of the sketch per core, merged at the end
+static void CopyMergeIngest(benchmark::State &state) {
+  const auto cores = static_cast<uint32_t>(state.range(1));
+  llb::ThreadPool pool{cores};
+  std::vector<std::unique_ptr<llb::LogLogBeta>> copies;
+  std::vector<const llb::LogLogBeta *> inputs;
+  for (auto core_ix = 0U; core_ix < cores; ++core_ix) {
+    copies.emplace_back(new llb::LogLogBeta{error_rate_for(state.range(0))});
+    inputs.push_back(copies.back().get());
+  }
+  llb::LogLogBeta llb{error_rate_for(state.range(0))};
+  const auto hashes = ingest_hashes();
+  const auto part = hashes.size() / cores;
+
+  for (auto _ : state) {
+    pool.run(cores, [&](uint64_t core_ix) {
+      copies[core_ix]->add_hashes(&hashes[core_ix * part], part);
+    });
+    llb.merge_all(inputs);
+    benchmark::DoNotOptimize(llb.cardinality());
+  }
+  state.SetItemsProcessed(state.iterations() * part * cores);
+  state.counters["sketch_mb"] =
+      static_cast<double>(llb.register_count() * (cores + 1)) / (1 << 20);
+}
+
+// A sketch of precision range(0) holding 1M values that is tracking changes,
+// after range(1) more values were added
+static llb::LogLogBeta churned_sketch(benchmark::State &state) {
+  std::mt19937_64 generator{2};
+  std::vector<uint64_t> hashes(1UL << 20);
+  for (auto &hash : hashes) {
+    hash = generator();
+  }
+  llb::LogLogBeta llb{error_rate_for(state.range(0))};
+  llb.add_hashes(hashes.data(), hashes.size());
+  llb.set_change_tracking(true);
+
+  hashes.resize(state.range(1));
+  for (auto &hash : hashes) {
+    hash = generator();
+  }
+  llb.add_hashes(hashes.data(), hashes.size());
+  return llb;
+}
+
+// A replica applying the changes of a churned sketch
+static void ApplyChanges(benchmark::State &state) {
+  auto primary = churned_sketch(state);
+  const auto changed = primary.changed_register_count();
+  const auto changes = primary.serialize_changes();
+  const llb::LogLogBetaView view{changes.data(), changes.size()};
+  llb::LogLogBeta replica{error_rate_for(state.range(0))};
+
+  for (auto _ : state) {
+    replica.merge(view);
+  }
+  state.counters["changed"] = static_cast<double>(changed);
+  state.counters["sent_bytes"] = static_cast<double>(changes.size());
+}
+
+// The same replica merging the whole serialized sketch instead
+static void ApplyFullSketch(benchmark::State &state) {
+  const auto primary = churned_sketch(state);
+  const auto buffer = primary.serialize();
+  const llb::LogLogBetaView view{buffer.data(), buffer.size()};
+  llb::LogLogBeta replica{error_rate_for(state.range(0))};
+
+  for (auto _ : state) {
+    replica.merge(view);
+  }
+  state.counters["sent_bytes"] = static_cast<double>(buffer.size());
+}
+
+static void AddHashesTracked(benchmark::State &state) {
+  llb::LogLogBeta llb{error_rate_for(state.range(0))};
+  llb.set_change_tracking(true);
+  const auto hashes = random_hashes(k_batch_values);
+
+  for (auto _ : state) {
+    llb.add_hashes(hashes.data(), hashes.size());
+  }
+  state.SetItemsProcessed(state.iterations() * hashes.size());
+}
+
+// 10K precision 14 sketches, far more than the caches hold
+static std::vector<std::unique_ptr<llb::LogLogBeta>> report_sketches() {
+  const auto hashes = random_hashes(k_batch_values);
+  llb::LogLogBeta prototype{error_rate_for(14)};
+  prototype.add_hashes(hashes.data(), hashes.size());
+  std::vector<std::unique_ptr<llb::LogLogBeta>> sketches;
+  for (auto sketch_ix = 0UL; sketch_ix < 10000; ++sketch_ix) {
+    sketches.emplace_back(new llb::LogLogBeta{error_rate_for(14)});
+    sketches.back()->merge(prototype);
+  }
+  return sketches;
+}
+
+static void CardinalityLoop(benchmark::State &state) {
+  const auto sketches = report_sketches();
+
+  for (auto _ : state) {
+    for (const auto &sketch : sketches) {
+      benchmark::DoNotOptimize(sketch->cardinality());
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * sketches.size());
+}
+
+static void CardinalityBatch(benchmark::State &state) {
+  const auto sketches = report_sketches();
+  std::vector<const llb::LogLogBeta *> inputs;
+  for (const auto &sketch : sketches) {
+    inputs.push_back(sketch.get());
+  }
+  std::vector<uint64_t> cardinalities(inputs.size());
+
+  for (auto _ : state) {
+    llb::LogLogBeta::cardinality_batch(inputs, cardinalities.data());
+    benchmark::DoNotOptimize(cardinalities.data());
+  }
+  state.SetItemsProcessed(state.iterations() * inputs.size());
+}
+
+static std::string mapped_path() {
+  const auto *directory = std::getenv("TMPDIR");
+  return std::string{directory != nullptr ? directory : "/tmp"} +
+         "/llb_perf_registers";
+}
+
+// The sketches of report_sketches() in a freshly written file
+static void write_mapped_sketches(const std::string &path) {
+  std::remove(path.c_str());
+  const auto sketches = report_sketches();
+  llb::MappedRegisterFile file;
+  file.open(path, 14, sketches.size());
+  for (auto slot_ix = 0UL; slot_ix < sketches.size(); ++slot_ix) {
+    llb::LogLogBeta{file, slot_ix}.merge(*sketches[slot_ix]);
+  }
+  file.checkpoint();
+}
+
+// A restart with the sketches in a file, nothing is read until it's used
+static void MappedOpen(benchmark::State &state) {
+  const auto path = mapped_path();
+  write_mapped_sketches(path);
+
+  for (auto _ : state) {
+    llb::MappedRegisterFile file;
+    file.open(path, 14, 10000);
+    std::vector<std::unique_ptr<llb::LogLogBeta>> sketches;
+    for (auto slot_ix = 0UL; slot_ix < file.slot_count(); ++slot_ix) {
+      sketches.emplace_back(new llb::LogLogBeta{file, slot_ix});
+    }
+    benchmark::DoNotOptimize(sketches.data());
+  }
+  state.SetItemsProcessed(state.iterations() * 10000);
+  std::remove(path.c_str());
+}
+
+// The same restart from serialized sketches
+static void DeserializeAll(benchmark::State &state) {
+  std::vector<std::vector<uint8_t>> buffers;
+  for (const auto &sketch : report_sketches()) {
+    buffers.push_back(sketch->serialize());
+  }
+
+  for (auto _ : state) {
+    std::vector<std::unique_ptr<llb::LogLogBeta>> sketches;
+    for (const auto &buffer : buffers) {
+      sketches.emplace_back(new llb::LogLogBeta{error_rate_for(14)});
+      sketches.back()->deserialize(buffer.data(), buffer.size());
+    }
+    benchmark::DoNotOptimize(sketches.data());
+  }
+  state.SetItemsProcessed(state.iterations() * buffers.size());
+}
+
+// A checkpoint after state.range(0) percent of the sketches changed. A bit
+// of the first register flips, so a page of each changed slot is dirty
+static void MappedCheckpoint(benchmark::State &state) {
+  const auto path = mapped_path();
+  write_mapped_sketches(path);
+  llb::MappedRegisterFile file;
+  file.open(path, 14, 10000);
+  const auto changed = file.slot_count() * state.range(0) / 100;
+
+  for (auto _ : state) {
+    state.PauseTiming();
+    for (auto slot_ix = 0UL; slot_ix < changed; ++slot_ix) {
+      file.slot(slot_ix)[0] ^= 1;
+    }
+    state.ResumeTiming();
+    benchmark::DoNotOptimize(file.checkpoint());
+  }
+  state.SetBytesProcessed(state.iterations() * changed * 4096);
+  file.close();
+  std::remove(path.c_str());
+}
+
 BENCHMARK(AddString);
 BENCHMARK(AddHash);
 BENCHMARK(Cardinality);
@@ -134,3 +967,89 @@ BENCHMARK(Merge);
 BENCHMARK(MergeNonAvx);
 BENCHMARK(FullTest);
 BENCHMARK(FullTestNonAvx);
+BENCHMARK_CAPTURE(CardinalityLayout, Packed6, llb::RegisterLayout::packed6);
+BENCHMARK_CAPTURE(CardinalityLayout, Packed4, llb::RegisterLayout::packed4);
+BENCHMARK_CAPTURE(MergeLayout, Packed6, llb::RegisterLayout::packed6);
+BENCHMARK_CAPTURE(MergeLayout, Packed4, llb::RegisterLayout::packed4);
+BENCHMARK(AddHashLoop)->Arg(14)->Arg(20);
+BENCHMARK(CallerHashLoop)->Arg(14)->Arg(20);
+BENCHMARK(AddHashes)->Arg(14)->Arg(20);
+BENCHMARK(AddStringLoop)->Arg(14)->Arg(20);
+BENCHMARK(AddManyContiguous)->Arg(14)->Arg(20);
+BENCHMARK(Deserialize);
+BENCHMARK(ViewCardinality);
+BENCHMARK(AddHashesIncremental)->Arg(14)->Arg(20);
+BENCHMARK(AddHashesColdIncremental)->Args({14, 0})->Args({14, 1});
+BENCHMARK(CardinalityRescan)->Arg(14)->Arg(20);
+BENCHMARK(CardinalityIncremental)->Arg(14)->Arg(20);
+BENCHMARK(MergeManyPairwise)
+    ->ArgsProduct({{2, 8, 64, 256, 1024}, {14, 18}});
+BENCHMARK(MergeMany)
+    ->ArgsProduct({{2, 8, 64, 256, 1024}, {14, 18}});
+BENCHMARK(UnionCardinality)
+    ->ArgsProduct({{2, 8, 64, 256, 1024}, {14, 18}});
+BENCHMARK(MergeFolded)->Arg(1)->Arg(2)->Arg(4)->Arg(6)->Arg(10);
+BENCHMARK(ParallelCardinality)
+    ->ArgsProduct({{16, 18, 20}, {1, 2, 4, 8}})
+    ->UseRealTime();
+BENCHMARK(ParallelMerge)
+    ->ArgsProduct({{16, 18, 20}, {1, 2, 4, 8}})
+    ->UseRealTime();
+BENCHMARK(ParallelUnionCardinality)
+    ->ArgsProduct({{16, 18, 20}, {1, 2, 4, 8}})
+    ->UseRealTime();
+BENCHMARK(SketchTableHeap)->Arg(1 << 20);
+BENCHMARK(SketchTableArena)->Arg(1 << 20);
+BENCHMARK(KeyedAddMap)->Arg(1000)->Arg(100000);
+BENCHMARK(KeyedAddTable)->Arg(1000)->Arg(100000);
+BENCHMARK(WindowRingCardinality)->Arg(12)->Arg(60)->Arg(360);
+BENCHMARK(SlidingCardinality)->Arg(12)->Arg(60)->Arg(360);
+BENCHMARK(SlidingAddHashes);
+BENCHMARK(IntersectionByUnion);
+BENCHMARK_CAPTURE(IntersectionCardinality, InclusionExclusion,
+                  llb::JointEstimator::inclusion_exclusion);
+BENCHMARK_CAPTURE(IntersectionCardinality, MaximumLikelihood,
+                  llb::JointEstimator::maximum_likelihood);
+BENCHMARK_CAPTURE(CardinalityEstimator, LogLogBeta, llb::Estimator::loglog_beta)
+    ->Arg(14)
+    ->Arg(20);
+BENCHMARK_CAPTURE(CardinalityEstimator, Ertl, llb::Estimator::ertl)
+    ->Arg(14)
+    ->Arg(20);
+BENCHMARK(ConcurrentAdd)->ThreadRange(1, 16)->UseRealTime();
+BENCHMARK(PerThreadAddMerge)->ThreadRange(1, 16)->UseRealTime();
+BENCHMARK(MergePrecision)->Arg(14)->Arg(20);
+BENCHMARK(CardinalityPrecision)->Arg(14)->Arg(20);
+BENCHMARK_TEMPLATE(FixedAddHashLoop, 14);
+BENCHMARK_TEMPLATE(FixedAddHashLoop, 20);
+BENCHMARK_TEMPLATE(FixedMerge, 14);
+BENCHMARK_TEMPLATE(FixedMerge, 20);
+BENCHMARK_TEMPLATE(FixedCardinality, 14);
+BENCHMARK_TEMPLATE(FixedCardinality, 20);
+BENCHMARK_CAPTURE(AddKeyLoop, Xxh3, llb::HashFunction::xxh3);
+BENCHMARK_CAPTURE(AddKeyLoop, SplitMix64, llb::HashFunction::splitmix64);
+BENCHMARK_CAPTURE(AddKeys, Xxh3, llb::HashFunction::xxh3);
+BENCHMARK_CAPTURE(AddKeys, Xxh3Low128, llb::HashFunction::xxh3_128_low);
+BENCHMARK_CAPTURE(AddKeys, SplitMix64, llb::HashFunction::splitmix64);
+BENCHMARK_CAPTURE(AddUuids, Xxh3, llb::HashFunction::xxh3);
+BENCHMARK_CAPTURE(AddUuids, Xxh3Low128, llb::HashFunction::xxh3_128_low);
+BENCHMARK_CAPTURE(AddUuids, SplitMix64, llb::HashFunction::splitmix64);
+BENCHMARK(ShardedIngest)
+    ->ArgsProduct({{18, 20}, {1, 2, 4, 8}})
+    ->UseRealTime();
+BENCHMARK(CopyMergeIngest)
+    ->ArgsProduct({{18, 20}, {1, 2, 4, 8}})
+    ->UseRealTime();
+BENCHMARK(ApplyChanges)->ArgsProduct({{14, 20}, {100, 10000, 1000000}});
+BENCHMARK(ApplyFullSketch)->ArgsProduct({{14, 20}, {100, 10000, 1000000}});
+BENCHMARK(AddHashesTracked)->Arg(14)->Arg(20);
+BENCHMARK(CardinalityLoop);
+BENCHMARK(CardinalityBatch);
+BENCHMARK(MappedOpen);
+BENCHMARK(DeserializeAll);
+BENCHMARK(MappedCheckpoint)
+    ->Arg(0)
+    ->Arg(1)
+    ->Arg(10)
+    ->Arg(100)
+    ->UseRealTime();
@@ -2,14 +2,17 @@
 
 #include <string>
 #include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "xxhash.h"
 
 namespace llb
 {
 const int k_string_length = 256;
 }
 
-static std::string random_string(size_t length);
-static std::string random_string(size_t length) {
+inline std::string random_string(size_t length) {
   auto randchar = []() -> char {
     const char charset[] = "0123456789"
                            "ABCDEFGHIJKLMNOPQRSTUVWXYZ"
@@ -21,3 +24,17 @@ static std::string random_string(size_t length) {
   std::generate_n(str.begin(), length, randchar);
   return str;
 }
+
+inline std::vector<uint64_t> random_hashes(size_t count) {
+  std::vector<uint64_t> hashes;
+  for (auto ix = 0u; ix < count; ++ix) {
+    const auto str = random_string((random() % llb::k_string_length) + 1);
+    hashes.push_back(XXH3_64bits(str.data(), str.size()));
+  }
+  return hashes;
+}
+
+// Error rate that gives a sketch of exactly precision_bits
+inline double error_rate_for(int64_t precision_bits) {
+  return 1.04 / std::sqrt(std::pow(2.0, precision_bits)) * 1.0001;
+}
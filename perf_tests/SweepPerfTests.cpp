@@ -0,0 +1,184 @@
+/**
+ * SweepPerfTests.cpp
+ */
+#include <benchmark/benchmark.h>
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <vector>
+
+#include "LogLogBeta.h"
+#include "PerfHelpers.h"
+
+// Sweeps over precision, cardinality, sketch count and cache residency. The
+// working set argument is 0 for one sketch that stays in cache, or the MB of
+// sketches cycled through so every call starts cold. Run them all with
+// --benchmark_filter=Sweep, see perf_tests/sweep.sh for the JSON baselines
+
+namespace {
+const int64_t k_cold_working_set_mb = 512;
+
+std::vector<uint64_t> sweep_hashes(uint64_t count, uint64_t seed) {
+  std::mt19937_64 generator{seed};
+  std::vector<uint64_t> hashes(count);
+  for (auto &hash : hashes) {
+    hash = generator();
+  }
+  return hashes;
+}
+
+// Sketches of precision_bits registers that fill working_set_mb, at least one
+uint64_t sketches_in(int64_t working_set_mb, int64_t precision_bits) {
+  return std::max<uint64_t>(
+      1, (static_cast<uint64_t>(working_set_mb) << 20) >> precision_bits);
+}
+
+// count copies of one sketch of cardinality values at precision_bits
+std::vector<llb::LogLogBeta> sweep_sketches(int64_t precision_bits,
+                                            uint64_t cardinality,
+                                            uint64_t count, uint64_t seed) {
+  llb::LogLogBeta prototype{error_rate_for(precision_bits)};
+  const auto hashes = sweep_hashes(cardinality, seed);
+  prototype.add_hashes(hashes.data(), hashes.size());
+
+  std::vector<llb::LogLogBeta> sketches;
+  sketches.reserve(count);
+  for (auto ix = 0UL; ix < count; ++ix) {
+    sketches.emplace_back(error_rate_for(precision_bits));
+    sketches.back().merge(prototype);
+  }
+  return sketches;
+}
+
+// A fresh sketch per iteration filled with state.range(1) values, so the
+// registers start out empty like a real ingest
+void SweepIngest(benchmark::State &state) {
+  const auto hashes = sweep_hashes(state.range(1), 1);
+
+  for (auto _ : state) {
+    llb::LogLogBeta llb{error_rate_for(state.range(0))};
+    llb.add_hashes(hashes.data(), hashes.size());
+    benchmark::DoNotOptimize(llb.cardinality());
+  }
+  state.SetItemsProcessed(state.iterations() * hashes.size());
+  state.SetBytesProcessed(state.iterations() * hashes.size() *
+                          sizeof(uint64_t));
+}
+
+// Order 0 is random, 1 sorted by register so updates walk the registers in
+// order, and 2 has every value 16 times in a row, as duplicate heavy input
+void SweepAddOrder(benchmark::State &state) {
+  llb::LogLogBeta llb{error_rate_for(state.range(0))};
+  auto hashes = sweep_hashes(1UL << 20, 2);
+  if (state.range(1) == 1) {
+    std::sort(hashes.begin(), hashes.end());
+  } else if (state.range(1) == 2) {
+    for (auto ix = 0UL; ix < hashes.size(); ++ix) {
+      hashes[ix] = hashes[ix / 16];
+    }
+  }
+
+  for (auto _ : state) {
+    llb.add_hashes(hashes.data(), hashes.size());
+  }
+  state.SetItemsProcessed(state.iterations() * hashes.size());
+}
+
+void SweepCardinality(benchmark::State &state) {
+  const auto sketches =
+      sweep_sketches(state.range(0), 1UL << 20,
+                     sketches_in(state.range(1), state.range(0)), 3);
+
+  auto sketch_ix = 0UL;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(sketches[sketch_ix].cardinality());
+    sketch_ix = sketch_ix + 1 == sketches.size() ? 0 : sketch_ix + 1;
+  }
+  state.SetItemsProcessed(state.iterations() << state.range(0));
+  state.SetBytesProcessed(state.iterations() << state.range(0));
+}
+
+void SweepMerge(benchmark::State &state) {
+  const auto count = sketches_in(state.range(1) / 2, state.range(0));
+  auto sketches = sweep_sketches(state.range(0), 1UL << 20, count, 4);
+  const auto merge_me = sweep_sketches(state.range(0), 1UL << 20, count, 5);
+
+  auto sketch_ix = 0UL;
+  for (auto _ : state) {
+    sketches[sketch_ix].merge(merge_me[sketch_ix]);
+    sketch_ix = sketch_ix + 1 == sketches.size() ? 0 : sketch_ix + 1;
+  }
+  state.SetItemsProcessed(state.iterations() << state.range(0));
+  state.SetBytesProcessed(state.iterations() * 2 << state.range(0));
+}
+
+// state.range(0) sketches of precision 14 merged into one and estimated as
+// a union, far more registers than fit in cache once they are many
+void SweepMergeAll(benchmark::State &state) {
+  const auto sketches = sweep_sketches(14, 1UL << 16, state.range(0), 6);
+  std::vector<const llb::LogLogBeta *> inputs;
+  for (const auto &sketch : sketches) {
+    inputs.push_back(&sketch);
+  }
+
+  for (auto _ : state) {
+    llb::LogLogBeta merged{error_rate_for(14)};
+    merged.merge_all(inputs);
+    benchmark::DoNotOptimize(merged.cardinality());
+  }
+  state.SetItemsProcessed(state.iterations() * inputs.size());
+  state.SetBytesProcessed(state.iterations() * inputs.size() << 14);
+}
+
+// Accuracy against time, for state.range(2) of 0 (LogLog-Beta) and 1 (Ertl).
+// Each of 16 sketches holds state.range(1) different values, the error
+// counters are the mean and max relative error of their estimates
+void SweepAccuracy(benchmark::State &state) {
+  const auto estimator = state.range(2) == 0 ? llb::Estimator::loglog_beta
+                                             : llb::Estimator::ertl;
+  const auto cardinality = static_cast<uint64_t>(state.range(1));
+  std::vector<llb::LogLogBeta> sketches;
+  auto error_sum = 0.0;
+  auto error_max = 0.0;
+  for (auto trial = 0UL; trial < 16; ++trial) {
+    sketches.emplace_back(error_rate_for(state.range(0)));
+    const auto hashes = sweep_hashes(cardinality, 100 + trial);
+    sketches.back().add_hashes(hashes.data(), hashes.size());
+    const auto estimate =
+        static_cast<double>(sketches.back().cardinality(estimator));
+    const auto error = std::abs(estimate - cardinality) / cardinality;
+    error_sum += error;
+    error_max = std::max(error_max, error);
+  }
+
+  auto sketch_ix = 0UL;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(sketches[sketch_ix].cardinality(estimator));
+    sketch_ix = (sketch_ix + 1) % sketches.size();
+  }
+  state.counters["error"] = error_sum / sketches.size();
+  state.counters["error_max"] = error_max;
+  state.counters["std_error"] = 1.04 / std::sqrt(1UL << state.range(0));
+}
+} // namespace
+
+BENCHMARK(SweepIngest)
+    ->ArgsProduct({{10, 14, 16, 18, 20}, {1 << 10, 1 << 16, 1 << 20}})
+    ->ArgNames({"precision", "values"});
+BENCHMARK(SweepAddOrder)
+    ->ArgsProduct({{14, 16, 20}, {0, 1, 2}})
+    ->ArgNames({"precision", "order"});
+BENCHMARK(SweepCardinality)
+    ->ArgsProduct({{10, 12, 14, 16, 18, 20}, {0, k_cold_working_set_mb}})
+    ->ArgNames({"precision", "working_set_mb"});
+BENCHMARK(SweepMerge)
+    ->ArgsProduct({{10, 12, 14, 16, 18, 20}, {0, k_cold_working_set_mb}})
+    ->ArgNames({"precision", "working_set_mb"});
+BENCHMARK(SweepMergeAll)
+    ->RangeMultiplier(8)
+    ->Range(8, 4096)
+    ->ArgName("sketches");
+BENCHMARK(SweepAccuracy)
+    ->ArgsProduct({{10, 14, 18}, {100, 10000, 1000000}, {0, 1}})
+    ->ArgNames({"precision", "values", "estimator"});
@@ -0,0 +1,57 @@
+#!/bin/bash
+# Records the sweep benchmarks as JSON and compares two recordings
+# usage: perf_tests/sweep.sh run path/to/PerfTestRunner out.json [filter]
+#        perf_tests/sweep.sh compare base.json new.json [max slowdown %]
+# compare exits 1 when any benchmark's median real time got slower by more
+# than the threshold (5% by default). extern/benchmark/tools/compare.py
+# gives the full statistics for the same files
+set -e
+
+usage() {
+    sed -n 3,4p "$0" | sed 's/^# //'
+    exit 2
+}
+
+case "$1" in
+run)
+    RUNNER=${2:?$(usage)}
+    OUT=${3:?$(usage)}
+    FILTER=${4:-Sweep}
+    "$RUNNER" --benchmark_filter="$FILTER" \
+        --benchmark_repetitions=5 \
+        --benchmark_report_aggregates_only=true \
+        --benchmark_out="$OUT" --benchmark_out_format=json
+    ;;
+compare)
+    BASE=${2:?$(usage)}
+    NEW=${3:?$(usage)}
+    THRESHOLD=${4:-5}
+    python3 - "$BASE" "$NEW" "$THRESHOLD" <<'PY'
+import json, sys
+
+def medians(path):
+    times = {}
+    for run in json.load(open(path))["benchmarks"]:
+        if run.get("aggregate_name", "median") == "median":
+            times[run.get("run_name", run["name"])] = run["real_time"]
+    return times
+
+base, new = medians(sys.argv[1]), medians(sys.argv[2])
+threshold = float(sys.argv[3]) / 100
+regressions = 0
+for name in sorted(base.keys() & new.keys()):
+    change = new[name] / base[name] - 1
+    flag = ""
+    if change > threshold:
+        flag = "  REGRESSION"
+        regressions += 1
+    print("%-60s %+7.1f%%%s" % (name, change * 100, flag))
+print("%d of %d slower by more than %s%%"
+      % (regressions, len(base.keys() & new.keys()), sys.argv[3]))
+sys.exit(1 if regressions else 0)
+PY
+    ;;
+*)
+    usage
+    ;;
+esac
@@ -0,0 +1,111 @@
+/**
+ * ConcurrentLogLogBeta.cpp
+ */
+
+#include <algorithm>
+
+#include "ConcurrentLogLogBeta.h"
+#include "DenseRegisters.h"
+#include "Kernels.h"
+
+namespace {
+constexpr uint32_t k_rank_mask = (1U << llb::constants::k_sparse_rank_bits) - 1;
+// Values between prefetching a register line and raising it
+constexpr uint64_t k_prefetch_distance = 16;
+} // namespace
+
+llb::ConcurrentLogLogBeta::ConcurrentLogLogBeta(double error_rate,
+                                               Hasher hasher) noexcept
+    : m_sketch{error_rate, Representation::dense, RegisterLayout::byte,
+               hasher} {}
+
+void llb::ConcurrentLogLogBeta::add(const uint8_t *value, uint64_t length) {
+  add_hash(m_sketch.m_hasher.hash(value, length));
+}
+
+void llb::ConcurrentLogLogBeta::add_hash(uint64_t hash) {
+  raise_register(hash >> m_sketch.m_max_precision_bits,
+                 kernels::hash_rank(hash, m_sketch.m_precision_bits));
+}
+
+void llb::ConcurrentLogLogBeta::add_hashes(const uint64_t *hashes,
+                                           uint64_t count) {
+  const auto &kernel_table = kernels::active();
+  uint32_t indices[constants::k_batch_size];
+  uint8_t ranks[constants::k_batch_size];
+  for (auto hash_ix = 0UL; hash_ix < count;
+       hash_ix += constants::k_batch_size) {
+    const auto batch_count =
+        std::min<uint64_t>(count - hash_ix, constants::k_batch_size);
+    kernel_table.index_ranks(&hashes[hash_ix], batch_count,
+                             m_sketch.m_precision_bits, indices, ranks);
+    for (auto ix = 0UL; ix < batch_count; ix += 1) {
+      if (ix + k_prefetch_distance < batch_count) {
+        __builtin_prefetch(
+            &m_sketch.m_registers[indices[ix + k_prefetch_distance]], 1);
+      }
+      raise_register(indices[ix], ranks[ix]);
+    }
+  }
+}
+
+void llb::ConcurrentLogLogBeta::raise_register(uint64_t index, uint8_t rank) {
+  // fetch-max, only writing (and taking the line exclusive) when the
+  // register actually grows
+  auto *reg = &m_sketch.m_registers[index];
+  auto current = __atomic_load_n(reg, __ATOMIC_RELAXED);
+  while (current < rank &&
+         !__atomic_compare_exchange_n(reg, &current, rank, true,
+                                      __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+  }
+}
+
+uint8_t llb::ConcurrentLogLogBeta::register_at(uint64_t index) const {
+  return __atomic_load_n(&m_sketch.m_registers[index], __ATOMIC_RELAXED);
+}
+
+llb::LogLogBeta llb::ConcurrentLogLogBeta::snapshot() const {
+  LogLogBeta copy{constants::k_default_error_rate, Representation::sparse,
+                  RegisterLayout::byte, m_sketch.m_hasher};
+  copy.reset(m_sketch.m_precision_bits, RegisterLayout::byte);
+  copy.to_dense();
+  for (auto register_ix = 0UL; register_ix < m_sketch.m_register_count;
+       register_ix += 1) {
+    copy.m_registers[register_ix] =
+        __atomic_load_n(&m_sketch.m_registers[register_ix], __ATOMIC_RELAXED);
+  }
+  return copy;
+}
+
+uint64_t llb::ConcurrentLogLogBeta::cardinality() const {
+  return snapshot().cardinality();
+}
+
+bool llb::ConcurrentLogLogBeta::merge(const LogLogBeta &merge_me) {
+  if (merge_me.m_precision_bits < m_sketch.m_precision_bits ||
+      merge_me.m_hasher != m_sketch.m_hasher) {
+    return false;
+  }
+  const auto shift = merge_me.m_precision_bits - m_sketch.m_precision_bits;
+
+  if (merge_me.m_registers == nullptr) {
+    for (const auto sparse_entry : merge_me.m_sparse) {
+      const auto entry = fold_entry(sparse_entry, shift);
+      raise_register(entry >> constants::k_sparse_rank_bits,
+                     static_cast<uint8_t>(entry & k_rank_mask));
+    }
+    return true;
+  }
+
+  const auto dense = merge_me.dense_registers();
+  for (auto register_ix = 0UL; register_ix < m_sketch.m_register_count;
+       register_ix += 1) {
+    raise_register(register_ix,
+                   llb::folded_register_at(dense, register_ix, shift));
+  }
+  return true;
+}
+
+bool llb::ConcurrentLogLogBeta::merge_into(LogLogBeta *sketch) const {
+  return sketch->merge(snapshot());
+}
@@ -0,0 +1,266 @@
+/**
+ * DenseRegisters.cpp
+ */
+
+#include <algorithm>
+#include <vector>
+
+#include "DenseRegisters.h"
+
+namespace {
+constexpr uint32_t k_rank_mask = (1U << llb::constants::k_sparse_rank_bits) - 1;
+
+// packed registers are unpacked to byte ranks this many at a time to be
+// counted by the byte kernel
+constexpr uint64_t k_unpack_registers = 4096U;
+
+static_assert(llb::constants::k_rank_histogram_size ==
+                  llb::kernels::k_histogram_size,
+              "rank histograms have one count per possible rank");
+
+// Ranks of the packed6 registers of count / 256 blocks
+void unpack_packed6(const uint8_t *registers, uint64_t count, uint8_t *ranks) {
+  using llb::kernels::k_packed6_block_bytes;
+  using llb::kernels::k_packed6_block_registers;
+  for (auto block_ix = 0UL; block_ix < count / k_packed6_block_registers;
+       block_ix += 1) {
+    const auto *block = &registers[block_ix * k_packed6_block_bytes];
+    auto *block_ranks = &ranks[block_ix * k_packed6_block_registers];
+    for (auto byte_ix = 0UL; byte_ix < k_packed6_block_bytes; byte_ix += 1) {
+      block_ranks[byte_ix] = block[byte_ix] & 0x3F;
+    }
+    for (auto high_ix = 0UL;
+         high_ix < k_packed6_block_registers - k_packed6_block_bytes;
+         high_ix += 1) {
+      block_ranks[k_packed6_block_bytes + high_ix] = static_cast<uint8_t>(
+          (block[high_ix] >> 6) | ((block[high_ix + 64] >> 6) << 2) |
+          ((block[high_ix + 128] >> 6) << 4));
+    }
+  }
+}
+
+// Ranks of count packed4 registers with the overflow markers as zeros,
+// returning the number of markers
+uint64_t unpack_packed4(const uint8_t *registers, uint64_t count,
+                        uint8_t base, uint8_t *ranks) {
+  // clamped so that a corrupt base in a view can't count past the histogram
+  uint8_t offset_ranks[16];
+  for (auto offset = 0U; offset < 16; offset += 1) {
+    offset_ranks[offset] = static_cast<uint8_t>(
+        offset == llb::kernels::k_packed4_overflow
+            ? 0U
+            : std::min<uint64_t>(base + offset,
+                                 llb::kernels::k_histogram_size - 1));
+  }
+
+  auto markers = 0UL;
+  for (auto byte_ix = 0UL; byte_ix < count / 2; byte_ix += 1) {
+    const auto byte = registers[byte_ix];
+    ranks[byte_ix * 2] = offset_ranks[byte & 0x0F];
+    ranks[byte_ix * 2 + 1] = offset_ranks[byte >> 4];
+    markers += (byte & 0x0F) == llb::kernels::k_packed4_overflow ? 1 : 0;
+    markers += (byte >> 4) == llb::kernels::k_packed4_overflow ? 1 : 0;
+  }
+  return markers;
+}
+} // namespace
+
+void llb::compact_entries(std::vector<uint32_t> *entries,
+                          uint32_t sorted_count) {
+  if (sorted_count == entries->size()) {
+    return;
+  }
+
+  std::sort(entries->begin() + sorted_count, entries->end());
+  std::inplace_merge(entries->begin(), entries->begin() + sorted_count,
+                     entries->end());
+
+  // entries of the same index are ordered by rank, keep the last one
+  auto out = entries->begin();
+  for (auto it = entries->begin(); it != entries->end(); ++it) {
+    const auto next = it + 1;
+    if (next == entries->end() ||
+        (*next >> constants::k_sparse_rank_bits) !=
+            (*it >> constants::k_sparse_rank_bits)) {
+      *out++ = *it;
+    }
+  }
+  entries->erase(out, entries->end());
+}
+
+uint8_t llb::register_at(const DenseRegisters &dense, uint64_t index) {
+  switch (dense.layout) {
+  case RegisterLayout::packed6:
+    return kernels::packed6_get(dense.registers, index);
+  case RegisterLayout::packed4: {
+    const auto offset = (dense.registers[index / 2] >> (index % 2 * 4)) & 0x0F;
+    if (offset != kernels::k_packed4_overflow) {
+      return static_cast<uint8_t>(dense.base + offset);
+    }
+
+    auto low = 0UL;
+    auto high = dense.overflow_count;
+    while (low < high) {
+      const auto middle = low + (high - low) / 2;
+      if ((overflow_entry(dense, middle) >> constants::k_sparse_rank_bits) <
+          index) {
+        low = middle + 1;
+      } else {
+        high = middle;
+      }
+    }
+    // a marker without an entry only happens in an unverified buffer
+    if (low == dense.overflow_count ||
+        (overflow_entry(dense, low) >> constants::k_sparse_rank_bits) !=
+            index) {
+      return static_cast<uint8_t>(dense.base + kernels::k_packed4_overflow);
+    }
+    return static_cast<uint8_t>(overflow_entry(dense, low) & k_rank_mask);
+  }
+  default:
+    return dense.registers[index];
+  }
+}
+
+uint8_t llb::folded_register_at(const DenseRegisters &dense, uint64_t index,
+                               uint32_t shift) {
+  // the first set register of the group outranks the rest once folded
+  const auto first = index << shift;
+  for (auto low = 0UL; low < (1UL << shift); low += 1) {
+    const auto rank = register_at(dense, first + low);
+    if (rank != 0) {
+      return kernels::fold_rank(low, rank, shift);
+    }
+  }
+  return 0U;
+}
+
+void llb::sum_registers(const kernels::KernelTable &kernel_table,
+                        const DenseRegisters &dense, double *sum_arg,
+                        uint64_t *zero_count_arg, ThreadPool *pool) {
+  // packed4 overflow markers are summed as offsets of 15 here
+  const auto sum_chunk = [&](uint64_t first_register, uint64_t register_count,
+                             double *sum, uint64_t *zero_count) {
+    const auto *registers =
+        &dense.registers[register_bytes(dense.layout, first_register)];
+    switch (dense.layout) {
+    case RegisterLayout::packed6:
+      kernel_table.sum_packed6(registers, register_count, sum, zero_count);
+      return;
+    case RegisterLayout::packed4: {
+      double offset_sum = 0.0;
+      uint64_t zero_offsets = 0;
+      kernel_table.sum_packed4(registers, register_count, &offset_sum,
+                               &zero_offsets);
+      *sum = offset_sum / (1UL << dense.base);
+      *zero_count = dense.base == 0 ? zero_offsets : 0;
+      return;
+    }
+    default:
+      kernel_table.sum_registers(registers, register_count, sum, zero_count);
+      return;
+    }
+  };
+
+  double sum = 0.0;
+  uint64_t zero_count = 0;
+  const auto chunks = chunk_count(pool, dense.register_count);
+  if (chunks == 1) {
+    sum_chunk(0UL, dense.register_count, &sum, &zero_count);
+  } else {
+    std::vector<double> sums(chunks);
+    std::vector<uint64_t> zero_counts(chunks);
+    run_chunks(pool, chunks, dense.register_count,
+               [&](uint64_t chunk_ix, uint64_t first_register,
+                   uint64_t register_count) {
+                 sum_chunk(first_register, register_count, &sums[chunk_ix],
+                           &zero_counts[chunk_ix]);
+               });
+    for (auto chunk_ix = 0UL; chunk_ix < chunks; chunk_ix += 1) {
+      sum += sums[chunk_ix];
+      zero_count += zero_counts[chunk_ix];
+    }
+  }
+
+  if (dense.layout == RegisterLayout::packed4) {
+    // swap the overflow markers for their real ranks
+    sum -= static_cast<double>(dense.overflow_count) /
+           (1UL << (kernels::k_packed4_overflow + dense.base));
+    for (auto entry_ix = 0UL; entry_ix < dense.overflow_count; entry_ix += 1) {
+      sum += 1.0 / (1UL << (overflow_entry(dense, entry_ix) & k_rank_mask));
+    }
+  }
+
+  *sum_arg = sum;
+  *zero_count_arg = zero_count;
+}
+
+void llb::histogram_registers(const kernels::KernelTable &kernel_table,
+                              const DenseRegisters &dense,
+                              uint64_t *histogram, ThreadPool *pool) {
+  // counts chunk into histogram and returns the packed4 markers counted as
+  // zeros
+  const auto histogram_chunk = [&](uint64_t first_register,
+                                   uint64_t register_count,
+                                   uint64_t *counts) {
+    const auto *registers =
+        &dense.registers[register_bytes(dense.layout, first_register)];
+    if (dense.layout == RegisterLayout::byte) {
+      kernel_table.histogram_registers(registers, register_count, counts);
+      return 0UL;
+    }
+
+    alignas(64) uint8_t ranks[k_unpack_registers];
+    auto markers = 0UL;
+    for (auto register_ix = 0UL; register_ix < register_count;
+         register_ix += k_unpack_registers) {
+      const auto count =
+          std::min(k_unpack_registers, register_count - register_ix);
+      const auto *bytes =
+          &registers[register_bytes(dense.layout, register_ix)];
+      if (dense.layout == RegisterLayout::packed6) {
+        unpack_packed6(bytes, count, ranks);
+      } else {
+        markers += unpack_packed4(bytes, count, dense.base, ranks);
+      }
+      kernel_table.histogram_registers(ranks, count, counts);
+    }
+    return markers;
+  };
+
+  auto markers = 0UL;
+  const auto chunks = chunk_count(pool, dense.register_count);
+  if (chunks == 1) {
+    markers = histogram_chunk(0UL, dense.register_count, histogram);
+  } else {
+    std::vector<uint64_t> counts(chunks * kernels::k_histogram_size);
+    std::vector<uint64_t> chunk_markers(chunks);
+    run_chunks(pool, chunks, dense.register_count,
+               [&](uint64_t chunk_ix, uint64_t first_register,
+                   uint64_t register_count) {
+                 chunk_markers[chunk_ix] = histogram_chunk(
+                     first_register, register_count,
+                     &counts[chunk_ix * kernels::k_histogram_size]);
+               });
+    for (auto chunk_ix = 0UL; chunk_ix < chunks; chunk_ix += 1) {
+      markers += chunk_markers[chunk_ix];
+      for (auto rank = 0UL; rank < kernels::k_histogram_size; rank += 1) {
+        histogram[rank] += counts[chunk_ix * kernels::k_histogram_size + rank];
+      }
+    }
+  }
+
+  if (dense.layout == RegisterLayout::packed4) {
+    // swap the overflow markers for their real ranks, a marker without an
+    // entry only happens in an unverified buffer and reads as base + 15
+    histogram[0] -= markers;
+    for (auto entry_ix = 0UL; entry_ix < dense.overflow_count; entry_ix += 1) {
+      histogram[overflow_entry(dense, entry_ix) & k_rank_mask] += 1;
+    }
+    if (markers > dense.overflow_count) {
+      histogram[std::min<uint64_t>(dense.base + kernels::k_packed4_overflow,
+                                   kernels::k_histogram_size - 1)] +=
+          markers - dense.overflow_count;
+    }
+  }
+}
@@ -0,0 +1,77 @@
+/**
+ * DenseRegisters.h
+ */
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "Kernels.h"
+#include "LogLogBeta.h"
+#include "ThreadPool.h"
+
+namespace llb {
+// Read only dense registers, either a LogLogBeta's own or ones a
+// LogLogBetaView wraps in place
+struct DenseRegisters {
+  RegisterLayout layout;
+  uint64_t register_count;
+  const uint8_t *registers;
+
+  // packed4 only, the base rank and the sorted (index << 6 | rank) overflow
+  // entries, little endian and not necessarily aligned
+  uint8_t base;
+  const uint8_t *overflow;
+  uint64_t overflow_count;
+};
+
+inline uint64_t register_bytes(RegisterLayout layout,
+                               uint64_t register_count) {
+  switch (layout) {
+  case RegisterLayout::packed6:
+    return register_count / 4 * 3;
+  case RegisterLayout::packed4:
+    return register_count / 2;
+  default:
+    return register_count;
+  }
+}
+
+inline uint32_t overflow_entry(const DenseRegisters &dense, uint64_t ix) {
+  uint32_t entry;
+  std::memcpy(&entry, &dense.overflow[ix * sizeof(entry)], sizeof(entry));
+  return entry;
+}
+
+// Sparse or overflow entry once the low shift bits of its index move into
+// its rank
+inline uint32_t fold_entry(uint32_t entry, uint32_t shift) {
+  const auto index = entry >> constants::k_sparse_rank_bits;
+  const auto rank = static_cast<uint8_t>(
+      entry & ((1U << constants::k_sparse_rank_bits) - 1));
+  return (index >> shift) << constants::k_sparse_rank_bits |
+         kernels::fold_rank(index & ((1U << shift) - 1), rank, shift);
+}
+
+// Sorts the unsorted tail of sparse entries into the sorted head, keeping only
+// the highest rank for each register index
+void compact_entries(std::vector<uint32_t> *entries, uint32_t sorted_count);
+
+uint8_t register_at(const DenseRegisters &dense, uint64_t index);
+
+// Rank of register index of dense folded down by shift bits of precision
+uint8_t folded_register_at(const DenseRegisters &dense, uint64_t index,
+                           uint32_t shift);
+
+// Summed in chunks across pool when there is one and the registers are many
+void sum_registers(const kernels::KernelTable &kernel_table,
+                   const DenseRegisters &dense, double *sum,
+                   uint64_t *zero_count, ThreadPool *pool = nullptr);
+
+// Adds the number of registers holding each rank into histogram[rank],
+// counted in chunks across pool like the sum
+void histogram_registers(const kernels::KernelTable &kernel_table,
+                         const DenseRegisters &dense, uint64_t *histogram,
+                         ThreadPool *pool = nullptr);
+} // namespace llb
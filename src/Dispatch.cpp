@@ -0,0 +1,88 @@
+/**
+ * Dispatch.cpp
+ */
+
+#include <atomic>
+
+#include "Dispatch.h"
+#include "Kernels.h"
+
+namespace {
+llb::InstructionSet detect() {
+#ifdef LLB_X86_KERNELS
+  __builtin_cpu_init();
+  // every flag the avx512 kernels are compiled with, vl for the 128 and 256
+  // bit EVEX forms they use
+  if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw") &&
+      __builtin_cpu_supports("avx512cd") &&
+      __builtin_cpu_supports("avx512dq") &&
+      __builtin_cpu_supports("avx512vl")) {
+    return llb::InstructionSet::avx512;
+  }
+  if (__builtin_cpu_supports("avx2")) {
+    return llb::InstructionSet::avx2;
+  }
+  if (__builtin_cpu_supports("sse4.1")) {
+    return llb::InstructionSet::sse41;
+  }
+#endif
+  return llb::InstructionSet::scalar;
+}
+
+const llb::kernels::KernelTable &
+kernels_for(llb::InstructionSet instruction_set) {
+  switch (instruction_set) {
+#ifdef LLB_X86_KERNELS
+  case llb::InstructionSet::avx512:
+    return llb::kernels::k_avx512;
+  case llb::InstructionSet::avx2:
+    return llb::kernels::k_avx2;
+  case llb::InstructionSet::sse41:
+    return llb::kernels::k_sse41;
+#endif
+  default:
+    return llb::kernels::k_scalar;
+  }
+}
+
+std::atomic<const llb::kernels::KernelTable *> g_active{nullptr};
+} // namespace
+
+llb::InstructionSet llb::detected_instruction_set() noexcept {
+  static const auto detected = detect();
+  return detected;
+}
+
+llb::InstructionSet llb::active_instruction_set() noexcept {
+  return kernels::active().instruction_set;
+}
+
+bool llb::set_instruction_set(InstructionSet instruction_set) noexcept {
+  if (instruction_set > detected_instruction_set()) {
+    return false;
+  }
+  g_active.store(&kernels_for(instruction_set), std::memory_order_relaxed);
+  return true;
+}
+
+const char *llb::instruction_set_name(InstructionSet instruction_set) noexcept {
+  switch (instruction_set) {
+  case InstructionSet::avx512:
+    return "avx512";
+  case InstructionSet::avx2:
+    return "avx2";
+  case InstructionSet::sse41:
+    return "sse4.1";
+  default:
+    return "scalar";
+  }
+}
+
+const llb::kernels::KernelTable &llb::kernels::active() noexcept {
+  const auto *active = g_active.load(std::memory_order_relaxed);
+  if (active == nullptr) {
+    active = &kernels_for(detected_instruction_set());
+    g_active.store(active, std::memory_order_relaxed);
+  }
+  return *active;
+}
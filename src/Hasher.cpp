@@ -0,0 +1,48 @@
+/**
+ * Hasher.cpp
+ */
+
+#include "Hasher.h"
+#include "Kernels.h"
+#include "xxhash.h"
+
+uint64_t llb::Hasher::hash(const uint8_t *value, uint64_t length) const {
+  switch (m_function) {
+  case HashFunction::xxh3_128_low:
+    return XXH3_128bits_withSeed(value, length, m_seed).low64;
+  case HashFunction::splitmix64:
+    if (length == 8 || length == 16) {
+      uint64_t hash;
+      kernels::scalar_hash_keys(m_function, m_seed, value, length, 1, &hash);
+      return hash;
+    }
+    return XXH3_64bits_withSeed(value, length, m_seed);
+  default:
+    return XXH3_64bits_withSeed(value, length, m_seed);
+  }
+}
+
+uint64_t llb::Hasher::hash(uint64_t key) const {
+  if (m_function == HashFunction::splitmix64) {
+    return kernels::splitmix64(key ^ m_seed);
+  }
+  return hash(reinterpret_cast<const uint8_t *>(&key), sizeof(key));
+}
+
+uint64_t llb::Hasher::hash(const Uuid &key) const {
+  return hash(key.bytes, sizeof(key.bytes));
+}
+
+void llb::Hasher::hash(const uint64_t *keys, uint64_t count,
+                       uint64_t *hashes) const {
+  kernels::active().hash_keys(m_function, m_seed,
+                              reinterpret_cast<const uint8_t *>(keys),
+                              sizeof(*keys), count, hashes);
+}
+
+void llb::Hasher::hash(const Uuid *keys, uint64_t count,
+                       uint64_t *hashes) const {
+  kernels::active().hash_keys(m_function, m_seed,
+                              reinterpret_cast<const uint8_t *>(keys),
+                              sizeof(*keys), count, hashes);
+}
@@ -0,0 +1,222 @@
+/**
+ * JointEstimation.cpp
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+#include "JointEstimation.h"
+
+namespace {
+constexpr auto k_negative_infinity = -std::numeric_limits<double>::infinity();
+// Nelder-Mead iterations before settling on the best point so far
+constexpr uint32_t k_max_iterations = 2000U;
+// Spread of the search's log cardinalities it stops at, 0.01% apart
+constexpr double k_tolerance = 1e-4;
+// Cardinalities at the start of the search are at least this, so values
+// missing from the first estimate can still be found
+constexpr double k_min_start = 1.0;
+// Log of the smallest cardinality searched, below it the likelihood barely
+// moves and the search would wander off toward 0
+constexpr double k_min_log_cardinality = -5.0;
+
+// Log of the chance a register of a sketch of rate (cardinality per
+// register) holds at most value, with q + 1 the highest rank
+double log_at_most(int value, double rate, int q) {
+  if (value < 0) {
+    return k_negative_infinity;
+  }
+  return value > q ? 0.0 : -rate * std::ldexp(1.0, -value);
+}
+
+// Log of the chance a register holds exactly value
+double log_exactly(int value, double rate, int q) {
+  if (value == 0) {
+    return -rate;
+  }
+  if (value > q) {
+    return std::log(-std::expm1(-rate * std::ldexp(1.0, -q)));
+  }
+  const auto scaled = rate * std::ldexp(1.0, -value);
+  return -scaled + std::log(-std::expm1(-scaled));
+}
+
+double log_sum(double lhs, double rhs) {
+  const auto high = std::max(lhs, rhs);
+  if (high == k_negative_infinity) {
+    return high;
+  }
+  return high + std::log1p(std::exp(std::min(lhs, rhs) - high));
+}
+
+// Log likelihood of the register pairs with the first register being the
+// max of the values only in it and the shared values, the second likewise
+double log_likelihood(const llb::joint::Histograms &histograms,
+                      const double *rates, int q) {
+  const auto first = rates[0];
+  const auto second = rates[1];
+  const auto both = rates[2];
+
+  // most bins are empty, only the ones with registers are evaluated
+  auto likelihood = 0.0;
+  const auto add = [&](uint64_t count, int value, double rate) {
+    if (count != 0) {
+      likelihood += static_cast<double>(count) * log_exactly(value, rate, q);
+    }
+  };
+  for (auto value = 0; value <= q + 1; value += 1) {
+    // below the other register, the other one is set by its own values
+    add(histograms.first_below[value], value, first + both);
+    add(histograms.second_above[value], value, second);
+    add(histograms.first_above[value], value, first);
+    add(histograms.second_below[value], value, second + both);
+
+    // equal registers either share the value or both reach it on their own
+    if (histograms.equal[value] != 0) {
+      likelihood += static_cast<double>(histograms.equal[value]) *
+                    log_sum(log_exactly(value, both, q) +
+                                log_at_most(value, first, q) +
+                                log_at_most(value, second, q),
+                            log_at_most(value - 1, both, q) +
+                                log_exactly(value, first, q) +
+                                log_exactly(value, second, q));
+    }
+  }
+  return likelihood;
+}
+} // namespace
+
+void llb::joint::histograms(const uint8_t *first, const uint8_t *second,
+                            uint64_t register_count, Histograms *histograms) {
+  std::memset(histograms, 0, sizeof(*histograms));
+  for (auto register_ix = 0UL; register_ix < register_count;
+       register_ix += 1) {
+    const auto first_value = first[register_ix];
+    const auto second_value = second[register_ix];
+    if (first_value < second_value) {
+      histograms->first_below[first_value] += 1;
+      histograms->second_above[second_value] += 1;
+    } else if (first_value > second_value) {
+      histograms->first_above[first_value] += 1;
+      histograms->second_below[second_value] += 1;
+    } else {
+      histograms->equal[first_value] += 1;
+    }
+  }
+}
+
+void llb::joint::maximum_likelihood(const Histograms &histograms,
+                                    uint64_t register_count,
+                                    uint32_t precision_bits,
+                                    double *cardinalities) {
+  // Nelder-Mead over the log of each cardinality, which keeps them positive
+  // and needs no derivatives of the likelihood
+  const auto q = static_cast<int>(64 - precision_bits);
+  const auto registers = static_cast<double>(register_count);
+  const auto cost = [&](const double *point) {
+    double rates[3];
+    for (auto dimension = 0; dimension < 3; dimension += 1) {
+      rates[dimension] =
+          std::exp(std::max(point[dimension], k_min_log_cardinality)) /
+          registers;
+    }
+    return -log_likelihood(histograms, rates, q);
+  };
+
+  double points[4][3];
+  double costs[4];
+  for (auto dimension = 0; dimension < 3; dimension += 1) {
+    points[0][dimension] =
+        std::log(std::max(cardinalities[dimension], k_min_start));
+  }
+  for (auto vertex = 1; vertex < 4; vertex += 1) {
+    std::copy(points[0], points[0] + 3, points[vertex]);
+    points[vertex][vertex - 1] += 0.5;
+  }
+  for (auto vertex = 0; vertex < 4; vertex += 1) {
+    costs[vertex] = cost(points[vertex]);
+  }
+
+  for (auto iteration = 0U; iteration < k_max_iterations; iteration += 1) {
+    // best vertex first, worst last
+    int order[4] = {0, 1, 2, 3};
+    std::sort(order, order + 4,
+              [&](int lhs, int rhs) { return costs[lhs] < costs[rhs]; });
+    const auto best = order[0];
+    const auto worst = order[3];
+    const auto second_worst = order[2];
+
+    auto size = 0.0;
+    for (auto vertex = 0; vertex < 4; vertex += 1) {
+      for (auto dimension = 0; dimension < 3; dimension += 1) {
+        size = std::max(size, std::abs(points[vertex][dimension] -
+                                       points[best][dimension]));
+      }
+    }
+    if (size < k_tolerance) {
+      break;
+    }
+
+    double centroid[3] = {0.0, 0.0, 0.0};
+    for (auto vertex = 0; vertex < 4; vertex += 1) {
+      if (vertex != worst) {
+        for (auto dimension = 0; dimension < 3; dimension += 1) {
+          centroid[dimension] += points[vertex][dimension] / 3.0;
+        }
+      }
+    }
+    const auto toward = [&](double scale, double *point) {
+      for (auto dimension = 0; dimension < 3; dimension += 1) {
+        point[dimension] =
+            centroid[dimension] +
+            scale * (points[worst][dimension] - centroid[dimension]);
+      }
+      return cost(point);
+    };
+
+    double reflected[3];
+    const auto reflected_cost = toward(-1.0, reflected);
+    if (reflected_cost < costs[best]) {
+      double expanded[3];
+      const auto expanded_cost = toward(-2.0, expanded);
+      const auto expand = expanded_cost < reflected_cost;
+      std::copy(expand ? expanded : reflected,
+                (expand ? expanded : reflected) + 3, points[worst]);
+      costs[worst] = expand ? expanded_cost : reflected_cost;
+      continue;
+    }
+    if (reflected_cost < costs[second_worst]) {
+      std::copy(reflected, reflected + 3, points[worst]);
+      costs[worst] = reflected_cost;
+      continue;
+    }
+
+    double contracted[3];
+    const auto contracted_cost = toward(0.5, contracted);
+    if (contracted_cost < costs[worst]) {
+      std::copy(contracted, contracted + 3, points[worst]);
+      costs[worst] = contracted_cost;
+      continue;
+    }
+
+    // shrink everything toward the best vertex
+    for (auto vertex = 0; vertex < 4; vertex += 1) {
+      if (vertex != best) {
+        for (auto dimension = 0; dimension < 3; dimension += 1) {
+          points[vertex][dimension] =
+              points[best][dimension] +
+              0.5 * (points[vertex][dimension] - points[best][dimension]);
+        }
+        costs[vertex] = cost(points[vertex]);
+      }
+    }
+  }
+
+  const auto best = std::min_element(costs, costs + 4) - costs;
+  for (auto dimension = 0; dimension < 3; dimension += 1) {
+    cardinalities[dimension] =
+        std::exp(std::max(points[best][dimension], k_min_log_cardinality));
+  }
+}
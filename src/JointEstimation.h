@@ -0,0 +1,31 @@
+/**
+ * JointEstimation.h
+ */
+#pragma once
+
+#include <cstdint>
+
+namespace llb {
+namespace joint {
+// Register pairs of two sketches counted by relation and value, following
+// Ertl's joint estimation for HyperLogLog sketches. first_below[k] counts the
+// pairs where the first register is k and below the second, second_above
+// counts the same pairs by the second register, and so on
+struct Histograms {
+  uint64_t first_below[64];
+  uint64_t second_above[64];
+  uint64_t first_above[64];
+  uint64_t second_below[64];
+  uint64_t equal[64];
+};
+
+void histograms(const uint8_t *first, const uint8_t *second,
+                uint64_t register_count, Histograms *histograms);
+
+// Refines cardinalities[0..2], the values only in the first sketch, only in
+// the second and in both, to the ones under which the register pairs are
+// most likely. Each starts from the given estimate
+void maximum_likelihood(const Histograms &histograms, uint64_t register_count,
+                        uint32_t precision_bits, double *cardinalities);
+} // namespace joint
+} // namespace llb
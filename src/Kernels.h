@@ -0,0 +1,245 @@
+/**
+ * Kernels.h
+ */
+#pragma once
+
+#include <cstdint>
+
+#include "Dispatch.h"
+#include "Hasher.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define LLB_X86_KERNELS 1
+#endif
+
+namespace llb {
+namespace kernels {
+// Register storage is over allocated so kernels can load a full vector past
+// the end of the registers
+constexpr uint64_t k_register_padding = 64U;
+
+constexpr uint64_t k_packed6_block_registers = 256U;
+constexpr uint64_t k_packed6_block_bytes = 192U;
+
+// A packed4 offset of 15 marks a register whose rank lives in the overflow list
+constexpr uint8_t k_packed4_overflow = 15U;
+
+// register_count is always a multiple of 256. Registers written to are 64 byte
+// aligned, registers only read may be anywhere, like inside a mapped file.
+//
+// packed6 registers come in 192 byte blocks of 256 registers, register j < 192
+// of a block is the low 6 bits of byte j and register 192 + j is spread over
+// the top 2 bits of bytes j, 64 + j and 128 + j, lowest bits first. That keeps
+// every block three aligned 64 byte vectors that unpack with shifts and masks.
+//
+// packed4 registers store a 4 bit offset per register, low nibble first.
+using SumRegistersFn = void (*)(const uint8_t *registers,
+                                uint64_t register_count, double *sum,
+                                uint64_t *zero_count);
+using MergeRegistersFn = void (*)(uint8_t *registers, const uint8_t *merge_me,
+                                  uint64_t register_count);
+// Sums 2^-offset over every packed4 offset and counts the zero offsets
+using SumPacked4Fn = void (*)(const uint8_t *registers,
+                              uint64_t register_count, double *offset_sum,
+                              uint64_t *zero_count);
+// Lowers both sides' offsets by their shift (keeping overflow markers), takes
+// the max into registers and returns the number of zero offsets left
+using MergePacked4Fn = uint64_t (*)(uint8_t *registers, const uint8_t *merge_me,
+                                    uint64_t register_count, uint8_t shift,
+                                    uint8_t merge_me_shift);
+
+inline uint8_t packed6_get(const uint8_t *registers, uint64_t index) {
+  const auto *block =
+      &registers[index / k_packed6_block_registers * k_packed6_block_bytes];
+  const auto block_ix = index % k_packed6_block_registers;
+  if (block_ix < k_packed6_block_bytes) {
+    return block[block_ix] & 0x3F;
+  }
+  const auto high_ix = block_ix - k_packed6_block_bytes;
+  return static_cast<uint8_t>((block[high_ix] >> 6) |
+                              ((block[high_ix + 64] >> 6) << 2) |
+                              ((block[high_ix + 128] >> 6) << 4));
+}
+
+inline void packed6_set(uint8_t *registers, uint64_t index, uint8_t value) {
+  auto *block =
+      &registers[index / k_packed6_block_registers * k_packed6_block_bytes];
+  const auto block_ix = index % k_packed6_block_registers;
+  if (block_ix < k_packed6_block_bytes) {
+    block[block_ix] = static_cast<uint8_t>((block[block_ix] & 0xC0) | value);
+    return;
+  }
+  const auto high_ix = block_ix - k_packed6_block_bytes;
+  for (auto plane = 0U; plane < 3U; plane += 1) {
+    auto &byte = block[high_ix + plane * 64];
+    byte = static_cast<uint8_t>((byte & 0x3F) |
+                                (((value >> (plane * 2)) & 0x03) << 6));
+  }
+}
+
+// Rank of a hash, the sentinel bit caps it at 64 - precision_bits + 1 when
+// every bit after the index is zero
+inline uint8_t hash_rank(uint64_t hash, uint32_t precision_bits) {
+  return static_cast<uint8_t>(
+      __builtin_clzll((hash << precision_bits) |
+                      (1UL << (precision_bits - 1))) +
+      1);
+}
+
+// Rank a register ends up with when the low shift bits of its index move into
+// its rank, the same rank the hash gets at shift bits less precision
+inline uint8_t fold_rank(uint64_t low, uint8_t rank, uint32_t shift) {
+  if (rank == 0) {
+    return 0U;
+  }
+  return static_cast<uint8_t>(low == 0 ? rank + shift
+                                       : shift - (63 - __builtin_clzll(low)));
+}
+
+// Raises every register to the fold of its 2^shift registers in merge_me.
+// Folded, the first register of a group outranks the rest when it is set and
+// otherwise the first set one wins, so only the first set register of each
+// group is looked at. nonzero_mask returns the set registers of 64 in a row
+template <typename NonzeroMask>
+inline void fold_groups(uint8_t *registers, const uint8_t *merge_me,
+                        uint64_t register_count, uint32_t shift,
+                        NonzeroMask nonzero_mask) {
+  const auto group_size = 1UL << shift;
+  const auto raise = [&](uint64_t index, uint64_t low, uint8_t rank) {
+    const auto folded = fold_rank(low, rank, shift);
+    registers[index] = registers[index] < folded ? folded : registers[index];
+  };
+
+  if (group_size < 64) {
+    const auto group_mask = (1UL << group_size) - 1;
+    for (auto chunk_ix = 0UL; chunk_ix < register_count << shift;
+         chunk_ix += 64) {
+      auto mask = nonzero_mask(&merge_me[chunk_ix]);
+      while (mask != 0) {
+        const auto first = static_cast<uint64_t>(__builtin_ctzll(mask));
+        const auto group_first = first >> shift << shift;
+        raise((chunk_ix + group_first) >> shift, first - group_first,
+              merge_me[chunk_ix + first]);
+        mask &= ~(group_mask << group_first);
+      }
+    }
+    return;
+  }
+
+  for (auto register_ix = 0UL; register_ix < register_count;
+       register_ix += 1) {
+    const auto *group = &merge_me[register_ix << shift];
+    for (auto chunk_ix = 0UL; chunk_ix < group_size; chunk_ix += 64) {
+      const auto mask = nonzero_mask(&group[chunk_ix]);
+      if (mask != 0) {
+        const auto low = chunk_ix + __builtin_ctzll(mask);
+        raise(register_ix, low, group[low]);
+        break;
+      }
+    }
+  }
+}
+
+// Splits hashes into their register index and rank
+using IndexRanksFn = void (*)(const uint64_t *hashes, uint64_t count,
+                              uint32_t precision_bits, uint32_t *indices,
+                              uint8_t *ranks);
+
+// Raises every byte register to the fold of its 2^shift byte registers in
+// merge_me, which has register_count << shift registers
+using FoldRegistersFn = void (*)(uint8_t *registers, const uint8_t *merge_me,
+                                 uint64_t register_count, uint32_t shift);
+
+// Sums 2^-value and counts the zeros of registers, of other and of their
+// max in one pass, into sums[0..2] and zero_counts[0..2]
+using SumJointFn = void (*)(const uint8_t *registers, const uint8_t *other,
+                            uint64_t register_count, double *sums,
+                            uint64_t *zero_counts);
+
+// Ranks never reach 64, so a histogram of registers per rank has 64 counts
+constexpr uint64_t k_histogram_size = 64U;
+// Ranks counted in vector lanes, upwards from the lowest rank of the
+// registers. The rare registers further up are counted one at a time
+constexpr uint8_t k_histogram_window = 16U;
+
+// Adds the number of registers holding each rank into histogram[rank]
+using HistogramRegistersFn = void (*)(const uint8_t *registers,
+                                      uint64_t register_count,
+                                      uint64_t *histogram);
+
+// First rank of the counted window for registers whose lowest rank is lowest
+inline uint8_t histogram_base(uint8_t lowest) {
+  return lowest < k_histogram_size - k_histogram_window
+             ? lowest
+             : static_cast<uint8_t>(k_histogram_size - k_histogram_window);
+}
+
+// Hashes count keys of key_bytes bytes, 8 or 16, the way a Hasher of
+// function and seed hashes their bytes
+using HashKeysFn = void (*)(HashFunction function, uint64_t seed,
+                            const uint8_t *keys, uint64_t key_bytes,
+                            uint64_t count, uint64_t *hashes);
+
+// XXH3 of 8 and 16 byte keys comes down to a few multiplies, keyed with these
+// xors of words of its default secret
+constexpr uint64_t k_xxh3_flip8 = 0x1CAD21F72C81017CUL ^ 0xDB979083E96DD4DEUL;
+constexpr uint64_t k_xxh3_flip16_low =
+    0x1F67B3B7A4A44072UL ^ 0x78E5C0CC4EE679CBUL;
+constexpr uint64_t k_xxh3_flip16_high =
+    0x2172FFCC7DD05A82UL ^ 0x8E2443F7744608B8UL;
+constexpr uint64_t k_xxh3_rrmxmx = 0x9FB21C651E98DF25UL;
+constexpr uint64_t k_xxh3_avalanche = 0x165667919E3779F9UL;
+
+// XXH3 mixes its seed into the flip of 8 byte keys like this
+inline uint64_t xxh3_seed8(uint64_t seed) {
+  return seed ^ (static_cast<uint64_t>(
+                     __builtin_bswap32(static_cast<uint32_t>(seed)))
+                 << 32);
+}
+
+// SplitMix64's finalizer, a bijection of 64 bit values
+inline uint64_t splitmix64(uint64_t value) {
+  value += 0x9E3779B97F4A7C15UL;
+  value = (value ^ (value >> 30)) * 0xBF58476D1CE4E5B9UL;
+  value = (value ^ (value >> 27)) * 0x94D049BB133111EBUL;
+  return value ^ (value >> 31);
+}
+
+inline uint64_t splitmix64_key16(uint64_t low, uint64_t high, uint64_t seed) {
+  return splitmix64(high ^ splitmix64(low ^ seed));
+}
+
+// Shared by the tables that have no vector version
+void scalar_index_ranks(const uint64_t *hashes, uint64_t count,
+                        uint32_t precision_bits, uint32_t *indices,
+                        uint8_t *ranks);
+
+void scalar_hash_keys(HashFunction function, uint64_t seed,
+                      const uint8_t *keys, uint64_t key_bytes, uint64_t count,
+                      uint64_t *hashes);
+
+struct KernelTable {
+  InstructionSet instruction_set;
+  SumRegistersFn sum_registers;
+  MergeRegistersFn merge_registers;
+  SumRegistersFn sum_packed6;
+  MergeRegistersFn merge_packed6;
+  SumPacked4Fn sum_packed4;
+  MergePacked4Fn merge_packed4;
+  IndexRanksFn index_ranks;
+  FoldRegistersFn fold_registers;
+  SumJointFn sum_joint;
+  HistogramRegistersFn histogram_registers;
+  HashKeysFn hash_keys;
+};
+
+extern const KernelTable k_scalar;
+#ifdef LLB_X86_KERNELS
+extern const KernelTable k_sse41;
+extern const KernelTable k_avx2;
+extern const KernelTable k_avx512;
+#endif
+
+const KernelTable &active() noexcept;
+} // namespace kernels
+} // namespace llb
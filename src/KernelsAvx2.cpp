@@ -0,0 +1,522 @@
+/**
+ * KernelsAvx2.cpp
+ */
+
+#include "Kernels.h"
+
+#ifdef LLB_X86_KERNELS
+
+#include <immintrin.h>
+
+namespace {
+// Registers summed in float before flushing into the double total
+constexpr uint64_t k_block_size = 2048;
+// Folds up to this many bits are done a bit at a time in vectors, larger ones
+// look for the first set register of each group
+constexpr uint32_t k_vector_fold_shift = 5;
+
+// 2^-value built directly from the float exponent bits, exact for all ranks
+inline __m256 reciprocal_pow2(__m128i value) {
+  return _mm256_castsi256_ps(_mm256_slli_epi32(
+      _mm256_sub_epi32(_mm256_set1_epi32(127), _mm256_cvtepu8_epi32(value)),
+      23));
+}
+
+// Sums 2^-value and counts zeros 32 values at a time, flushing the float
+// partial sums into the double total every k_block_size values
+class SumAccumulator {
+public:
+  void add(__m256i values) {
+    m_zero_count +=
+        static_cast<uint64_t>(__builtin_popcount(static_cast<uint32_t>(
+            _mm256_movemask_epi8(
+                _mm256_cmpeq_epi8(values, _mm256_setzero_si256())))));
+
+    const auto low = _mm256_castsi256_si128(values);
+    const auto high = _mm256_extracti128_si256(values, 1);
+    m_accumulate_0 = _mm256_add_ps(m_accumulate_0, reciprocal_pow2(low));
+    m_accumulate_1 = _mm256_add_ps(m_accumulate_1,
+                                   reciprocal_pow2(_mm_srli_si128(low, 8)));
+    m_accumulate_2 = _mm256_add_ps(m_accumulate_2, reciprocal_pow2(high));
+    m_accumulate_3 = _mm256_add_ps(m_accumulate_3,
+                                   reciprocal_pow2(_mm_srli_si128(high, 8)));
+
+    m_pending += 32;
+    if (m_pending == k_block_size) {
+      flush();
+    }
+  }
+
+  void finish(double *sum, uint64_t *zero_count) {
+    flush();
+    *sum = m_sum;
+    *zero_count = m_zero_count;
+  }
+
+private:
+  void flush() {
+    const auto total =
+        _mm256_add_ps(_mm256_add_ps(m_accumulate_0, m_accumulate_1),
+                      _mm256_add_ps(m_accumulate_2, m_accumulate_3));
+    const auto half = _mm_add_ps(_mm256_castps256_ps128(total),
+                                 _mm256_extractf128_ps(total, 1));
+    alignas(16) float lanes[4];
+    _mm_store_ps(lanes, half);
+    m_sum += static_cast<double>(lanes[0]) + lanes[1] + lanes[2] + lanes[3];
+
+    m_accumulate_0 = _mm256_setzero_ps();
+    m_accumulate_1 = _mm256_setzero_ps();
+    m_accumulate_2 = _mm256_setzero_ps();
+    m_accumulate_3 = _mm256_setzero_ps();
+    m_pending = 0;
+  }
+
+  __m256 m_accumulate_0 = _mm256_setzero_ps();
+  __m256 m_accumulate_1 = _mm256_setzero_ps();
+  __m256 m_accumulate_2 = _mm256_setzero_ps();
+  __m256 m_accumulate_3 = _mm256_setzero_ps();
+  double m_sum = 0.0;
+  uint64_t m_zero_count = 0;
+  uint64_t m_pending = 0;
+};
+
+inline __m256i load(const uint8_t *bytes) {
+  return _mm256_loadu_si256(reinterpret_cast<const __m256i *>(bytes));
+}
+
+// The 32 high packed6 registers spread over the top 2 bits of 3 byte vectors
+inline __m256i packed6_high(__m256i bytes_0, __m256i bytes_1,
+                            __m256i bytes_2) {
+  return _mm256_or_si256(
+      _mm256_or_si256(_mm256_and_si256(_mm256_srli_epi16(bytes_0, 6),
+                                       _mm256_set1_epi8(0x03)),
+                      _mm256_and_si256(_mm256_srli_epi16(bytes_1, 4),
+                                       _mm256_set1_epi8(0x0C))),
+      _mm256_and_si256(_mm256_srli_epi16(bytes_2, 2), _mm256_set1_epi8(0x30)));
+}
+
+// low registers with 2 bits of the high registers moved into their top bits
+template <int Shift> inline __m256i packed6_bytes(__m256i low, __m256i high) {
+  return _mm256_or_si256(low, _mm256_and_si256(_mm256_slli_epi16(high, Shift),
+                                               _mm256_set1_epi8(-64)));
+}
+
+// 32 packed4 offsets from 16 bytes, in register order
+inline __m256i unpack4(const uint8_t *packed) {
+  const auto bytes =
+      _mm_loadu_si128(reinterpret_cast<const __m128i *>(packed));
+  const auto mask = _mm_set1_epi8(0x0F);
+  const auto low = _mm_and_si128(bytes, mask);
+  const auto high = _mm_and_si128(_mm_srli_epi16(bytes, 4), mask);
+  return _mm256_inserti128_si256(
+      _mm256_castsi128_si256(_mm_unpacklo_epi8(low, high)),
+      _mm_unpackhi_epi8(low, high), 1);
+}
+
+void sum_registers(const uint8_t *registers, uint64_t register_count,
+                   double *sum, uint64_t *zero_count) {
+  SumAccumulator accumulator;
+  for (auto register_ix = 0UL; register_ix < register_count;
+       register_ix += 32) {
+    accumulator.add(load(&registers[register_ix]));
+  }
+  accumulator.finish(sum, zero_count);
+}
+
+void sum_joint(const uint8_t *registers, const uint8_t *other,
+               uint64_t register_count, double *sums,
+               uint64_t *zero_counts) {
+  SumAccumulator first;
+  SumAccumulator second;
+  SumAccumulator both;
+  for (auto register_ix = 0UL; register_ix < register_count;
+       register_ix += 32) {
+    const auto first_registers = load(&registers[register_ix]);
+    const auto second_registers = load(&other[register_ix]);
+    first.add(first_registers);
+    second.add(second_registers);
+    both.add(_mm256_max_epu8(first_registers, second_registers));
+  }
+  first.finish(&sums[0], &zero_counts[0]);
+  second.finish(&sums[1], &zero_counts[1]);
+  both.finish(&sums[2], &zero_counts[2]);
+}
+
+// Vectors counted into byte lanes before the lanes would overflow
+constexpr uint64_t k_histogram_flush = 255;
+
+void histogram_registers(const uint8_t *registers, uint64_t register_count,
+                         uint64_t *histogram) {
+  using llb::kernels::k_histogram_window;
+  auto lowest_lanes = _mm256_set1_epi8(-1);
+  for (auto register_ix = 0UL; register_ix < register_count;
+       register_ix += 32) {
+    lowest_lanes = _mm256_min_epu8(lowest_lanes, load(&registers[register_ix]));
+  }
+  alignas(32) uint8_t lanes[32];
+  _mm256_store_si256(reinterpret_cast<__m256i *>(lanes), lowest_lanes);
+  uint8_t lowest = lanes[0];
+  for (const auto lane : lanes) {
+    lowest = lane < lowest ? lane : lowest;
+  }
+
+  const auto base = llb::kernels::histogram_base(lowest);
+  const auto base_lanes = _mm256_set1_epi8(static_cast<char>(base));
+  const auto last_lanes = _mm256_set1_epi8(k_histogram_window - 1);
+  __m256i counts[k_histogram_window];
+  for (auto &count : counts) {
+    count = _mm256_setzero_si256();
+  }
+  const auto flush = [&]() {
+    for (auto rank = 0U; rank < k_histogram_window; rank += 1) {
+      const auto sums = _mm256_sad_epu8(counts[rank], _mm256_setzero_si256());
+      histogram[base + rank] += static_cast<uint64_t>(
+          _mm256_extract_epi64(sums, 0) + _mm256_extract_epi64(sums, 1) +
+          _mm256_extract_epi64(sums, 2) + _mm256_extract_epi64(sums, 3));
+      counts[rank] = _mm256_setzero_si256();
+    }
+  };
+
+  auto pending = 0UL;
+  for (auto register_ix = 0UL; register_ix < register_count;
+       register_ix += 32) {
+    const auto offsets =
+        _mm256_sub_epi8(load(&registers[register_ix]), base_lanes);
+    // equal lanes are all ones, so subtracting them counts them
+    for (auto rank = 0U; rank < k_histogram_window; rank += 1) {
+      counts[rank] = _mm256_sub_epi8(
+          counts[rank],
+          _mm256_cmpeq_epi8(offsets,
+                            _mm256_set1_epi8(static_cast<char>(rank))));
+    }
+    auto above = ~static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(
+        _mm256_min_epu8(offsets, last_lanes), offsets)));
+    while (above != 0) {
+      histogram[registers[register_ix + __builtin_ctz(above)]] += 1;
+      above &= above - 1;
+    }
+    pending += 1;
+    if (pending == k_histogram_flush) {
+      flush();
+      pending = 0;
+    }
+  }
+  flush();
+}
+
+void merge_registers(uint8_t *registers, const uint8_t *merge_me,
+                     uint64_t register_count) {
+  for (auto register_ix = 0UL; register_ix < register_count;
+       register_ix += 32) {
+    auto *this_registers =
+        reinterpret_cast<__m256i *>(&registers[register_ix]);
+    const auto merge_me_registers = _mm256_loadu_si256(
+        reinterpret_cast<const __m256i *>(&merge_me[register_ix]));
+    _mm256_store_si256(this_registers,
+                       _mm256_max_epu8(_mm256_loadu_si256(this_registers),
+                                       merge_me_registers));
+  }
+}
+
+void sum_packed6(const uint8_t *registers, uint64_t register_count,
+                 double *sum, uint64_t *zero_count) {
+  const auto low_mask = _mm256_set1_epi8(0x3F);
+  SumAccumulator accumulator;
+  for (auto block_ix = 0UL; block_ix < register_count / 4 * 3;
+       block_ix += llb::kernels::k_packed6_block_bytes) {
+    for (auto byte_ix = block_ix; byte_ix < block_ix + 64; byte_ix += 32) {
+      const auto bytes_0 = load(&registers[byte_ix]);
+      const auto bytes_1 = load(&registers[byte_ix + 64]);
+      const auto bytes_2 = load(&registers[byte_ix + 128]);
+      accumulator.add(_mm256_and_si256(bytes_0, low_mask));
+      accumulator.add(_mm256_and_si256(bytes_1, low_mask));
+      accumulator.add(_mm256_and_si256(bytes_2, low_mask));
+      accumulator.add(packed6_high(bytes_0, bytes_1, bytes_2));
+    }
+  }
+  accumulator.finish(sum, zero_count);
+}
+
+void merge_packed6(uint8_t *registers, const uint8_t *merge_me,
+                   uint64_t register_count) {
+  const auto low_mask = _mm256_set1_epi8(0x3F);
+  for (auto block_ix = 0UL; block_ix < register_count / 4 * 3;
+       block_ix += llb::kernels::k_packed6_block_bytes) {
+    for (auto byte_ix = block_ix; byte_ix < block_ix + 64; byte_ix += 32) {
+      const auto this_0 = load(&registers[byte_ix]);
+      const auto this_1 = load(&registers[byte_ix + 64]);
+      const auto this_2 = load(&registers[byte_ix + 128]);
+      const auto merge_me_0 = load(&merge_me[byte_ix]);
+      const auto merge_me_1 = load(&merge_me[byte_ix + 64]);
+      const auto merge_me_2 = load(&merge_me[byte_ix + 128]);
+
+      const auto high =
+          _mm256_max_epu8(packed6_high(this_0, this_1, this_2),
+                          packed6_high(merge_me_0, merge_me_1, merge_me_2));
+      const auto low_0 =
+          _mm256_max_epu8(_mm256_and_si256(this_0, low_mask),
+                          _mm256_and_si256(merge_me_0, low_mask));
+      const auto low_1 =
+          _mm256_max_epu8(_mm256_and_si256(this_1, low_mask),
+                          _mm256_and_si256(merge_me_1, low_mask));
+      const auto low_2 =
+          _mm256_max_epu8(_mm256_and_si256(this_2, low_mask),
+                          _mm256_and_si256(merge_me_2, low_mask));
+
+      _mm256_store_si256(reinterpret_cast<__m256i *>(&registers[byte_ix]),
+                         packed6_bytes<6>(low_0, high));
+      _mm256_store_si256(
+          reinterpret_cast<__m256i *>(&registers[byte_ix + 64]),
+          packed6_bytes<4>(low_1, high));
+      _mm256_store_si256(
+          reinterpret_cast<__m256i *>(&registers[byte_ix + 128]),
+          packed6_bytes<2>(low_2, high));
+    }
+  }
+}
+
+void sum_packed4(const uint8_t *registers, uint64_t register_count,
+                 double *offset_sum, uint64_t *zero_count) {
+  SumAccumulator accumulator;
+  for (auto byte_ix = 0UL; byte_ix < register_count / 2; byte_ix += 16) {
+    accumulator.add(unpack4(&registers[byte_ix]));
+  }
+  accumulator.finish(offset_sum, zero_count);
+}
+
+// Lowers offsets by shift, leaving overflow markers in place
+inline __m256i shift_offsets(__m256i offsets, __m256i shift) {
+  const auto overflow = _mm256_set1_epi8(llb::kernels::k_packed4_overflow);
+  return _mm256_max_epu8(
+      _mm256_subs_epu8(offsets, shift),
+      _mm256_and_si256(_mm256_cmpeq_epi8(offsets, overflow), overflow));
+}
+
+inline uint64_t count_zeros(__m256i values) {
+  return static_cast<uint64_t>(
+      __builtin_popcount(static_cast<uint32_t>(_mm256_movemask_epi8(
+          _mm256_cmpeq_epi8(values, _mm256_setzero_si256())))));
+}
+
+uint64_t merge_packed4(uint8_t *registers, const uint8_t *merge_me,
+                       uint64_t register_count, uint8_t shift,
+                       uint8_t merge_me_shift) {
+  const auto mask = _mm256_set1_epi8(0x0F);
+  const auto this_shift = _mm256_set1_epi8(static_cast<char>(shift));
+  const auto merge_me_shift_v =
+      _mm256_set1_epi8(static_cast<char>(merge_me_shift));
+  uint64_t zero_count = 0;
+
+  for (auto byte_ix = 0UL; byte_ix < register_count / 2; byte_ix += 32) {
+    auto *this_registers = reinterpret_cast<__m256i *>(&registers[byte_ix]);
+    const auto this_bytes = _mm256_loadu_si256(this_registers);
+    const auto merge_me_bytes = _mm256_loadu_si256(
+        reinterpret_cast<const __m256i *>(&merge_me[byte_ix]));
+
+    const auto low = _mm256_max_epu8(
+        shift_offsets(_mm256_and_si256(this_bytes, mask), this_shift),
+        shift_offsets(_mm256_and_si256(merge_me_bytes, mask),
+                      merge_me_shift_v));
+    const auto high = _mm256_max_epu8(
+        shift_offsets(_mm256_and_si256(_mm256_srli_epi16(this_bytes, 4), mask),
+                      this_shift),
+        shift_offsets(
+            _mm256_and_si256(_mm256_srli_epi16(merge_me_bytes, 4), mask),
+            merge_me_shift_v));
+
+    zero_count += count_zeros(low) + count_zeros(high);
+    _mm256_store_si256(this_registers,
+                       _mm256_or_si256(low, _mm256_slli_epi16(high, 4)));
+  }
+  return zero_count;
+}
+
+// Folds 64 registers into 32 by moving the lowest index bit into the rank,
+// a pair's first register gains a rank and otherwise a set second one is 1
+inline __m256i fold_pairs(__m256i first, __m256i second) {
+  const auto one = _mm256_set1_epi16(1);
+  const auto fold = [&](__m256i pairs) {
+    const auto low = _mm256_and_si256(pairs, _mm256_set1_epi16(0xFF));
+    const auto high = _mm256_srli_epi16(pairs, 8);
+    return _mm256_max_epu16(_mm256_add_epi16(low, _mm256_min_epu16(low, one)),
+                            _mm256_min_epu16(high, one));
+  };
+  // packus interleaves the 128 bit lanes
+  return _mm256_permute4x64_epi64(
+      _mm256_packus_epi16(fold(first), fold(second)), 0xD8);
+}
+
+// Folds 32 << shift registers into 32 one bit at a time
+inline __m256i fold_vector(const uint8_t *merge_me, uint32_t shift) {
+  if (shift == 0) {
+    return load(merge_me);
+  }
+  return fold_pairs(fold_vector(merge_me, shift - 1),
+                    fold_vector(&merge_me[32UL << (shift - 1)], shift - 1));
+}
+
+void fold_registers(uint8_t *registers, const uint8_t *merge_me,
+                    uint64_t register_count, uint32_t shift) {
+  if (shift <= k_vector_fold_shift) {
+    for (auto register_ix = 0UL; register_ix < register_count;
+         register_ix += 32) {
+      auto *this_registers =
+          reinterpret_cast<__m256i *>(&registers[register_ix]);
+      _mm256_store_si256(
+          this_registers,
+          _mm256_max_epu8(_mm256_loadu_si256(this_registers),
+                          fold_vector(&merge_me[register_ix << shift], shift)));
+    }
+    return;
+  }
+
+  llb::kernels::fold_groups(
+      registers, merge_me, register_count, shift, [](const uint8_t *values) {
+        const auto zeros_0 = static_cast<uint32_t>(
+            _mm256_movemask_epi8(_mm256_cmpeq_epi8(
+                _mm256_loadu_si256(reinterpret_cast<const __m256i *>(values)),
+                _mm256_setzero_si256())));
+        const auto zeros_1 = static_cast<uint32_t>(
+            _mm256_movemask_epi8(_mm256_cmpeq_epi8(
+                _mm256_loadu_si256(
+                    reinterpret_cast<const __m256i *>(&values[32])),
+                _mm256_setzero_si256())));
+        return ~(static_cast<uint64_t>(zeros_1) << 32 | zeros_0);
+      });
+}
+
+// AVX2 has no 64 bit multiply, the low half of each product from 32 bit ones
+inline __m256i mullo_epi64(__m256i a, __m256i b) {
+  const auto cross = _mm256_add_epi64(
+      _mm256_mul_epu32(a, _mm256_srli_epi64(b, 32)),
+      _mm256_mul_epu32(_mm256_srli_epi64(a, 32), b));
+  return _mm256_add_epi64(_mm256_mul_epu32(a, b),
+                          _mm256_slli_epi64(cross, 32));
+}
+
+inline __m256i rotl_epi64(__m256i value, int bits) {
+  return _mm256_or_si256(_mm256_slli_epi64(value, bits),
+                         _mm256_srli_epi64(value, 64 - bits));
+}
+
+// XXH3's 4 to 8 byte path on 8 byte keys, the key's 32 bit halves swapped
+// and keyed, then rrmxmx
+inline __m256i xxh3_key8(__m256i key, __m256i flip) {
+  const auto multiplier = _mm256_set1_epi64x(llb::kernels::k_xxh3_rrmxmx);
+  auto hash = _mm256_xor_si256(_mm256_shuffle_epi32(key, 0xB1), flip);
+  hash = _mm256_xor_si256(hash, _mm256_xor_si256(rotl_epi64(hash, 49),
+                                                 rotl_epi64(hash, 24)));
+  hash = mullo_epi64(hash, multiplier);
+  hash = _mm256_xor_si256(
+      hash, _mm256_add_epi64(_mm256_srli_epi64(hash, 35),
+                             _mm256_set1_epi64x(8)));
+  hash = mullo_epi64(hash, multiplier);
+  return _mm256_xor_si256(hash, _mm256_srli_epi64(hash, 28));
+}
+
+// Low and high 64 bits of the 128 bit products xored together, from 32 bit
+// multiplies
+inline __m256i mul128_fold64(__m256i a, __m256i b) {
+  const auto a_high = _mm256_srli_epi64(a, 32);
+  const auto b_high = _mm256_srli_epi64(b, 32);
+  const auto low_low = _mm256_mul_epu32(a, b);
+  const auto low_high = _mm256_mul_epu32(a, b_high);
+  const auto high_low = _mm256_mul_epu32(a_high, b);
+  const auto high_high = _mm256_mul_epu32(a_high, b_high);
+  const auto low_mask = _mm256_set1_epi64x(0xFFFFFFFFLL);
+  const auto cross = _mm256_add_epi64(
+      _mm256_add_epi64(_mm256_srli_epi64(low_low, 32),
+                       _mm256_and_si256(low_high, low_mask)),
+      high_low);
+  const auto high =
+      _mm256_add_epi64(_mm256_add_epi64(high_high,
+                                        _mm256_srli_epi64(low_high, 32)),
+                       _mm256_srli_epi64(cross, 32));
+  const auto low = _mm256_or_si256(_mm256_slli_epi64(cross, 32),
+                                   _mm256_and_si256(low_low, low_mask));
+  return _mm256_xor_si256(low, high);
+}
+
+// XXH3's 9 to 16 byte path on 16 byte keys, split into their low and high
+// words
+inline __m256i xxh3_key16(__m256i low, __m256i high, __m256i low_flip,
+                          __m256i high_flip) {
+  const auto byte_swap =
+      _mm256_set_epi64x(0x08090A0B0C0D0E0FLL, 0x0001020304050607LL,
+                        0x08090A0B0C0D0E0FLL, 0x0001020304050607LL);
+  low = _mm256_xor_si256(low, low_flip);
+  high = _mm256_xor_si256(high, high_flip);
+  auto hash = _mm256_add_epi64(
+      _mm256_add_epi64(_mm256_set1_epi64x(16),
+                       _mm256_shuffle_epi8(low, byte_swap)),
+      _mm256_add_epi64(high, mul128_fold64(low, high)));
+  hash = _mm256_xor_si256(hash, _mm256_srli_epi64(hash, 37));
+  hash = mullo_epi64(hash,
+                     _mm256_set1_epi64x(llb::kernels::k_xxh3_avalanche));
+  return _mm256_xor_si256(hash, _mm256_srli_epi64(hash, 32));
+}
+
+inline __m256i splitmix64(__m256i value) {
+  value = _mm256_add_epi64(value, _mm256_set1_epi64x(0x9E3779B97F4A7C15LL));
+  value = mullo_epi64(_mm256_xor_si256(value, _mm256_srli_epi64(value, 30)),
+                      _mm256_set1_epi64x(0xBF58476D1CE4E5B9LL));
+  value = mullo_epi64(_mm256_xor_si256(value, _mm256_srli_epi64(value, 27)),
+                      _mm256_set1_epi64x(0x94D049BB133111EBLL));
+  return _mm256_xor_si256(value, _mm256_srli_epi64(value, 31));
+}
+
+void hash_keys(llb::HashFunction function, uint64_t seed, const uint8_t *keys,
+               uint64_t key_bytes, uint64_t count, uint64_t *hashes) {
+  const auto load = [&](uint64_t offset) {
+    return _mm256_loadu_si256(
+        reinterpret_cast<const __m256i *>(&keys[offset]));
+  };
+  const auto store = [&](uint64_t key_ix, __m256i hash) {
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(&hashes[key_ix]), hash);
+  };
+
+  auto key_ix = 0UL;
+  if (function == llb::HashFunction::xxh3 && key_bytes == 8) {
+    const auto flip = _mm256_set1_epi64x(static_cast<long long>(
+        llb::kernels::k_xxh3_flip8 - llb::kernels::xxh3_seed8(seed)));
+    for (; key_ix + 4 <= count; key_ix += 4) {
+      store(key_ix, xxh3_key8(load(key_ix * 8), flip));
+    }
+  } else if (function == llb::HashFunction::splitmix64 && key_bytes == 8) {
+    const auto seeds = _mm256_set1_epi64x(static_cast<long long>(seed));
+    for (; key_ix + 4 <= count; key_ix += 4) {
+      store(key_ix, splitmix64(_mm256_xor_si256(load(key_ix * 8), seeds)));
+    }
+  } else if (function != llb::HashFunction::xxh3_128_low && key_bytes == 16) {
+    const auto seeds = _mm256_set1_epi64x(static_cast<long long>(seed));
+    const auto low_flip = _mm256_set1_epi64x(
+        static_cast<long long>(llb::kernels::k_xxh3_flip16_low + seed));
+    const auto high_flip = _mm256_set1_epi64x(
+        static_cast<long long>(llb::kernels::k_xxh3_flip16_high - seed));
+    for (; key_ix + 4 <= count; key_ix += 4) {
+      const auto first = load(key_ix * 16);
+      const auto second = load(key_ix * 16 + 32);
+      // unpack gives keys 0, 2, 1, 3
+      const auto low =
+          _mm256_permute4x64_epi64(_mm256_unpacklo_epi64(first, second), 0xD8);
+      const auto high =
+          _mm256_permute4x64_epi64(_mm256_unpackhi_epi64(first, second), 0xD8);
+      store(key_ix,
+            function == llb::HashFunction::xxh3
+                ? xxh3_key16(low, high, low_flip, high_flip)
+                : splitmix64(_mm256_xor_si256(
+                      high, splitmix64(_mm256_xor_si256(low, seeds)))));
+    }
+  }
+  llb::kernels::scalar_hash_keys(function, seed, &keys[key_ix * key_bytes],
+                                 key_bytes, count - key_ix, &hashes[key_ix]);
+}
+} // namespace
+
+const llb::kernels::KernelTable llb::kernels::k_avx2 = {
+    llb::InstructionSet::avx2, sum_registers, merge_registers, sum_packed6,
+    merge_packed6, sum_packed4, merge_packed4,
+    llb::kernels::scalar_index_ranks, fold_registers, sum_joint,
+    histogram_registers, hash_keys};
+
+#endif
@@ -0,0 +1,553 @@
+/**
+ * KernelsAvx512.cpp
+ */
+
+#include "Kernels.h"
+
+#ifdef LLB_X86_KERNELS
+
+#include <immintrin.h>
+
+namespace {
+// Registers summed in float before flushing into the double total
+constexpr uint64_t k_block_size = 4096;
+// Folds up to this many bits are done a bit at a time in vectors, larger ones
+// look for the first set register of each group
+constexpr uint32_t k_vector_fold_shift = 5;
+
+void merge_registers(uint8_t *registers, const uint8_t *merge_me,
+                     uint64_t register_count) {
+  for (auto register_ix = 0UL; register_ix < register_count;
+       register_ix += 64) {
+    const auto this_registers =
+        *(reinterpret_cast<const __m512i *>(&registers[register_ix]));
+    const auto merge_me_registers =
+        _mm512_loadu_si512(&merge_me[register_ix]);
+
+    const auto mask =
+        _mm512_cmp_epi8_mask(this_registers, merge_me_registers, _MM_CMPINT_LT);
+    *(reinterpret_cast<__m512i *>(&registers[register_ix])) =
+        _mm512_mask_blend_epi8(mask, this_registers, merge_me_registers);
+  }
+}
+
+// 2^-value built directly from the float exponent bits, exact for all ranks
+inline __m512 reciprocal_pow2(__m128i value) {
+  return _mm512_castsi512_ps(_mm512_slli_epi32(
+      _mm512_sub_epi32(_mm512_set1_epi32(127), _mm512_cvtepu8_epi32(value)),
+      23));
+}
+
+// Sums 2^-value and counts zeros 64 values at a time, flushing the float
+// partial sums into the double total every k_block_size values
+class SumAccumulator {
+public:
+  void add(__m512i values) {
+    m_zero_count += static_cast<uint64_t>(__builtin_popcountll(
+        _mm512_cmpeq_epi8_mask(values, _mm512_setzero_si512())));
+
+    m_accumulate_0 = _mm512_add_ps(
+        m_accumulate_0, reciprocal_pow2(_mm512_extracti32x4_epi32(values, 0)));
+    m_accumulate_1 = _mm512_add_ps(
+        m_accumulate_1, reciprocal_pow2(_mm512_extracti32x4_epi32(values, 1)));
+    m_accumulate_2 = _mm512_add_ps(
+        m_accumulate_2, reciprocal_pow2(_mm512_extracti32x4_epi32(values, 2)));
+    m_accumulate_3 = _mm512_add_ps(
+        m_accumulate_3, reciprocal_pow2(_mm512_extracti32x4_epi32(values, 3)));
+
+    m_pending += 64;
+    if (m_pending == k_block_size) {
+      flush();
+    }
+  }
+
+  void finish(double *sum, uint64_t *zero_count) {
+    flush();
+    *sum = m_sum;
+    *zero_count = m_zero_count;
+  }
+
+private:
+  void flush() {
+    m_sum += static_cast<double>(_mm512_reduce_add_ps(
+        _mm512_add_ps(_mm512_add_ps(m_accumulate_0, m_accumulate_1),
+                      _mm512_add_ps(m_accumulate_2, m_accumulate_3))));
+
+    m_accumulate_0 = _mm512_setzero_ps();
+    m_accumulate_1 = _mm512_setzero_ps();
+    m_accumulate_2 = _mm512_setzero_ps();
+    m_accumulate_3 = _mm512_setzero_ps();
+    m_pending = 0;
+  }
+
+  __m512 m_accumulate_0 = _mm512_setzero_ps();
+  __m512 m_accumulate_1 = _mm512_setzero_ps();
+  __m512 m_accumulate_2 = _mm512_setzero_ps();
+  __m512 m_accumulate_3 = _mm512_setzero_ps();
+  double m_sum = 0.0;
+  uint64_t m_zero_count = 0;
+  uint64_t m_pending = 0;
+};
+
+void sum_registers(const uint8_t *registers, uint64_t register_count,
+                   double *sum, uint64_t *zero_count) {
+  SumAccumulator accumulator;
+  for (auto register_ix = 0UL; register_ix < register_count;
+       register_ix += 64) {
+    accumulator.add(_mm512_loadu_si512(&registers[register_ix]));
+  }
+  accumulator.finish(sum, zero_count);
+}
+
+void sum_joint(const uint8_t *registers, const uint8_t *other,
+               uint64_t register_count, double *sums,
+               uint64_t *zero_counts) {
+  SumAccumulator first;
+  SumAccumulator second;
+  SumAccumulator both;
+  for (auto register_ix = 0UL; register_ix < register_count;
+       register_ix += 64) {
+    const auto first_registers = _mm512_loadu_si512(&registers[register_ix]);
+    const auto second_registers = _mm512_loadu_si512(&other[register_ix]);
+    first.add(first_registers);
+    second.add(second_registers);
+    both.add(_mm512_max_epu8(first_registers, second_registers));
+  }
+  first.finish(&sums[0], &zero_counts[0]);
+  second.finish(&sums[1], &zero_counts[1]);
+  both.finish(&sums[2], &zero_counts[2]);
+}
+
+// Vectors of offsets summed into byte lanes before the lanes could overflow
+constexpr uint64_t k_min_sum_block = 15 * 64;
+// Registers histogrammed per pair of passes
+constexpr uint64_t k_histogram_tile = 8192;
+
+inline uint64_t sum_lanes(__m512i bytes) {
+  return static_cast<uint64_t>(_mm512_reduce_add_epi64(
+      _mm512_sad_epu8(bytes, _mm512_setzero_si512())));
+}
+
+// Adds min(register - base, rank) summed over the registers to totals[i] for
+// 8 ranks from first_rank. The registers at or above a rank are then the step
+// from one sum to the next, with no mask registers in the loop
+void add_min_sums(const uint8_t *registers, uint64_t register_count,
+                  uint8_t base, uint8_t first_rank, uint64_t *totals) {
+  const auto base_lanes = _mm512_set1_epi8(static_cast<char>(base));
+  const auto rank_0 = _mm512_set1_epi8(static_cast<char>(first_rank));
+  const auto rank_1 = _mm512_set1_epi8(static_cast<char>(first_rank + 1));
+  const auto rank_2 = _mm512_set1_epi8(static_cast<char>(first_rank + 2));
+  const auto rank_3 = _mm512_set1_epi8(static_cast<char>(first_rank + 3));
+  const auto rank_4 = _mm512_set1_epi8(static_cast<char>(first_rank + 4));
+  const auto rank_5 = _mm512_set1_epi8(static_cast<char>(first_rank + 5));
+  const auto rank_6 = _mm512_set1_epi8(static_cast<char>(first_rank + 6));
+  const auto rank_7 = _mm512_set1_epi8(static_cast<char>(first_rank + 7));
+  for (auto block_ix = 0UL; block_ix < register_count;
+       block_ix += k_min_sum_block) {
+    const auto block_end = register_count - block_ix < k_min_sum_block
+                               ? register_count
+                               : block_ix + k_min_sum_block;
+    auto sum_0 = _mm512_setzero_si512();
+    auto sum_1 = _mm512_setzero_si512();
+    auto sum_2 = _mm512_setzero_si512();
+    auto sum_3 = _mm512_setzero_si512();
+    auto sum_4 = _mm512_setzero_si512();
+    auto sum_5 = _mm512_setzero_si512();
+    auto sum_6 = _mm512_setzero_si512();
+    auto sum_7 = _mm512_setzero_si512();
+    for (auto register_ix = block_ix; register_ix < block_end;
+         register_ix += 64) {
+      const auto offsets = _mm512_sub_epi8(
+          _mm512_loadu_si512(&registers[register_ix]), base_lanes);
+      sum_0 = _mm512_add_epi8(sum_0, _mm512_min_epu8(offsets, rank_0));
+      sum_1 = _mm512_add_epi8(sum_1, _mm512_min_epu8(offsets, rank_1));
+      sum_2 = _mm512_add_epi8(sum_2, _mm512_min_epu8(offsets, rank_2));
+      sum_3 = _mm512_add_epi8(sum_3, _mm512_min_epu8(offsets, rank_3));
+      sum_4 = _mm512_add_epi8(sum_4, _mm512_min_epu8(offsets, rank_4));
+      sum_5 = _mm512_add_epi8(sum_5, _mm512_min_epu8(offsets, rank_5));
+      sum_6 = _mm512_add_epi8(sum_6, _mm512_min_epu8(offsets, rank_6));
+      sum_7 = _mm512_add_epi8(sum_7, _mm512_min_epu8(offsets, rank_7));
+    }
+    totals[0] += sum_lanes(sum_0);
+    totals[1] += sum_lanes(sum_1);
+    totals[2] += sum_lanes(sum_2);
+    totals[3] += sum_lanes(sum_3);
+    totals[4] += sum_lanes(sum_4);
+    totals[5] += sum_lanes(sum_5);
+    totals[6] += sum_lanes(sum_6);
+    totals[7] += sum_lanes(sum_7);
+  }
+}
+
+void histogram_registers(const uint8_t *registers, uint64_t register_count,
+                         uint64_t *histogram) {
+  using llb::kernels::k_histogram_window;
+  auto lowest_lanes = _mm512_set1_epi8(-1);
+  for (auto register_ix = 0UL; register_ix < register_count;
+       register_ix += 64) {
+    lowest_lanes = _mm512_min_epu8(
+        lowest_lanes, _mm512_loadu_si512(&registers[register_ix]));
+  }
+  alignas(64) uint8_t lanes[64];
+  _mm512_store_si512(lanes, lowest_lanes);
+  uint8_t lowest = lanes[0];
+  for (const auto lane : lanes) {
+    lowest = lane < lowest ? lane : lowest;
+  }
+
+  const auto base = llb::kernels::histogram_base(lowest);
+  const auto base_lanes = _mm512_set1_epi8(static_cast<char>(base));
+  const auto last_lanes = _mm512_set1_epi8(k_histogram_window - 1);
+  // sums[rank] is the sum of min(offset, rank), taken a tile at a time so
+  // the second pass over the tile reads it from L1
+  uint64_t sums[k_histogram_window + 1] = {};
+  for (auto tile_ix = 0UL; tile_ix < register_count;
+       tile_ix += k_histogram_tile) {
+    const auto tile_registers = register_count - tile_ix < k_histogram_tile
+                                    ? register_count - tile_ix
+                                    : k_histogram_tile;
+    add_min_sums(&registers[tile_ix], tile_registers, base, 1, &sums[1]);
+    add_min_sums(&registers[tile_ix], tile_registers, base, 9, &sums[9]);
+    for (auto register_ix = tile_ix; register_ix < tile_ix + tile_registers;
+         register_ix += 64) {
+      auto above = _mm512_cmpgt_epu8_mask(
+          _mm512_sub_epi8(_mm512_loadu_si512(&registers[register_ix]),
+                          base_lanes),
+          last_lanes);
+      while (above != 0) {
+        histogram[registers[register_ix + __builtin_ctzll(above)]] += 1;
+        above &= above - 1;
+      }
+    }
+  }
+
+  // the registers at a rank are the ones at or above it less the ones above
+  auto at_or_above = register_count;
+  for (auto rank = 0U; rank < k_histogram_window; rank += 1) {
+    const auto above = sums[rank + 1] - sums[rank];
+    histogram[base + rank] += at_or_above - above;
+    at_or_above = above;
+  }
+}
+
+// The 64 high packed6 registers spread over the top 2 bits of 3 byte vectors
+inline __m512i packed6_high(__m512i bytes_0, __m512i bytes_1,
+                            __m512i bytes_2) {
+  return _mm512_or_si512(
+      _mm512_or_si512(_mm512_and_si512(_mm512_srli_epi16(bytes_0, 6),
+                                       _mm512_set1_epi8(0x03)),
+                      _mm512_and_si512(_mm512_srli_epi16(bytes_1, 4),
+                                       _mm512_set1_epi8(0x0C))),
+      _mm512_and_si512(_mm512_srli_epi16(bytes_2, 2), _mm512_set1_epi8(0x30)));
+}
+
+// low registers with 2 bits of the high registers moved into their top bits,
+// low | (shifted & 0xC0) in a single ternary logic op
+template <int Shift> inline __m512i packed6_bytes(__m512i low, __m512i high) {
+  return _mm512_ternarylogic_epi32(low, _mm512_slli_epi16(high, Shift),
+                                   _mm512_set1_epi8(-64), 0xF8);
+}
+
+// 64 packed4 offsets from 32 bytes, in register order
+inline __m512i unpack4(const uint8_t *packed) {
+  const auto bytes =
+      _mm256_loadu_si256(reinterpret_cast<const __m256i *>(packed));
+  const auto mask = _mm256_set1_epi8(0x0F);
+  const auto low = _mm256_and_si256(bytes, mask);
+  const auto high = _mm256_and_si256(_mm256_srli_epi16(bytes, 4), mask);
+  const auto interleaved = _mm512_inserti64x4(
+      _mm512_castsi256_si512(_mm256_unpacklo_epi8(low, high)),
+      _mm256_unpackhi_epi8(low, high), 1);
+  return _mm512_shuffle_i64x2(interleaved, interleaved,
+                              _MM_SHUFFLE(3, 1, 2, 0));
+}
+
+void sum_packed6(const uint8_t *registers, uint64_t register_count,
+                 double *sum, uint64_t *zero_count) {
+  const auto low_mask = _mm512_set1_epi8(0x3F);
+  SumAccumulator accumulator;
+  for (auto block_ix = 0UL; block_ix < register_count / 4 * 3;
+       block_ix += llb::kernels::k_packed6_block_bytes) {
+    const auto bytes_0 = _mm512_loadu_si512(&registers[block_ix]);
+    const auto bytes_1 = _mm512_loadu_si512(&registers[block_ix + 64]);
+    const auto bytes_2 = _mm512_loadu_si512(&registers[block_ix + 128]);
+    accumulator.add(_mm512_and_si512(bytes_0, low_mask));
+    accumulator.add(_mm512_and_si512(bytes_1, low_mask));
+    accumulator.add(_mm512_and_si512(bytes_2, low_mask));
+    accumulator.add(packed6_high(bytes_0, bytes_1, bytes_2));
+  }
+  accumulator.finish(sum, zero_count);
+}
+
+void merge_packed6(uint8_t *registers, const uint8_t *merge_me,
+                   uint64_t register_count) {
+  const auto low_mask = _mm512_set1_epi8(0x3F);
+  for (auto block_ix = 0UL; block_ix < register_count / 4 * 3;
+       block_ix += llb::kernels::k_packed6_block_bytes) {
+    const auto this_0 = _mm512_loadu_si512(&registers[block_ix]);
+    const auto this_1 = _mm512_loadu_si512(&registers[block_ix + 64]);
+    const auto this_2 = _mm512_loadu_si512(&registers[block_ix + 128]);
+    const auto merge_me_0 = _mm512_loadu_si512(&merge_me[block_ix]);
+    const auto merge_me_1 = _mm512_loadu_si512(&merge_me[block_ix + 64]);
+    const auto merge_me_2 = _mm512_loadu_si512(&merge_me[block_ix + 128]);
+
+    const auto high =
+        _mm512_max_epu8(packed6_high(this_0, this_1, this_2),
+                        packed6_high(merge_me_0, merge_me_1, merge_me_2));
+    const auto low_0 = _mm512_max_epu8(_mm512_and_si512(this_0, low_mask),
+                                       _mm512_and_si512(merge_me_0, low_mask));
+    const auto low_1 = _mm512_max_epu8(_mm512_and_si512(this_1, low_mask),
+                                       _mm512_and_si512(merge_me_1, low_mask));
+    const auto low_2 = _mm512_max_epu8(_mm512_and_si512(this_2, low_mask),
+                                       _mm512_and_si512(merge_me_2, low_mask));
+
+    _mm512_store_si512(&registers[block_ix], packed6_bytes<6>(low_0, high));
+    _mm512_store_si512(&registers[block_ix + 64],
+                       packed6_bytes<4>(low_1, high));
+    _mm512_store_si512(&registers[block_ix + 128],
+                       packed6_bytes<2>(low_2, high));
+  }
+}
+
+void sum_packed4(const uint8_t *registers, uint64_t register_count,
+                 double *offset_sum, uint64_t *zero_count) {
+  SumAccumulator accumulator;
+  for (auto byte_ix = 0UL; byte_ix < register_count / 2; byte_ix += 32) {
+    accumulator.add(unpack4(&registers[byte_ix]));
+  }
+  accumulator.finish(offset_sum, zero_count);
+}
+
+// Lowers offsets by shift, leaving overflow markers in place
+inline __m512i shift_offsets(__m512i offsets, __m512i shift) {
+  const auto overflow = _mm512_set1_epi8(llb::kernels::k_packed4_overflow);
+  return _mm512_mask_blend_epi8(_mm512_cmpeq_epi8_mask(offsets, overflow),
+                                _mm512_subs_epu8(offsets, shift), overflow);
+}
+
+uint64_t merge_packed4(uint8_t *registers, const uint8_t *merge_me,
+                       uint64_t register_count, uint8_t shift,
+                       uint8_t merge_me_shift) {
+  const auto mask = _mm512_set1_epi8(0x0F);
+  const auto this_shift = _mm512_set1_epi8(static_cast<char>(shift));
+  const auto merge_me_shift_v =
+      _mm512_set1_epi8(static_cast<char>(merge_me_shift));
+  uint64_t zero_count = 0;
+
+  for (auto byte_ix = 0UL; byte_ix < register_count / 2; byte_ix += 64) {
+    auto *this_registers = reinterpret_cast<__m512i *>(&registers[byte_ix]);
+    const auto this_bytes = _mm512_loadu_si512(this_registers);
+    const auto merge_me_bytes = _mm512_loadu_si512(&merge_me[byte_ix]);
+
+    const auto low = _mm512_max_epu8(
+        shift_offsets(_mm512_and_si512(this_bytes, mask), this_shift),
+        shift_offsets(_mm512_and_si512(merge_me_bytes, mask),
+                      merge_me_shift_v));
+    const auto high = _mm512_max_epu8(
+        shift_offsets(_mm512_and_si512(_mm512_srli_epi16(this_bytes, 4), mask),
+                      this_shift),
+        shift_offsets(
+            _mm512_and_si512(_mm512_srli_epi16(merge_me_bytes, 4), mask),
+            merge_me_shift_v));
+
+    zero_count += static_cast<uint64_t>(
+        __builtin_popcountll(
+            _mm512_cmpeq_epi8_mask(low, _mm512_setzero_si512())) +
+        __builtin_popcountll(
+            _mm512_cmpeq_epi8_mask(high, _mm512_setzero_si512())));
+    _mm512_store_si512(this_registers,
+                       _mm512_or_si512(low, _mm512_slli_epi16(high, 4)));
+  }
+  return zero_count;
+}
+
+void index_ranks(const uint64_t *hashes, uint64_t count,
+                 uint32_t precision_bits, uint32_t *indices, uint8_t *ranks) {
+  const auto index_shift = _mm_cvtsi32_si128(64 - precision_bits);
+  const auto rank_shift = _mm_cvtsi32_si128(precision_bits);
+  const auto sentinel = _mm512_set1_epi64(1LL << (precision_bits - 1));
+  const auto one = _mm512_set1_epi64(1);
+
+  auto hash_ix = 0UL;
+  for (; hash_ix + 8 <= count; hash_ix += 8) {
+    const auto hash = _mm512_loadu_si512(&hashes[hash_ix]);
+    const auto rank = _mm512_add_epi64(
+        _mm512_lzcnt_epi64(
+            _mm512_or_si512(_mm512_sll_epi64(hash, rank_shift), sentinel)),
+        one);
+    _mm256_storeu_si256(
+        reinterpret_cast<__m256i *>(&indices[hash_ix]),
+        _mm512_cvtepi64_epi32(_mm512_srl_epi64(hash, index_shift)));
+    _mm_storel_epi64(reinterpret_cast<__m128i *>(&ranks[hash_ix]),
+                     _mm512_cvtepi64_epi8(rank));
+  }
+  llb::kernels::scalar_index_ranks(&hashes[hash_ix], count - hash_ix,
+                                   precision_bits, &indices[hash_ix],
+                                   &ranks[hash_ix]);
+}
+
+// Folds 128 registers into 64 by moving the lowest index bit into the rank,
+// a pair's first register gains a rank and otherwise a set second one is 1
+inline __m512i fold_pairs(__m512i first, __m512i second) {
+  const auto one = _mm512_set1_epi16(1);
+  const auto fold = [&](__m512i pairs) {
+    const auto low = _mm512_and_si512(pairs, _mm512_set1_epi16(0xFF));
+    const auto high = _mm512_srli_epi16(pairs, 8);
+    return _mm512_max_epu16(_mm512_add_epi16(low, _mm512_min_epu16(low, one)),
+                            _mm512_min_epu16(high, one));
+  };
+  // packus interleaves the 128 bit lanes
+  return _mm512_permutexvar_epi64(
+      _mm512_setr_epi64(0, 2, 4, 6, 1, 3, 5, 7),
+      _mm512_packus_epi16(fold(first), fold(second)));
+}
+
+// Folds 64 << shift registers into 64 one bit at a time
+inline __m512i fold_vector(const uint8_t *merge_me, uint32_t shift) {
+  if (shift == 0) {
+    return _mm512_loadu_si512(merge_me);
+  }
+  return fold_pairs(fold_vector(merge_me, shift - 1),
+                    fold_vector(&merge_me[64UL << (shift - 1)], shift - 1));
+}
+
+void fold_registers(uint8_t *registers, const uint8_t *merge_me,
+                    uint64_t register_count, uint32_t shift) {
+  if (shift <= k_vector_fold_shift) {
+    for (auto register_ix = 0UL; register_ix < register_count;
+         register_ix += 64) {
+      auto *this_registers = &registers[register_ix];
+      _mm512_store_si512(
+          this_registers,
+          _mm512_max_epu8(_mm512_loadu_si512(this_registers),
+                          fold_vector(&merge_me[register_ix << shift], shift)));
+    }
+    return;
+  }
+
+  llb::kernels::fold_groups(
+      registers, merge_me, register_count, shift, [](const uint8_t *values) {
+        const auto bytes = _mm512_loadu_si512(values);
+        return static_cast<uint64_t>(_mm512_test_epi8_mask(bytes, bytes));
+      });
+}
+
+// XXH3's 4 to 8 byte path on 8 byte keys, the key's 32 bit halves swapped
+// and keyed, then rrmxmx
+inline __m512i xxh3_key8(__m512i key, __m512i flip) {
+  const auto multiplier = _mm512_set1_epi64(llb::kernels::k_xxh3_rrmxmx);
+  auto hash = _mm512_xor_si512(_mm512_ror_epi64(key, 32), flip);
+  hash = _mm512_ternarylogic_epi64(hash, _mm512_rol_epi64(hash, 49),
+                                   _mm512_rol_epi64(hash, 24), 0x96);
+  hash = _mm512_mullo_epi64(hash, multiplier);
+  hash = _mm512_xor_si512(
+      hash, _mm512_add_epi64(_mm512_srli_epi64(hash, 35),
+                             _mm512_set1_epi64(8)));
+  hash = _mm512_mullo_epi64(hash, multiplier);
+  return _mm512_xor_si512(hash, _mm512_srli_epi64(hash, 28));
+}
+
+// Low and high 64 bits of the 128 bit products xored together, from 32 bit
+// multiplies
+inline __m512i mul128_fold64(__m512i a, __m512i b) {
+  const auto a_high = _mm512_srli_epi64(a, 32);
+  const auto b_high = _mm512_srli_epi64(b, 32);
+  const auto low_low = _mm512_mul_epu32(a, b);
+  const auto low_high = _mm512_mul_epu32(a, b_high);
+  const auto high_low = _mm512_mul_epu32(a_high, b);
+  const auto high_high = _mm512_mul_epu32(a_high, b_high);
+  const auto low_mask = _mm512_set1_epi64(0xFFFFFFFFLL);
+  const auto cross = _mm512_add_epi64(
+      _mm512_add_epi64(_mm512_srli_epi64(low_low, 32),
+                       _mm512_and_si512(low_high, low_mask)),
+      high_low);
+  const auto high =
+      _mm512_add_epi64(_mm512_add_epi64(high_high,
+                                        _mm512_srli_epi64(low_high, 32)),
+                       _mm512_srli_epi64(cross, 32));
+  const auto low = _mm512_or_si512(_mm512_slli_epi64(cross, 32),
+                                   _mm512_and_si512(low_low, low_mask));
+  return _mm512_xor_si512(low, high);
+}
+
+// XXH3's 9 to 16 byte path on 16 byte keys, split into their low and high
+// words
+inline __m512i xxh3_key16(__m512i low, __m512i high, __m512i low_flip,
+                          __m512i high_flip) {
+  const auto byte_swap = _mm512_set4_epi64(
+      0x08090A0B0C0D0E0FLL, 0x0001020304050607LL, 0x08090A0B0C0D0E0FLL,
+      0x0001020304050607LL);
+  low = _mm512_xor_si512(low, low_flip);
+  high = _mm512_xor_si512(high, high_flip);
+  auto hash = _mm512_add_epi64(
+      _mm512_add_epi64(_mm512_set1_epi64(16),
+                       _mm512_shuffle_epi8(low, byte_swap)),
+      _mm512_add_epi64(high, mul128_fold64(low, high)));
+  hash = _mm512_xor_si512(hash, _mm512_srli_epi64(hash, 37));
+  hash = _mm512_mullo_epi64(hash,
+                            _mm512_set1_epi64(llb::kernels::k_xxh3_avalanche));
+  return _mm512_xor_si512(hash, _mm512_srli_epi64(hash, 32));
+}
+
+inline __m512i splitmix64(__m512i value) {
+  value = _mm512_add_epi64(value, _mm512_set1_epi64(0x9E3779B97F4A7C15LL));
+  value = _mm512_mullo_epi64(
+      _mm512_xor_si512(value, _mm512_srli_epi64(value, 30)),
+      _mm512_set1_epi64(0xBF58476D1CE4E5B9LL));
+  value = _mm512_mullo_epi64(
+      _mm512_xor_si512(value, _mm512_srli_epi64(value, 27)),
+      _mm512_set1_epi64(0x94D049BB133111EBLL));
+  return _mm512_xor_si512(value, _mm512_srli_epi64(value, 31));
+}
+
+void hash_keys(llb::HashFunction function, uint64_t seed, const uint8_t *keys,
+               uint64_t key_bytes, uint64_t count, uint64_t *hashes) {
+  auto key_ix = 0UL;
+  if (function == llb::HashFunction::xxh3 && key_bytes == 8) {
+    const auto flip = _mm512_set1_epi64(static_cast<long long>(
+        llb::kernels::k_xxh3_flip8 - llb::kernels::xxh3_seed8(seed)));
+    for (; key_ix + 8 <= count; key_ix += 8) {
+      _mm512_storeu_si512(
+          &hashes[key_ix],
+          xxh3_key8(_mm512_loadu_si512(&keys[key_ix * 8]), flip));
+    }
+  } else if (function == llb::HashFunction::splitmix64 && key_bytes == 8) {
+    const auto seeds = _mm512_set1_epi64(static_cast<long long>(seed));
+    for (; key_ix + 8 <= count; key_ix += 8) {
+      _mm512_storeu_si512(
+          &hashes[key_ix],
+          splitmix64(
+              _mm512_xor_si512(_mm512_loadu_si512(&keys[key_ix * 8]), seeds)));
+    }
+  } else if (function != llb::HashFunction::xxh3_128_low && key_bytes == 16) {
+    const auto low_words = _mm512_setr_epi64(0, 2, 4, 6, 8, 10, 12, 14);
+    const auto high_words = _mm512_setr_epi64(1, 3, 5, 7, 9, 11, 13, 15);
+    const auto seeds = _mm512_set1_epi64(static_cast<long long>(seed));
+    const auto low_flip = _mm512_set1_epi64(
+        static_cast<long long>(llb::kernels::k_xxh3_flip16_low + seed));
+    const auto high_flip = _mm512_set1_epi64(
+        static_cast<long long>(llb::kernels::k_xxh3_flip16_high - seed));
+    for (; key_ix + 8 <= count; key_ix += 8) {
+      const auto first = _mm512_loadu_si512(&keys[key_ix * 16]);
+      const auto second = _mm512_loadu_si512(&keys[key_ix * 16 + 64]);
+      const auto low = _mm512_permutex2var_epi64(first, low_words, second);
+      const auto high = _mm512_permutex2var_epi64(first, high_words, second);
+      _mm512_storeu_si512(
+          &hashes[key_ix],
+          function == llb::HashFunction::xxh3
+              ? xxh3_key16(low, high, low_flip, high_flip)
+              : splitmix64(_mm512_xor_si512(
+                    high, splitmix64(_mm512_xor_si512(low, seeds)))));
+    }
+  }
+  llb::kernels::scalar_hash_keys(function, seed, &keys[key_ix * key_bytes],
+                                 key_bytes, count - key_ix, &hashes[key_ix]);
+}
+} // namespace
+
+const llb::kernels::KernelTable llb::kernels::k_avx512 = {
+    llb::InstructionSet::avx512, sum_registers, merge_registers, sum_packed6,
+    merge_packed6, sum_packed4, merge_packed4,
+    index_ranks, fold_registers, sum_joint, histogram_registers, hash_keys};
+
+#endif
@@ -0,0 +1,207 @@
+/**
+ * KernelsScalar.cpp
+ */
+
+#include <algorithm>
+#include <cstring>
+
+#include "Kernels.h"
+#include "xxhash.h"
+
+namespace {
+void sum_registers(const uint8_t *registers, uint64_t register_count,
+                   double *sum_arg, uint64_t *zero_count_arg) {
+  double sum = 0.0;
+  uint64_t zero_count = 0;
+  for (auto register_ix = 0UL; register_ix < register_count;
+       register_ix += 1) {
+    const auto value = registers[register_ix];
+    zero_count += value == 0 ? 1 : 0;
+    sum += 1.0 / (1UL << value);
+  }
+
+  *sum_arg = sum;
+  *zero_count_arg = zero_count;
+}
+
+void merge_registers(uint8_t *registers, const uint8_t *merge_me,
+                     uint64_t register_count) {
+  for (auto register_ix = 0UL; register_ix < register_count;
+       register_ix += 1) {
+    registers[register_ix] = registers[register_ix] < merge_me[register_ix]
+                                 ? merge_me[register_ix]
+                                 : registers[register_ix];
+  }
+}
+
+void sum_packed6(const uint8_t *registers, uint64_t register_count,
+                 double *sum_arg, uint64_t *zero_count_arg) {
+  double sum = 0.0;
+  uint64_t zero_count = 0;
+  for (auto register_ix = 0UL; register_ix < register_count;
+       register_ix += 1) {
+    const auto value = llb::kernels::packed6_get(registers, register_ix);
+    zero_count += value == 0 ? 1 : 0;
+    sum += 1.0 / (1UL << value);
+  }
+
+  *sum_arg = sum;
+  *zero_count_arg = zero_count;
+}
+
+void merge_packed6(uint8_t *registers, const uint8_t *merge_me,
+                   uint64_t register_count) {
+  for (auto register_ix = 0UL; register_ix < register_count;
+       register_ix += llb::kernels::k_packed6_block_registers) {
+    // high registers first, their bits share bytes with the low registers
+    for (auto high_ix = register_ix + llb::kernels::k_packed6_block_bytes;
+         high_ix < register_ix + llb::kernels::k_packed6_block_registers;
+         high_ix += 1) {
+      const auto value = llb::kernels::packed6_get(merge_me, high_ix);
+      if (llb::kernels::packed6_get(registers, high_ix) < value) {
+        llb::kernels::packed6_set(registers, high_ix, value);
+      }
+    }
+
+    const auto block_ix = register_ix / 4 * 3;
+    for (auto byte_ix = block_ix;
+         byte_ix < block_ix + llb::kernels::k_packed6_block_bytes;
+         byte_ix += 1) {
+      const auto low = std::max(registers[byte_ix] & 0x3F,
+                                merge_me[byte_ix] & 0x3F);
+      registers[byte_ix] =
+          static_cast<uint8_t>((registers[byte_ix] & 0xC0) | low);
+    }
+  }
+}
+
+void sum_packed4(const uint8_t *registers, uint64_t register_count,
+                 double *offset_sum_arg, uint64_t *zero_count_arg) {
+  double offset_sum = 0.0;
+  uint64_t zero_count = 0;
+  for (auto byte_ix = 0UL; byte_ix < register_count / 2; byte_ix += 1) {
+    const auto low = registers[byte_ix] & 0x0F;
+    const auto high = registers[byte_ix] >> 4;
+    zero_count += (low == 0 ? 1 : 0) + (high == 0 ? 1 : 0);
+    offset_sum += 1.0 / (1UL << low) + 1.0 / (1UL << high);
+  }
+
+  *offset_sum_arg = offset_sum;
+  *zero_count_arg = zero_count;
+}
+
+inline uint8_t shift_offset(uint8_t offset, uint8_t shift) {
+  if (offset == llb::kernels::k_packed4_overflow) {
+    return offset;
+  }
+  return offset > shift ? static_cast<uint8_t>(offset - shift) : 0;
+}
+
+uint64_t merge_packed4(uint8_t *registers, const uint8_t *merge_me,
+                       uint64_t register_count, uint8_t shift,
+                       uint8_t merge_me_shift) {
+  uint64_t zero_count = 0;
+  for (auto byte_ix = 0UL; byte_ix < register_count / 2; byte_ix += 1) {
+    const auto low = std::max(shift_offset(registers[byte_ix] & 0x0F, shift),
+                              shift_offset(merge_me[byte_ix] & 0x0F,
+                                           merge_me_shift));
+    const auto high = std::max(shift_offset(registers[byte_ix] >> 4, shift),
+                               shift_offset(merge_me[byte_ix] >> 4,
+                                            merge_me_shift));
+    zero_count += (low == 0 ? 1 : 0) + (high == 0 ? 1 : 0);
+    registers[byte_ix] = static_cast<uint8_t>(low | (high << 4));
+  }
+  return zero_count;
+}
+
+void fold_registers(uint8_t *registers, const uint8_t *merge_me,
+                    uint64_t register_count, uint32_t shift) {
+  llb::kernels::fold_groups(
+      registers, merge_me, register_count, shift, [](const uint8_t *values) {
+        uint64_t mask = 0;
+        for (auto value_ix = 0UL; value_ix < 64; value_ix += 1) {
+          mask |= (values[value_ix] != 0 ? 1UL : 0UL) << value_ix;
+        }
+        return mask;
+      });
+}
+
+void sum_joint(const uint8_t *registers, const uint8_t *other,
+               uint64_t register_count, double *sums,
+               uint64_t *zero_counts) {
+  double sum[3] = {0.0, 0.0, 0.0};
+  uint64_t zero_count[3] = {0, 0, 0};
+  for (auto register_ix = 0UL; register_ix < register_count;
+       register_ix += 1) {
+    const uint8_t values[3] = {
+        registers[register_ix], other[register_ix],
+        std::max(registers[register_ix], other[register_ix])};
+    for (auto side = 0; side < 3; side += 1) {
+      zero_count[side] += values[side] == 0 ? 1 : 0;
+      sum[side] += 1.0 / (1UL << values[side]);
+    }
+  }
+
+  for (auto side = 0; side < 3; side += 1) {
+    sums[side] = sum[side];
+    zero_counts[side] = zero_count[side];
+  }
+}
+
+void histogram_registers(const uint8_t *registers, uint64_t register_count,
+                         uint64_t *histogram) {
+  // four histograms so runs of equal ranks don't wait on each other's stores
+  uint64_t counts[4][llb::kernels::k_histogram_size] = {};
+  for (auto register_ix = 0UL; register_ix < register_count;
+       register_ix += 4) {
+    counts[0][registers[register_ix]] += 1;
+    counts[1][registers[register_ix + 1]] += 1;
+    counts[2][registers[register_ix + 2]] += 1;
+    counts[3][registers[register_ix + 3]] += 1;
+  }
+
+  for (auto rank = 0UL; rank < llb::kernels::k_histogram_size; rank += 1) {
+    histogram[rank] +=
+        counts[0][rank] + counts[1][rank] + counts[2][rank] + counts[3][rank];
+  }
+}
+} // namespace
+
+void llb::kernels::scalar_index_ranks(const uint64_t *hashes, uint64_t count,
+                                      uint32_t precision_bits,
+                                      uint32_t *indices, uint8_t *ranks) {
+  for (auto hash_ix = 0UL; hash_ix < count; hash_ix += 1) {
+    indices[hash_ix] =
+        static_cast<uint32_t>(hashes[hash_ix] >> (64 - precision_bits));
+    ranks[hash_ix] = hash_rank(hashes[hash_ix], precision_bits);
+  }
+}
+
+void llb::kernels::scalar_hash_keys(HashFunction function, uint64_t seed,
+                                    const uint8_t *keys, uint64_t key_bytes,
+                                    uint64_t count, uint64_t *hashes) {
+  for (auto key_ix = 0UL; key_ix < count; key_ix += 1) {
+    const auto *key = &keys[key_ix * key_bytes];
+    switch (function) {
+    case HashFunction::xxh3_128_low:
+      hashes[key_ix] = XXH3_128bits_withSeed(key, key_bytes, seed).low64;
+      break;
+    case HashFunction::splitmix64: {
+      uint64_t words[2] = {};
+      std::memcpy(words, key, key_bytes);
+      hashes[key_ix] = key_bytes == 8
+                           ? splitmix64(words[0] ^ seed)
+                           : splitmix64_key16(words[0], words[1], seed);
+      break;
+    }
+    default:
+      hashes[key_ix] = XXH3_64bits_withSeed(key, key_bytes, seed);
+    }
+  }
+}
+
+const llb::kernels::KernelTable llb::kernels::k_scalar = {
+    llb::InstructionSet::scalar, sum_registers, merge_registers, sum_packed6,
+    merge_packed6, sum_packed4, merge_packed4,
+    llb::kernels::scalar_index_ranks, fold_registers, sum_joint,
+    histogram_registers, llb::kernels::scalar_hash_keys};
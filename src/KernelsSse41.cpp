@@ -0,0 +1,384 @@
+/**
+ * KernelsSse41.cpp
+ */
+
+#include "Kernels.h"
+
+#ifdef LLB_X86_KERNELS
+
+#include <smmintrin.h>
+
+namespace {
+// Registers summed in float before flushing into the double total
+constexpr uint64_t k_block_size = 1024;
+// Folds up to this many bits are done a bit at a time in vectors, larger ones
+// look for the first set register of each group
+constexpr uint32_t k_vector_fold_shift = 5;
+
+// 2^-value built directly from the float exponent bits, exact for all ranks
+inline __m128 reciprocal_pow2(__m128i value) {
+  return _mm_castsi128_ps(
+      _mm_slli_epi32(_mm_sub_epi32(_mm_set1_epi32(127), value), 23));
+}
+
+// Sums 2^-value and counts zeros 16 values at a time, flushing the float
+// partial sums into the double total every k_block_size values
+class SumAccumulator {
+public:
+  void add(__m128i values) {
+    // every zero adds 0xFF, popcnt isn't part of SSE4.1
+    m_zero_sums = _mm_add_epi64(
+        m_zero_sums,
+        _mm_sad_epu8(_mm_cmpeq_epi8(values, _mm_setzero_si128()),
+                     _mm_setzero_si128()));
+
+    m_accumulate_0 =
+        _mm_add_ps(m_accumulate_0, reciprocal_pow2(_mm_cvtepu8_epi32(values)));
+    m_accumulate_1 = _mm_add_ps(
+        m_accumulate_1,
+        reciprocal_pow2(_mm_cvtepu8_epi32(_mm_srli_si128(values, 4))));
+    m_accumulate_2 = _mm_add_ps(
+        m_accumulate_2,
+        reciprocal_pow2(_mm_cvtepu8_epi32(_mm_srli_si128(values, 8))));
+    m_accumulate_3 = _mm_add_ps(
+        m_accumulate_3,
+        reciprocal_pow2(_mm_cvtepu8_epi32(_mm_srli_si128(values, 12))));
+
+    m_pending += 16;
+    if (m_pending == k_block_size) {
+      flush();
+    }
+  }
+
+  void finish(double *sum, uint64_t *zero_count) {
+    flush();
+    *sum = m_sum;
+    *zero_count = static_cast<uint64_t>(_mm_cvtsi128_si64(m_zero_sums) +
+                                        _mm_extract_epi64(m_zero_sums, 1)) /
+                  0xFF;
+  }
+
+private:
+  void flush() {
+    const auto total = _mm_add_ps(_mm_add_ps(m_accumulate_0, m_accumulate_1),
+                                  _mm_add_ps(m_accumulate_2, m_accumulate_3));
+    alignas(16) float lanes[4];
+    _mm_store_ps(lanes, total);
+    m_sum += static_cast<double>(lanes[0]) + lanes[1] + lanes[2] + lanes[3];
+
+    m_accumulate_0 = _mm_setzero_ps();
+    m_accumulate_1 = _mm_setzero_ps();
+    m_accumulate_2 = _mm_setzero_ps();
+    m_accumulate_3 = _mm_setzero_ps();
+    m_pending = 0;
+  }
+
+  __m128 m_accumulate_0 = _mm_setzero_ps();
+  __m128 m_accumulate_1 = _mm_setzero_ps();
+  __m128 m_accumulate_2 = _mm_setzero_ps();
+  __m128 m_accumulate_3 = _mm_setzero_ps();
+  __m128i m_zero_sums = _mm_setzero_si128();
+  double m_sum = 0.0;
+  uint64_t m_pending = 0;
+};
+
+inline __m128i load(const uint8_t *bytes) {
+  return _mm_loadu_si128(reinterpret_cast<const __m128i *>(bytes));
+}
+
+// The 16 high packed6 registers spread over the top 2 bits of 3 byte vectors
+inline __m128i packed6_high(__m128i bytes_0, __m128i bytes_1,
+                            __m128i bytes_2) {
+  return _mm_or_si128(
+      _mm_or_si128(
+          _mm_and_si128(_mm_srli_epi16(bytes_0, 6), _mm_set1_epi8(0x03)),
+          _mm_and_si128(_mm_srli_epi16(bytes_1, 4), _mm_set1_epi8(0x0C))),
+      _mm_and_si128(_mm_srli_epi16(bytes_2, 2), _mm_set1_epi8(0x30)));
+}
+
+// low registers with 2 bits of the high registers moved into their top bits
+template <int Shift> inline __m128i packed6_bytes(__m128i low, __m128i high) {
+  return _mm_or_si128(low, _mm_and_si128(_mm_slli_epi16(high, Shift),
+                                         _mm_set1_epi8(-64)));
+}
+
+// 16 packed4 offsets from 8 bytes, in register order
+inline __m128i unpack4(const uint8_t *packed) {
+  const auto bytes =
+      _mm_loadl_epi64(reinterpret_cast<const __m128i *>(packed));
+  const auto mask = _mm_set1_epi8(0x0F);
+  return _mm_unpacklo_epi8(_mm_and_si128(bytes, mask),
+                           _mm_and_si128(_mm_srli_epi16(bytes, 4), mask));
+}
+
+void sum_registers(const uint8_t *registers, uint64_t register_count,
+                   double *sum, uint64_t *zero_count) {
+  SumAccumulator accumulator;
+  for (auto register_ix = 0UL; register_ix < register_count;
+       register_ix += 16) {
+    accumulator.add(load(&registers[register_ix]));
+  }
+  accumulator.finish(sum, zero_count);
+}
+
+void sum_joint(const uint8_t *registers, const uint8_t *other,
+               uint64_t register_count, double *sums,
+               uint64_t *zero_counts) {
+  SumAccumulator first;
+  SumAccumulator second;
+  SumAccumulator both;
+  for (auto register_ix = 0UL; register_ix < register_count;
+       register_ix += 16) {
+    const auto first_registers = load(&registers[register_ix]);
+    const auto second_registers = load(&other[register_ix]);
+    first.add(first_registers);
+    second.add(second_registers);
+    both.add(_mm_max_epu8(first_registers, second_registers));
+  }
+  first.finish(&sums[0], &zero_counts[0]);
+  second.finish(&sums[1], &zero_counts[1]);
+  both.finish(&sums[2], &zero_counts[2]);
+}
+
+// Vectors counted into byte lanes before the lanes would overflow
+constexpr uint64_t k_histogram_flush = 255;
+
+void histogram_registers(const uint8_t *registers, uint64_t register_count,
+                         uint64_t *histogram) {
+  using llb::kernels::k_histogram_window;
+  auto lowest_lanes = _mm_set1_epi8(-1);
+  for (auto register_ix = 0UL; register_ix < register_count;
+       register_ix += 16) {
+    lowest_lanes = _mm_min_epu8(lowest_lanes, load(&registers[register_ix]));
+  }
+  alignas(16) uint8_t lanes[16];
+  _mm_store_si128(reinterpret_cast<__m128i *>(lanes), lowest_lanes);
+  uint8_t lowest = lanes[0];
+  for (const auto lane : lanes) {
+    lowest = lane < lowest ? lane : lowest;
+  }
+
+  const auto base = llb::kernels::histogram_base(lowest);
+  const auto base_lanes = _mm_set1_epi8(static_cast<char>(base));
+  const auto last_lanes = _mm_set1_epi8(k_histogram_window - 1);
+  __m128i counts[k_histogram_window];
+  for (auto &count : counts) {
+    count = _mm_setzero_si128();
+  }
+  const auto flush = [&]() {
+    for (auto rank = 0U; rank < k_histogram_window; rank += 1) {
+      const auto sums = _mm_sad_epu8(counts[rank], _mm_setzero_si128());
+      histogram[base + rank] += static_cast<uint64_t>(
+          _mm_extract_epi64(sums, 0) + _mm_extract_epi64(sums, 1));
+      counts[rank] = _mm_setzero_si128();
+    }
+  };
+
+  auto pending = 0UL;
+  for (auto register_ix = 0UL; register_ix < register_count;
+       register_ix += 16) {
+    const auto offsets =
+        _mm_sub_epi8(load(&registers[register_ix]), base_lanes);
+    // equal lanes are all ones, so subtracting them counts them
+    for (auto rank = 0U; rank < k_histogram_window; rank += 1) {
+      counts[rank] = _mm_sub_epi8(
+          counts[rank],
+          _mm_cmpeq_epi8(offsets, _mm_set1_epi8(static_cast<char>(rank))));
+    }
+    const auto within =
+        _mm_cmpeq_epi8(_mm_min_epu8(offsets, last_lanes), offsets);
+    auto above = ~static_cast<uint32_t>(_mm_movemask_epi8(within)) & 0xFFFFU;
+    while (above != 0) {
+      histogram[registers[register_ix + __builtin_ctz(above)]] += 1;
+      above &= above - 1;
+    }
+    pending += 1;
+    if (pending == k_histogram_flush) {
+      flush();
+      pending = 0;
+    }
+  }
+  flush();
+}
+
+void merge_registers(uint8_t *registers, const uint8_t *merge_me,
+                     uint64_t register_count) {
+  for (auto register_ix = 0UL; register_ix < register_count;
+       register_ix += 16) {
+    auto *this_registers =
+        reinterpret_cast<__m128i *>(&registers[register_ix]);
+    const auto merge_me_registers = _mm_loadu_si128(
+        reinterpret_cast<const __m128i *>(&merge_me[register_ix]));
+    _mm_store_si128(this_registers,
+                    _mm_max_epu8(_mm_load_si128(this_registers),
+                                 merge_me_registers));
+  }
+}
+
+void sum_packed6(const uint8_t *registers, uint64_t register_count,
+                 double *sum, uint64_t *zero_count) {
+  const auto low_mask = _mm_set1_epi8(0x3F);
+  SumAccumulator accumulator;
+  for (auto block_ix = 0UL; block_ix < register_count / 4 * 3;
+       block_ix += llb::kernels::k_packed6_block_bytes) {
+    for (auto byte_ix = block_ix; byte_ix < block_ix + 64; byte_ix += 16) {
+      const auto bytes_0 = load(&registers[byte_ix]);
+      const auto bytes_1 = load(&registers[byte_ix + 64]);
+      const auto bytes_2 = load(&registers[byte_ix + 128]);
+      accumulator.add(_mm_and_si128(bytes_0, low_mask));
+      accumulator.add(_mm_and_si128(bytes_1, low_mask));
+      accumulator.add(_mm_and_si128(bytes_2, low_mask));
+      accumulator.add(packed6_high(bytes_0, bytes_1, bytes_2));
+    }
+  }
+  accumulator.finish(sum, zero_count);
+}
+
+void merge_packed6(uint8_t *registers, const uint8_t *merge_me,
+                   uint64_t register_count) {
+  const auto low_mask = _mm_set1_epi8(0x3F);
+  for (auto block_ix = 0UL; block_ix < register_count / 4 * 3;
+       block_ix += llb::kernels::k_packed6_block_bytes) {
+    for (auto byte_ix = block_ix; byte_ix < block_ix + 64; byte_ix += 16) {
+      const auto this_0 = load(&registers[byte_ix]);
+      const auto this_1 = load(&registers[byte_ix + 64]);
+      const auto this_2 = load(&registers[byte_ix + 128]);
+      const auto merge_me_0 = load(&merge_me[byte_ix]);
+      const auto merge_me_1 = load(&merge_me[byte_ix + 64]);
+      const auto merge_me_2 = load(&merge_me[byte_ix + 128]);
+
+      const auto high =
+          _mm_max_epu8(packed6_high(this_0, this_1, this_2),
+                       packed6_high(merge_me_0, merge_me_1, merge_me_2));
+      const auto low_0 = _mm_max_epu8(_mm_and_si128(this_0, low_mask),
+                                      _mm_and_si128(merge_me_0, low_mask));
+      const auto low_1 = _mm_max_epu8(_mm_and_si128(this_1, low_mask),
+                                      _mm_and_si128(merge_me_1, low_mask));
+      const auto low_2 = _mm_max_epu8(_mm_and_si128(this_2, low_mask),
+                                      _mm_and_si128(merge_me_2, low_mask));
+
+      _mm_store_si128(reinterpret_cast<__m128i *>(&registers[byte_ix]),
+                      packed6_bytes<6>(low_0, high));
+      _mm_store_si128(reinterpret_cast<__m128i *>(&registers[byte_ix + 64]),
+                      packed6_bytes<4>(low_1, high));
+      _mm_store_si128(reinterpret_cast<__m128i *>(&registers[byte_ix + 128]),
+                      packed6_bytes<2>(low_2, high));
+    }
+  }
+}
+
+void sum_packed4(const uint8_t *registers, uint64_t register_count,
+                 double *offset_sum, uint64_t *zero_count) {
+  SumAccumulator accumulator;
+  for (auto byte_ix = 0UL; byte_ix < register_count / 2; byte_ix += 8) {
+    accumulator.add(unpack4(&registers[byte_ix]));
+  }
+  accumulator.finish(offset_sum, zero_count);
+}
+
+// Lowers offsets by shift, leaving overflow markers in place
+inline __m128i shift_offsets(__m128i offsets, __m128i shift) {
+  const auto overflow = _mm_set1_epi8(llb::kernels::k_packed4_overflow);
+  return _mm_max_epu8(
+      _mm_subs_epu8(offsets, shift),
+      _mm_and_si128(_mm_cmpeq_epi8(offsets, overflow), overflow));
+}
+
+uint64_t merge_packed4(uint8_t *registers, const uint8_t *merge_me,
+                       uint64_t register_count, uint8_t shift,
+                       uint8_t merge_me_shift) {
+  const auto mask = _mm_set1_epi8(0x0F);
+  const auto this_shift = _mm_set1_epi8(static_cast<char>(shift));
+  const auto merge_me_shift_v =
+      _mm_set1_epi8(static_cast<char>(merge_me_shift));
+  auto zero_sums = _mm_setzero_si128();
+
+  for (auto byte_ix = 0UL; byte_ix < register_count / 2; byte_ix += 16) {
+    auto *this_registers = reinterpret_cast<__m128i *>(&registers[byte_ix]);
+    const auto this_bytes = _mm_loadu_si128(this_registers);
+    const auto merge_me_bytes = _mm_loadu_si128(
+        reinterpret_cast<const __m128i *>(&merge_me[byte_ix]));
+
+    const auto low = _mm_max_epu8(
+        shift_offsets(_mm_and_si128(this_bytes, mask), this_shift),
+        shift_offsets(_mm_and_si128(merge_me_bytes, mask), merge_me_shift_v));
+    const auto high = _mm_max_epu8(
+        shift_offsets(_mm_and_si128(_mm_srli_epi16(this_bytes, 4), mask),
+                      this_shift),
+        shift_offsets(_mm_and_si128(_mm_srli_epi16(merge_me_bytes, 4), mask),
+                      merge_me_shift_v));
+
+    zero_sums = _mm_add_epi64(
+        zero_sums,
+        _mm_add_epi64(
+            _mm_sad_epu8(_mm_cmpeq_epi8(low, _mm_setzero_si128()),
+                         _mm_setzero_si128()),
+            _mm_sad_epu8(_mm_cmpeq_epi8(high, _mm_setzero_si128()),
+                         _mm_setzero_si128())));
+    _mm_store_si128(this_registers,
+                    _mm_or_si128(low, _mm_slli_epi16(high, 4)));
+  }
+  return static_cast<uint64_t>(_mm_cvtsi128_si64(zero_sums) +
+                               _mm_extract_epi64(zero_sums, 1)) /
+         0xFF;
+}
+
+// Folds 32 registers into 16 by moving the lowest index bit into the rank,
+// a pair's first register gains a rank and otherwise a set second one is 1
+inline __m128i fold_pairs(__m128i first, __m128i second) {
+  const auto one = _mm_set1_epi16(1);
+  const auto fold = [&](__m128i pairs) {
+    const auto low = _mm_and_si128(pairs, _mm_set1_epi16(0xFF));
+    const auto high = _mm_srli_epi16(pairs, 8);
+    return _mm_max_epu16(_mm_add_epi16(low, _mm_min_epu16(low, one)),
+                         _mm_min_epu16(high, one));
+  };
+  return _mm_packus_epi16(fold(first), fold(second));
+}
+
+// Folds 16 << shift registers into 16 one bit at a time
+inline __m128i fold_vector(const uint8_t *merge_me, uint32_t shift) {
+  if (shift == 0) {
+    return load(merge_me);
+  }
+  return fold_pairs(fold_vector(merge_me, shift - 1),
+                    fold_vector(&merge_me[16UL << (shift - 1)], shift - 1));
+}
+
+void fold_registers(uint8_t *registers, const uint8_t *merge_me,
+                    uint64_t register_count, uint32_t shift) {
+  if (shift <= k_vector_fold_shift) {
+    for (auto register_ix = 0UL; register_ix < register_count;
+         register_ix += 16) {
+      auto *this_registers =
+          reinterpret_cast<__m128i *>(&registers[register_ix]);
+      _mm_store_si128(
+          this_registers,
+          _mm_max_epu8(_mm_loadu_si128(this_registers),
+                       fold_vector(&merge_me[register_ix << shift], shift)));
+    }
+    return;
+  }
+
+  llb::kernels::fold_groups(
+      registers, merge_me, register_count, shift, [](const uint8_t *values) {
+        uint64_t mask = 0;
+        for (auto value_ix = 0UL; value_ix < 64; value_ix += 16) {
+          const auto zeros = _mm_movemask_epi8(_mm_cmpeq_epi8(
+              _mm_loadu_si128(
+                  reinterpret_cast<const __m128i *>(&values[value_ix])),
+              _mm_setzero_si128()));
+          mask |= static_cast<uint64_t>(~zeros & 0xFFFF) << value_ix;
+        }
+        return mask;
+      });
+}
+} // namespace
+
+const llb::kernels::KernelTable llb::kernels::k_sse41 = {
+    llb::InstructionSet::sse41, sum_registers, merge_registers, sum_packed6,
+    merge_packed6, sum_packed4, merge_packed4,
+    llb::kernels::scalar_index_ranks, fold_registers, sum_joint,
+    histogram_registers, llb::kernels::scalar_hash_keys};
+
+#endif
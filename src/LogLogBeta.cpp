@@ -2,231 +2,1428 @@
  * LogLogBeta.cpp
  */
 
+#include <algorithm>
 #include <cmath>
 #include <cstdlib>
 #include <cstring>
+#include <limits>
 #include <vector>
 
+#include "DenseRegisters.h"
+#include "JointEstimation.h"
+#include "Kernels.h"
 #include "LogLogBeta.h"
+#ifndef LLB_INLINE_HOT_PATH
+#include "LogLogBetaInline.h"
+#endif
+#include "LogLogBetaView.h"
+#include "MappedRegisterFile.h"
+#include "Serialization.h"
+#include "StatsCounters.h"
+#include "ThreadPool.h"
 #include "xxhash.h"
 
-#include <emmintrin.h>
-#include <immintrin.h>
-#include <pmmintrin.h>
-#include <xmmintrin.h>
-
 namespace {
-constexpr int64_t k_one = 1;
-constexpr __m512i k_ones = {k_one, k_one, k_one, k_one,
-                            k_one, k_one, k_one, k_one};
+constexpr uint32_t k_sparse_rank_mask =
+    (1U << llb::constants::k_sparse_rank_bits) - 1;
+// Values between prefetching a register line and updating it
+constexpr uint64_t k_prefetch_distance = 16;
+// Bytes of the next input's tile fetched ahead in a multi-way merge
+constexpr uint64_t k_merge_prefetch_bytes = 512;
+// Bytes of the next sketch's registers fetched ahead in a batch estimate,
+// all of a precision 14 byte sketch
+constexpr uint64_t k_batch_prefetch_bytes = 16384;
+
+// Max-reduces every input, from input_offset on, into registers a tile at a
+// time, the tile stays in cache while the inputs stream through it
+void merge_tiles(const llb::kernels::KernelTable &kernel_table,
+                 llb::RegisterLayout layout, uint8_t *registers,
+                 uint64_t register_count, const uint8_t *const *inputs,
+                 uint64_t input_count, uint64_t input_offset) {
+  const auto merge = layout == llb::RegisterLayout::packed6
+                         ? kernel_table.merge_packed6
+                         : kernel_table.merge_registers;
+  const auto tile_registers = std::min<uint64_t>(
+      llb::constants::k_merge_tile_registers, register_count);
+  const auto tile_bytes = llb::register_bytes(layout, tile_registers);
+  const auto bytes = llb::register_bytes(layout, register_count);
+  for (auto tile_ix = 0UL; tile_ix < bytes; tile_ix += tile_bytes) {
+    const auto input_tile_ix = input_offset + tile_ix;
+    for (auto input_ix = 0UL; input_ix < input_count; input_ix += 1) {
+      // the hardware prefetcher takes a few lines to pick up each new input
+      if (input_ix + 1 < input_count) {
+        for (auto line_ix = 0UL; line_ix < k_merge_prefetch_bytes;
+             line_ix += 64) {
+          __builtin_prefetch(&inputs[input_ix + 1][input_tile_ix + line_ix]);
+        }
+      }
+      merge(&registers[tile_ix], &inputs[input_ix][input_tile_ix],
+            tile_registers);
+    }
+  }
+}
+
+// 2^-rank, built from its exponent bits to keep divisions off the add path
+double inverse_power(uint8_t rank) {
+  const auto bits = static_cast<uint64_t>(1023U - rank) << 52;
+  double value;
+  std::memcpy(&value, &bits, sizeof(value));
+  return value;
+}
+
+// Ertl's sigma and tau, the series correcting for the zero registers and for
+// the registers at the highest rank. Both run until the terms stop changing
+// the total
+double ertl_sigma(double x) {
+  if (x == 1.0) {
+    return std::numeric_limits<double>::infinity();
+  }
+  auto y = 1.0;
+  auto z = x;
+  auto previous = 0.0;
+  do {
+    x *= x;
+    previous = z;
+    z += x * y;
+    y += y;
+  } while (z != previous);
+  return z;
+}
 
-constexpr auto k_alpha1 = 0.7213;
-constexpr auto k_alpha2 = 1.079;
+double ertl_tau(double x) {
+  if (x == 0.0 || x == 1.0) {
+    return 0.0;
+  }
+  auto y = 1.0;
+  auto z = 1.0 - x;
+  auto previous = 0.0;
+  do {
+    x = std::sqrt(x);
+    previous = z;
+    y *= 0.5;
+    z -= (1.0 - x) * (1.0 - x) * y;
+  } while (z != previous);
+  return z / 3.0;
+}
 } // namespace
 
-llb::LogLogBeta::LogLogBeta(double error_rate) noexcept
+llb::LogLogBeta::LogLogBeta(double error_rate,
+                            Representation representation,
+                            RegisterLayout layout, Hasher hasher) noexcept
     : m_precision_bits{0UL}, m_max_precision_bits{0UL},
-      m_register_count{0UL}, m_alpha{0.0}, m_registers{nullptr} {
+      m_register_count{0UL}, m_registers{nullptr}, m_layout{layout},
+      m_hasher{hasher}, m_storage{nullptr}, m_base{0U}, m_zero_offsets{0U},
+      m_sparse_sorted{0U}, m_incremental{false}, m_sum{0.0}, m_zero_count{0UL},
+      m_tracking{false} {
 
   const auto est_error_rate =
       std::ceil(std::log2(std::pow((1.04 / error_rate), 2.0)));
-  m_precision_bits = std::max(static_cast<uint32_t>(est_error_rate),
-                              llb::constants::k_minimum_precision);
+  reset(std::min(std::max(static_cast<uint32_t>(est_error_rate),
+                          llb::constants::k_minimum_precision),
+                 llb::constants::k_maximum_precision),
+        layout);
+
+  if (representation == Representation::dense) {
+    to_dense();
+  }
+}
+
+llb::LogLogBeta::LogLogBeta(RegisterStorage &storage, double error_rate,
+                            Representation representation,
+                            RegisterLayout layout, Hasher hasher) noexcept
+    : LogLogBeta(error_rate, Representation::sparse, layout, hasher) {
+  m_storage = &storage;
+  if (representation == Representation::dense) {
+    to_dense();
+  }
+}
+
+llb::LogLogBeta::LogLogBeta(MappedRegisterFile &file, uint64_t slot) noexcept
+    : LogLogBeta(constants::k_default_error_rate, Representation::sparse,
+                 file.layout(), file.hasher()) {
+  reset(file.precision_bits(), file.layout());
+  m_storage = &file;
+  m_registers = file.slot(slot);
+}
+
+llb::LogLogBeta::~LogLogBeta() noexcept {
+  release_registers(m_registers, allocation_bytes());
+}
+
+llb::LogLogBeta::LogLogBeta(LogLogBeta &&other) noexcept
+    : m_precision_bits{other.m_precision_bits},
+      m_max_precision_bits{other.m_max_precision_bits},
+      m_register_count{other.m_register_count},
+      m_registers{other.m_registers}, m_layout{other.m_layout},
+      m_hasher{other.m_hasher}, m_storage{other.m_storage},
+      m_base{other.m_base},
+      m_zero_offsets{other.m_zero_offsets},
+      m_overflow{std::move(other.m_overflow)},
+      m_sparse{std::move(other.m_sparse)},
+      m_sparse_sorted{other.m_sparse_sorted},
+      m_incremental{other.m_incremental}, m_sum{other.m_sum},
+      m_zero_count{other.m_zero_count}, m_tracking{other.m_tracking},
+      m_changed{std::move(other.m_changed)} {
+  other.m_tracking = false;
+  other.m_registers = nullptr;
+  other.reset(other.m_precision_bits, other.m_layout);
+}
+
+llb::LogLogBeta &llb::LogLogBeta::operator=(LogLogBeta &&other) noexcept {
+  if (this != &other) {
+    release_registers(m_registers, allocation_bytes());
+    m_precision_bits = other.m_precision_bits;
+    m_max_precision_bits = other.m_max_precision_bits;
+    m_register_count = other.m_register_count;
+    m_registers = other.m_registers;
+    m_layout = other.m_layout;
+    m_hasher = other.m_hasher;
+    m_storage = other.m_storage;
+    m_base = other.m_base;
+    m_zero_offsets = other.m_zero_offsets;
+    m_overflow = std::move(other.m_overflow);
+    m_sparse = std::move(other.m_sparse);
+    m_sparse_sorted = other.m_sparse_sorted;
+    m_incremental = other.m_incremental;
+    m_sum = other.m_sum;
+    m_zero_count = other.m_zero_count;
+    m_tracking = other.m_tracking;
+    m_changed = std::move(other.m_changed);
+
+    other.m_tracking = false;
+    other.m_registers = nullptr;
+    other.reset(other.m_precision_bits, other.m_layout);
+  }
+  return *this;
+}
+
+void llb::LogLogBeta::reset(uint32_t precision_bits, RegisterLayout layout) {
+  release_registers(m_registers, allocation_bytes());
+  m_registers = nullptr;
+  m_precision_bits = precision_bits;
   m_max_precision_bits = (sizeof(uint64_t) * 8) - m_precision_bits;
   m_register_count = 1UL << m_precision_bits;
-  m_alpha = k_alpha1 / (1.0 + k_alpha2 / static_cast<double>(m_register_count));
-  m_registers = reinterpret_cast<uint8_t *>(std::aligned_alloc(
-      llb::constants::k_default_alignment, m_register_count));
+  m_layout = layout;
+  m_base = 0U;
+  m_zero_offsets = 0U;
+  m_overflow.clear();
+  m_sparse.clear();
+  m_sparse_sorted = 0U;
+  if (m_tracking) {
+    m_changed.assign(m_register_count / 64, 0UL);
+  }
+}
+
+void llb::LogLogBeta::count_add(uint64_t index, uint8_t rank) const {
+  stats::add(stats::hashes_added, 1UL);
+  if (m_registers != nullptr) {
+    stats::add(stats::registers_raised, register_at(index) < rank ? 1UL : 0UL);
+  }
+}
+
+void llb::LogLogBeta::add_hashes(const uint64_t *hashes, uint64_t count) {
+  const auto &kernel_table = kernels::active();
+  uint32_t indices[constants::k_batch_size];
+  uint8_t ranks[constants::k_batch_size];
+  for (auto hash_ix = 0UL; hash_ix < count;
+       hash_ix += constants::k_batch_size) {
+    const auto batch_count =
+        std::min<uint64_t>(count - hash_ix, constants::k_batch_size);
+    kernel_table.index_ranks(&hashes[hash_ix], batch_count, m_precision_bits,
+                             indices, ranks);
+    add_index_ranks(indices, ranks, batch_count);
+  }
+}
+
+void llb::LogLogBeta::add_many(const uint8_t *const *values,
+                               const uint64_t *lengths, uint64_t count) {
+  uint64_t hashes[constants::k_batch_size];
+  for (auto value_ix = 0UL; value_ix < count;
+       value_ix += constants::k_batch_size) {
+    const auto batch_count =
+        std::min<uint64_t>(count - value_ix, constants::k_batch_size);
+    for (auto ix = 0UL; ix < batch_count; ix += 1) {
+      hashes[ix] =
+          m_hasher.hash(values[value_ix + ix], lengths[value_ix + ix]);
+    }
+    add_hashes(hashes, batch_count);
+  }
+}
 
-  std::memset(m_registers, 0, m_register_count);
+void llb::LogLogBeta::add_many(const uint8_t *buffer, const uint64_t *offsets,
+                               uint64_t count) {
+  uint64_t hashes[constants::k_batch_size];
+  for (auto value_ix = 0UL; value_ix < count;
+       value_ix += constants::k_batch_size) {
+    const auto batch_count =
+        std::min<uint64_t>(count - value_ix, constants::k_batch_size);
+    for (auto ix = value_ix; ix < value_ix + batch_count; ix += 1) {
+      hashes[ix - value_ix] =
+          m_hasher.hash(&buffer[offsets[ix]], offsets[ix + 1] - offsets[ix]);
+    }
+    add_hashes(hashes, batch_count);
+  }
+}
+
+void llb::LogLogBeta::add_many(const std::vector<std::string> &values) {
+  uint64_t hashes[constants::k_batch_size];
+  for (auto value_ix = 0UL; value_ix < values.size();
+       value_ix += constants::k_batch_size) {
+    const auto batch_count =
+        std::min<uint64_t>(values.size() - value_ix, constants::k_batch_size);
+    for (auto ix = 0UL; ix < batch_count; ix += 1) {
+      const auto &value = values[value_ix + ix];
+      hashes[ix] = m_hasher.hash(
+          reinterpret_cast<const uint8_t *>(value.data()), value.size());
+    }
+    add_hashes(hashes, batch_count);
+  }
 }
 
-llb::LogLogBeta::~LogLogBeta() noexcept { free(m_registers); }
+void llb::LogLogBeta::add_keys(const uint64_t *keys, uint64_t count) {
+  uint64_t hashes[constants::k_batch_size];
+  for (auto key_ix = 0UL; key_ix < count; key_ix += constants::k_batch_size) {
+    const auto batch_count =
+        std::min<uint64_t>(count - key_ix, constants::k_batch_size);
+    m_hasher.hash(&keys[key_ix], batch_count, hashes);
+    add_hashes(hashes, batch_count);
+  }
+}
 
-void llb::LogLogBeta::add(const uint8_t *value, uint64_t length) {
-  add_hash(XXH3_64bits(value, length));
+void llb::LogLogBeta::add_keys(const Uuid *keys, uint64_t count) {
+  uint64_t hashes[constants::k_batch_size];
+  for (auto key_ix = 0UL; key_ix < count; key_ix += constants::k_batch_size) {
+    const auto batch_count =
+        std::min<uint64_t>(count - key_ix, constants::k_batch_size);
+    m_hasher.hash(&keys[key_ix], batch_count, hashes);
+    add_hashes(hashes, batch_count);
+  }
 }
 
-void llb::LogLogBeta::add_hash(uint64_t hash) {
-  // Count leading zeros
-  const auto val = __builtin_clzll(hash << m_precision_bits) + 1;
+void llb::LogLogBeta::add_index_ranks(const uint32_t *indices,
+                                      const uint8_t *ranks, uint64_t count) {
+  stats::add(stats::hashes_added, count);
+  auto ix = 0UL;
+  // counted once per call, the counters live in thread local storage
+  auto raised = 0UL;
+  for (; ix < count && m_registers == nullptr; ix += 1) {
+    add_sparse(indices[ix], ranks[ix]);
+  }
+
+  // Registers past L1 are the bottleneck, so fetch the lines a few values
+  // ahead. Repeated indices are applied in order, so conflicts just work
+  if (m_layout == RegisterLayout::byte && !m_incremental && !m_tracking) {
+    for (; ix < count; ix += 1) {
+      if (ix + k_prefetch_distance < count) {
+        __builtin_prefetch(&m_registers[indices[ix + k_prefetch_distance]],
+                           1);
+      }
+      const auto index = indices[ix];
+      raised += m_registers[index] < ranks[ix] ? 1UL : 0UL;
+      m_registers[index] =
+          m_registers[index] < ranks[ix] ? ranks[ix] : m_registers[index];
+    }
+    stats::add(stats::registers_raised, raised);
+    return;
+  }
 
-  const auto k = hash >> m_max_precision_bits;
-  m_registers[k] =
-      m_registers[k] < val ? static_cast<uint8_t>(val) : m_registers[k];
+  for (; ix < count; ix += 1) {
+    if (ix + k_prefetch_distance < count) {
+      __builtin_prefetch(register_address(indices[ix + k_prefetch_distance]),
+                         1);
+    }
+    if (k_stats_enabled) {
+      raised += register_at(indices[ix]) < ranks[ix] ? 1UL : 0UL;
+    }
+    raise_register(indices[ix], ranks[ix]);
+  }
+  stats::add(stats::registers_raised, raised);
 }
 
-void llb::LogLogBeta::sum_registers_nonavx(double *sum_arg,
-                                           uint64_t *zero_count_arg) const {
+void llb::LogLogBeta::add_sparse(uint64_t index, uint8_t rank) {
+  // without comparing to the register's rank, so a sparse sketch reports
+  // every register it was given as changed
+  if (m_tracking) {
+    mark_changed(index);
+  }
+  m_sparse.push_back(
+      static_cast<uint32_t>(index << constants::k_sparse_rank_bits) | rank);
+  if (m_sparse.size() - m_sparse_sorted >= constants::k_sparse_buffer_size) {
+    compact_sparse();
+  }
+}
 
-  double sum = 0.0;
-  uint64_t zero_count = 0;
-  for (auto register_ix = 0UL; register_ix < m_register_count;
-       register_ix += 1) {
-    const auto value = m_registers[register_ix];
-    zero_count += value == 0 ? 1 : 0;
-    sum += 1.0 / (1UL << value);
+void llb::LogLogBeta::add_entry(uint32_t entry) {
+  const auto index = entry >> constants::k_sparse_rank_bits;
+  const auto rank = static_cast<uint8_t>(entry & k_sparse_rank_mask);
+  if (m_registers == nullptr) {
+    add_sparse(index, rank);
+  } else {
+    raise_register(index, rank);
   }
+}
 
-  *sum_arg = sum;
-  *zero_count_arg = zero_count;
+void llb::LogLogBeta::compact_sparse() {
+  compact_entries(&m_sparse, m_sparse_sorted);
+  m_sparse_sorted = static_cast<uint32_t>(m_sparse.size());
+
+  if (m_sparse.size() >
+      m_register_count / constants::k_sparse_promote_divisor) {
+    to_dense();
+  }
 }
 
-#ifdef __AVX512F__
-void llb::LogLogBeta::sum_registers(double *sum_arg,
-                                    uint64_t *zero_count_arg) const {
-  __m512 accumulate_0 = _mm512_setzero_ps();
-  __m512 accumulate_1 = _mm512_setzero_ps();
-  __m512 accumulate_2 = _mm512_setzero_ps();
-  __m512 accumulate_3 = _mm512_setzero_ps();
-  uint64_t zero_count = 0;
+void llb::LogLogBeta::to_dense() {
+  const auto bytes = allocation_bytes();
+  // aligned_alloc() takes only multiples of the alignment
+  const auto alignment = llb::constants::k_default_alignment;
+  m_registers = m_storage != nullptr
+                    ? m_storage->allocate(bytes)
+                    : reinterpret_cast<uint8_t *>(std::aligned_alloc(
+                          alignment,
+                          (bytes + alignment - 1) / alignment * alignment));
+  std::memset(m_registers, 0, bytes);
+  m_base = 0U;
+  m_zero_offsets = static_cast<uint32_t>(m_register_count);
+  m_sum = static_cast<double>(m_register_count);
+  m_zero_count = m_register_count;
 
-  __m512i reg;
-
-  __mmask64 mask;
-
-  __m128i reg0;
-  __m128i reg1;
-  __m128i reg2;
-  __m128i reg3;
-  __m128i reg4;
-  __m128i reg5;
-  __m128i reg6;
-  __m128i reg7;
-
-  __m256 reg0_reciprocal;
-  __m256 reg1_reciprocal;
-  __m256 reg2_reciprocal;
-  __m256 reg3_reciprocal;
-  __m256 reg4_reciprocal;
-  __m256 reg5_reciprocal;
-  __m256 reg6_reciprocal;
-  __m256 reg7_reciprocal;
-
-  __m512 sum_one_round_0;
-  __m512 sum_one_round_1;
-  __m512 sum_one_round_2;
-  __m512 sum_one_round_3;
+  for (const auto entry : m_sparse) {
+    raise_register(entry >> constants::k_sparse_rank_bits,
+                   static_cast<uint8_t>(entry & k_sparse_rank_mask));
+  }
 
-  for (auto register_ix = 0UL; register_ix < m_register_count;
-       register_ix += 64) {
-
-    reg = *(reinterpret_cast<const __m512i *>(&m_registers[register_ix]));
-
-    mask = _mm512_cmp_epi8_mask(reg, _mm512_setzero_si512(), _MM_CMPINT_EQ);
-    zero_count += static_cast<uint64_t>(_mm_popcnt_u64(mask));
-
-    reg0 = _mm_loadu_si128((__m128i const *)(m_registers + register_ix + 0));
-    reg1 = _mm_loadu_si128((__m128i const *)(m_registers + register_ix + 8));
-    reg2 = _mm_loadu_si128((__m128i const *)(m_registers + register_ix + 16));
-    reg3 = _mm_loadu_si128((__m128i const *)(m_registers + register_ix + 24));
-    reg4 = _mm_loadu_si128((__m128i const *)(m_registers + register_ix + 32));
-    reg5 = _mm_loadu_si128((__m128i const *)(m_registers + register_ix + 40));
-    reg6 = _mm_loadu_si128((__m128i const *)(m_registers + register_ix + 48));
-    reg7 = _mm_loadu_si128((__m128i const *)(m_registers + register_ix + 56));
-
-    reg0_reciprocal = _mm256_rcp14_ps(_mm512_cvtepi64_ps(
-        _mm512_sllv_epi64(k_ones, _mm512_cvtepi8_epi64(reg0))));
-    reg1_reciprocal = _mm256_rcp14_ps(_mm512_cvtepi64_ps(
-        _mm512_sllv_epi64(k_ones, _mm512_cvtepi8_epi64(reg1))));
-    reg2_reciprocal = _mm256_rcp14_ps(_mm512_cvtepi64_ps(
-        _mm512_sllv_epi64(k_ones, _mm512_cvtepi8_epi64(reg2))));
-    reg3_reciprocal = _mm256_rcp14_ps(_mm512_cvtepi64_ps(
-        _mm512_sllv_epi64(k_ones, _mm512_cvtepi8_epi64(reg3))));
-    reg4_reciprocal = _mm256_rcp14_ps(_mm512_cvtepi64_ps(
-        _mm512_sllv_epi64(k_ones, _mm512_cvtepi8_epi64(reg4))));
-    reg5_reciprocal = _mm256_rcp14_ps(_mm512_cvtepi64_ps(
-        _mm512_sllv_epi64(k_ones, _mm512_cvtepi8_epi64(reg5))));
-    reg6_reciprocal = _mm256_rcp14_ps(_mm512_cvtepi64_ps(
-        _mm512_sllv_epi64(k_ones, _mm512_cvtepi8_epi64(reg6))));
-    reg7_reciprocal = _mm256_rcp14_ps(_mm512_cvtepi64_ps(
-        _mm512_sllv_epi64(k_ones, _mm512_cvtepi8_epi64(reg7))));
-
-    sum_one_round_0 = _mm512_insertf32x8(sum_one_round_0, reg0_reciprocal, 0);
-    sum_one_round_0 = _mm512_insertf32x8(sum_one_round_0, reg1_reciprocal, 1);
-
-    sum_one_round_1 = _mm512_insertf32x8(sum_one_round_1, reg2_reciprocal, 0);
-    sum_one_round_1 = _mm512_insertf32x8(sum_one_round_1, reg3_reciprocal, 1);
-
-    sum_one_round_2 = _mm512_insertf32x8(sum_one_round_2, reg4_reciprocal, 0);
-    sum_one_round_2 = _mm512_insertf32x8(sum_one_round_2, reg5_reciprocal, 1);
-
-    sum_one_round_3 = _mm512_insertf32x8(sum_one_round_3, reg6_reciprocal, 0);
-    sum_one_round_3 = _mm512_insertf32x8(sum_one_round_3, reg7_reciprocal, 1);
-
-    accumulate_0 = _mm512_add_ps(sum_one_round_0, accumulate_0);
-    accumulate_1 = _mm512_add_ps(sum_one_round_1, accumulate_1);
-    accumulate_2 = _mm512_add_ps(sum_one_round_2, accumulate_2);
-    accumulate_3 = _mm512_add_ps(sum_one_round_3, accumulate_3);
-  }
-
-  accumulate_0 = _mm512_add_ps(accumulate_0, accumulate_1);
-  accumulate_0 = _mm512_add_ps(accumulate_0, accumulate_2);
-  accumulate_0 = _mm512_add_ps(accumulate_0, accumulate_3);
-
-  *sum_arg =
-      accumulate_0[0] + accumulate_0[1] + accumulate_0[2] + accumulate_0[3] +
-      accumulate_0[4] + accumulate_0[5] + accumulate_0[6] + accumulate_0[7] +
-      accumulate_0[8] + accumulate_0[9] + accumulate_0[10] + accumulate_0[11] +
-      accumulate_0[12] + accumulate_0[13] + accumulate_0[14] + accumulate_0[15];
+  std::vector<uint32_t>().swap(m_sparse);
+  m_sparse_sorted = 0U;
+}
+
+uint64_t llb::LogLogBeta::register_bytes() const {
+  return llb::register_bytes(m_layout, m_register_count);
+}
+
+uint64_t llb::LogLogBeta::allocation_bytes() const {
+  return register_bytes() + kernels::k_register_padding;
+}
+
+void llb::LogLogBeta::release_registers(uint8_t *registers, uint64_t bytes) {
+  if (registers == nullptr) {
+    return;
+  }
+  if (m_storage != nullptr) {
+    m_storage->deallocate(registers, bytes);
+  } else {
+    free(registers);
+  }
+}
+
+const uint8_t *llb::LogLogBeta::register_address(uint64_t index) const {
+  switch (m_layout) {
+  case RegisterLayout::packed6: {
+    const auto block_ix = index % kernels::k_packed6_block_registers;
+    return &m_registers[index / kernels::k_packed6_block_registers *
+                            kernels::k_packed6_block_bytes +
+                        block_ix % kernels::k_packed6_block_bytes];
+  }
+  case RegisterLayout::packed4:
+    return &m_registers[index / 2];
+  default:
+    return &m_registers[index];
+  }
+}
+
+uint8_t llb::LogLogBeta::register_at(uint64_t index) const {
+  if (m_registers == nullptr) {
+    uint32_t entry = 0;
+    for (const auto sparse_entry : m_sparse) {
+      if ((sparse_entry >> constants::k_sparse_rank_bits) == index) {
+        entry = std::max(entry, sparse_entry);
+      }
+    }
+    return static_cast<uint8_t>(entry & k_sparse_rank_mask);
+  }
+
+  return llb::register_at(dense_registers(), index);
+}
+
+llb::DenseRegisters llb::LogLogBeta::dense_registers() const {
+  return {m_layout,
+          m_register_count,
+          m_registers,
+          m_base,
+          reinterpret_cast<const uint8_t *>(m_overflow.data()),
+          m_overflow.size()};
+}
+
+void llb::LogLogBeta::raise_register(uint64_t index, uint8_t rank) {
+  switch (m_layout) {
+  case RegisterLayout::packed6: {
+    const auto current = kernels::packed6_get(m_registers, index);
+    if (current < rank) {
+      kernels::packed6_set(m_registers, index, rank);
+      register_raised(index, current, rank);
+    }
+    break;
+  }
+  case RegisterLayout::packed4:
+    raise_packed4(index, rank);
+    break;
+  default:
+    if (m_registers[index] < rank) {
+      register_raised(index, m_registers[index], rank);
+      m_registers[index] = rank;
+    }
+    break;
+  }
+}
+
+void llb::LogLogBeta::register_raised(uint64_t index, uint8_t from,
+                                      uint8_t to) {
+  if (m_tracking) {
+    mark_changed(index);
+  }
+  if (!m_incremental) {
+    return;
+  }
+  // both terms are powers of two, so this is exact until the sum runs out
+  // of mantissa for ranks far past anything seen in practice
+  m_sum += inverse_power(to) - inverse_power(from);
+  m_zero_count -= from == 0 ? 1 : 0;
+}
+
+void llb::LogLogBeta::sync_estimate(const kernels::KernelTable &kernel_table,
+                                    ThreadPool *pool) {
+  if (m_incremental && m_registers != nullptr) {
+    llb::sum_registers(kernel_table, dense_registers(), &m_sum, &m_zero_count,
+                       pool);
+  }
+}
+
+void llb::LogLogBeta::set_incremental_estimate(bool enabled) {
+  m_incremental = enabled;
+  sync_estimate(kernels::active());
+}
+
+void llb::LogLogBeta::set_change_tracking(bool enabled) {
+  m_tracking = enabled;
+  m_changed.assign(enabled ? m_register_count / 64 : 0UL, 0UL);
+}
+
+void llb::LogLogBeta::mark_all_changed() {
+  std::fill(m_changed.begin(), m_changed.end(), ~0UL);
+}
+
+uint64_t llb::LogLogBeta::changed_register_count() const {
+  auto count = 0UL;
+  for (const auto word : m_changed) {
+    count += static_cast<uint64_t>(__builtin_popcountll(word));
+  }
+  return count;
+}
+
+void llb::LogLogBeta::raise_packed4(uint64_t index, uint8_t rank) {
+  if (rank <= m_base) {
+    return;
+  }
+
+  const auto offset = (m_registers[index / 2] >> (index % 2 * 4)) & 0x0F;
+  const auto entry =
+      static_cast<uint32_t>(index << constants::k_sparse_rank_bits) | rank;
+  if (offset == kernels::k_packed4_overflow) {
+    auto it = std::lower_bound(
+        m_overflow.begin(), m_overflow.end(),
+        static_cast<uint32_t>(index << constants::k_sparse_rank_bits));
+    if (*it < entry) {
+      register_raised(index, static_cast<uint8_t>(*it & k_sparse_rank_mask),
+                      rank);
+      *it = entry;
+    }
+    return;
+  }
+
+  if (rank - m_base <= offset) {
+    return;
+  }
+  register_raised(index, static_cast<uint8_t>(m_base + offset), rank);
+
+  if (rank - m_base >= kernels::k_packed4_overflow) {
+    m_overflow.insert(
+        std::lower_bound(m_overflow.begin(), m_overflow.end(), entry), entry);
+    set_packed4_offset(index, kernels::k_packed4_overflow);
+  } else {
+    set_packed4_offset(index, static_cast<uint8_t>(rank - m_base));
+  }
+
+  if (offset == 0 && --m_zero_offsets == 0) {
+    rebase_packed4(kernels::active());
+  }
+}
+
+void llb::LogLogBeta::set_packed4_offset(uint64_t index, uint8_t offset) {
+  const auto shift = index % 2 * 4;
+  auto &packed = m_registers[index / 2];
+  packed =
+      static_cast<uint8_t>((packed & ~(0x0F << shift)) | (offset << shift));
+}
+
+void llb::LogLogBeta::rebase_packed4(const kernels::KernelTable &kernel_table) {
+  // every register is above the base, so move the base up and lower every
+  // offset until some register sits at the base again
+  while (m_zero_offsets == 0) {
+    m_base += 1;
+    m_zero_offsets = static_cast<uint32_t>(kernel_table.merge_packed4(
+        m_registers, m_registers, m_register_count, 1, 1));
+
+    auto out = m_overflow.begin();
+    for (const auto entry : m_overflow) {
+      const auto offset = (entry & k_sparse_rank_mask) - m_base;
+      if (offset < kernels::k_packed4_overflow) {
+        set_packed4_offset(entry >> constants::k_sparse_rank_bits,
+                           static_cast<uint8_t>(offset));
+      } else {
+        *out++ = entry;
+      }
+    }
+    m_overflow.erase(out, m_overflow.end());
+  }
+}
+
+void llb::LogLogBeta::sum_registers_nonavx(double *sum,
+                                           uint64_t *zero_count) const {
+  sum_registers(kernels::k_scalar, sum, zero_count);
+}
+
+void llb::LogLogBeta::sum_registers(double *sum, uint64_t *zero_count) const {
+  sum_registers(kernels::active(), sum, zero_count);
+}
+
+void llb::LogLogBeta::sum_registers(const kernels::KernelTable &kernel_table,
+                                    double *sum_arg, uint64_t *zero_count_arg,
+                                    ThreadPool *pool) const {
+  if (m_registers != nullptr) {
+    stats::kernel_run(kernel_table.instruction_set);
+    llb::sum_registers(kernel_table, dense_registers(), sum_arg,
+                       zero_count_arg, pool);
+    return;
+  }
+
+  std::vector<uint32_t> unsorted;
+  const auto *entries = &m_sparse;
+  if (m_sparse_sorted != m_sparse.size()) {
+    unsorted = m_sparse;
+    compact_entries(&unsorted, m_sparse_sorted);
+    entries = &unsorted;
+  }
+
+  // every register without an entry is zero and adds 2^-0 to the sum
+  const auto zero_count = m_register_count - entries->size();
+  double sum = static_cast<double>(zero_count);
+  for (const auto entry : *entries) {
+    sum += 1.0 / (1UL << (entry & k_sparse_rank_mask));
+  }
+
+  *sum_arg = sum;
   *zero_count_arg = zero_count;
 }
-#endif
 
 double llb::LogLogBeta::beta(uint64_t zero_count) {
+  // Horner's rule over the coefficients of ln(z + 1)^1 to ^7, a multiply and
+  // add per term instead of a pow each
+  constexpr double k_coefficients[] = {0.070471823, 0.17393686, 0.16339839,
+                                       -0.09237745, 0.03738027, -0.005384159,
+                                       0.00042419};
   const auto leading_zero_count = std::log(zero_count + 1);
-  return -0.370393911 * zero_count + 0.070471823 * leading_zero_count +
-         0.17393686 * std::pow(leading_zero_count, 2) +
-         0.16339839 * std::pow(leading_zero_count, 3) +
-         -0.09237745 * std::pow(leading_zero_count, 4) +
-         0.03738027 * std::pow(leading_zero_count, 5) +
-         -0.005384159 * std::pow(leading_zero_count, 6) +
-         0.00042419 * std::pow(leading_zero_count, 7);
+  auto polynomial = 0.0;
+  for (auto term_ix = 7; term_ix-- > 0;) {
+    polynomial = polynomial * leading_zero_count + k_coefficients[term_ix];
+  }
+  return -0.370393911 * zero_count + polynomial * leading_zero_count;
+}
+
+uint64_t llb::LogLogBeta::estimate(uint64_t register_count, double sum,
+                                   uint64_t zero_count) {
+  const auto alpha = constants::k_alpha1 /
+                     (1.0 + constants::k_alpha2 /
+                                static_cast<double>(register_count));
+  return static_cast<uint64_t>(
+      (alpha * register_count * (register_count - zero_count)) /
+      (beta(zero_count) + sum));
+}
+
+uint64_t llb::LogLogBeta::ertl_estimate(uint64_t register_count,
+                                        uint32_t precision_bits,
+                                        const uint64_t *histogram) {
+  // registers at the highest rank had every bit after the index zero
+  const auto count = static_cast<double>(register_count);
+  const auto highest_rank = 64U - precision_bits + 1;
+  auto z = count * ertl_tau(1.0 - histogram[highest_rank] / count);
+  for (auto rank = highest_rank - 1; rank >= 1; rank -= 1) {
+    z = 0.5 * (z + static_cast<double>(histogram[rank]));
+  }
+  z += count * ertl_sigma(static_cast<double>(histogram[0]) / count);
+  return static_cast<uint64_t>(
+      std::llround(count * count / (2.0 * std::log(2.0) * z)));
+}
+
+void llb::LogLogBeta::sum_byte_registers(const uint8_t *registers,
+                                         uint64_t register_count, double *sum,
+                                         uint64_t *zero_count) {
+  kernels::active().sum_registers(registers, register_count, sum,
+                                  zero_count);
 }
 
 uint64_t llb::LogLogBeta::cardinality_nonavx() const {
   double sum = 0.0;
   uint64_t zero_count = 0;
   sum_registers_nonavx(&sum, &zero_count);
-  return static_cast<uint64_t>(
-      (m_alpha * m_register_count * (m_register_count - zero_count)) /
-      (beta(zero_count) + sum));
+  return estimate(m_register_count, sum, zero_count);
 }
 
-#ifdef __AVX512F__
 uint64_t llb::LogLogBeta::cardinality() const {
+  const stats::Timer timer{stats::cardinalities};
+  if (m_incremental && m_registers != nullptr) {
+    return estimate(m_register_count, m_sum, m_zero_count);
+  }
+
   double sum = 0.0;
   uint64_t zero_count = 0;
   sum_registers(&sum, &zero_count);
-  return static_cast<uint64_t>(
-      (m_alpha * m_register_count * (m_register_count - zero_count)) /
-      (beta(zero_count) + sum));
+  return estimate(m_register_count, sum, zero_count);
+}
+
+uint64_t llb::LogLogBeta::cardinality(Estimator estimator) const {
+  // the register sum is cheaper to take than the histogram
+  if (estimator == Estimator::loglog_beta) {
+    return cardinality();
+  }
+
+  const stats::Timer timer{stats::cardinalities};
+  uint64_t histogram[constants::k_rank_histogram_size] = {};
+  rank_histogram(kernels::active(), histogram);
+  return ertl_estimate(m_register_count, m_precision_bits, histogram);
+}
+
+void llb::LogLogBeta::cardinality_batch(const LogLogBeta *const *sketches,
+                                        uint64_t count,
+                                        uint64_t *cardinalities) {
+  const auto &kernel_table = kernels::active();
+  double sums[constants::k_batch_size];
+  uint64_t zero_counts[constants::k_batch_size];
+  for (auto batch_ix = 0UL; batch_ix < count;
+       batch_ix += constants::k_batch_size) {
+    const auto batch_count =
+        std::min<uint64_t>(count - batch_ix, constants::k_batch_size);
+    for (auto ix = batch_ix; ix < batch_ix + batch_count; ix += 1) {
+      // the sketch after next, so its register pointer is in cache by the
+      // time the next one's registers are fetched
+      if (ix + 2 < count) {
+        __builtin_prefetch(sketches[ix + 2]);
+      }
+      if (ix + 1 < count && sketches[ix + 1]->m_registers != nullptr) {
+        const auto *next = sketches[ix + 1]->m_registers;
+        const auto bytes = std::min(k_batch_prefetch_bytes,
+                                    sketches[ix + 1]->register_bytes());
+        for (auto line_ix = 0UL; line_ix < bytes; line_ix += 64) {
+          __builtin_prefetch(&next[line_ix]);
+        }
+      }
+
+      const auto &sketch = *sketches[ix];
+      if (sketch.m_incremental && sketch.m_registers != nullptr) {
+        sums[ix - batch_ix] = sketch.m_sum;
+        zero_counts[ix - batch_ix] = sketch.m_zero_count;
+      } else {
+        sketch.sum_registers(kernel_table, &sums[ix - batch_ix],
+                             &zero_counts[ix - batch_ix]);
+      }
+    }
+
+    // the estimates of a batch together, a loop of independent logs and
+    // polynomials the compiler can pipeline
+    for (auto ix = 0UL; ix < batch_count; ix += 1) {
+      cardinalities[batch_ix + ix] =
+          estimate(sketches[batch_ix + ix]->m_register_count, sums[ix],
+                   zero_counts[ix]);
+    }
+  }
+}
+
+void llb::LogLogBeta::rank_histogram(uint64_t *histogram) const {
+  std::fill_n(histogram, constants::k_rank_histogram_size, 0UL);
+  rank_histogram(kernels::active(), histogram);
+}
+
+void llb::LogLogBeta::rank_histogram(const kernels::KernelTable &kernel_table,
+                                     uint64_t *histogram,
+                                     ThreadPool *pool) const {
+  if (m_registers != nullptr) {
+    histogram_registers(kernel_table, dense_registers(), histogram, pool);
+    return;
+  }
+
+  std::vector<uint32_t> unsorted;
+  const auto *entries = &m_sparse;
+  if (m_sparse_sorted != m_sparse.size()) {
+    unsorted = m_sparse;
+    compact_entries(&unsorted, m_sparse_sorted);
+    entries = &unsorted;
+  }
+
+  histogram[0] += m_register_count - entries->size();
+  for (const auto entry : *entries) {
+    histogram[entry & k_sparse_rank_mask] += 1;
+  }
+}
+
+uint64_t llb::LogLogBeta::cardinality(ThreadPool &pool) const {
+  const stats::Timer timer{stats::cardinalities};
+  if (m_incremental && m_registers != nullptr) {
+    return estimate(m_register_count, m_sum, m_zero_count);
+  }
+
+  double sum = 0.0;
+  uint64_t zero_count = 0;
+  sum_registers(kernels::active(), &sum, &zero_count, &pool);
+  return estimate(m_register_count, sum, zero_count);
 }
-#endif
 
 void llb::LogLogBeta::merge_nonavx(const LogLogBeta &merge_me) {
+  merge(merge_me, kernels::k_scalar);
+}
+
+bool llb::LogLogBeta::merge(const LogLogBeta &merge_me) {
+  if (merge_me.m_hasher != m_hasher) {
+    return false;
+  }
+  merge(merge_me, kernels::active());
+  return true;
+}
+
+bool llb::LogLogBeta::merge(const LogLogBeta &merge_me, ThreadPool &pool) {
+  if (merge_me.m_hasher != m_hasher) {
+    return false;
+  }
+  merge(merge_me, kernels::active(), &pool);
+  return true;
+}
+
+void llb::LogLogBeta::merge(const LogLogBeta &merge_me,
+                            const kernels::KernelTable &kernel_table,
+                            ThreadPool *pool) {
+  const stats::Timer timer{stats::merges};
+  if (merge_me.m_precision_bits < m_precision_bits) {
+    fold_to(merge_me.m_precision_bits);
+  }
+  const auto shift = merge_me.m_precision_bits - m_precision_bits;
+
+  if (merge_me.m_registers == nullptr) {
+    if (m_registers == nullptr && shift == 0 && !m_tracking) {
+      m_sparse.insert(m_sparse.end(), merge_me.m_sparse.begin(),
+                      merge_me.m_sparse.end());
+      compact_sparse();
+      return;
+    }
+
+    for (const auto entry : merge_me.m_sparse) {
+      add_entry(fold_entry(entry, shift));
+    }
+    return;
+  }
+
+  merge_dense(merge_me.dense_registers(), kernel_table, pool);
+}
+
+void llb::LogLogBeta::merge_dense(const DenseRegisters &merge_me,
+                                  const kernels::KernelTable &kernel_table,
+                                  ThreadPool *pool) {
+  const auto merge_me_precision =
+      static_cast<uint32_t>(__builtin_ctzll(merge_me.register_count));
+  if (merge_me_precision < m_precision_bits) {
+    fold_to(merge_me_precision);
+  }
+  if (m_registers == nullptr) {
+    to_dense();
+  }
+
+  // the kernels don't report which registers they raise
+  if (m_tracking) {
+    const auto shift = merge_me_precision - m_precision_bits;
+    for (auto register_ix = 0UL; register_ix < m_register_count;
+         register_ix += 1) {
+      raise_register(register_ix,
+                     folded_register_at(merge_me, register_ix, shift));
+    }
+    return;
+  }
+
+  if (merge_me_precision > m_precision_bits) {
+    merge_folded(merge_me, merge_me_precision - m_precision_bits,
+                 kernel_table);
+    sync_estimate(kernel_table, pool);
+    return;
+  }
+
+  if (m_layout != merge_me.layout) {
+    for (auto register_ix = 0UL; register_ix < m_register_count;
+         register_ix += 1) {
+      raise_register(register_ix, llb::register_at(merge_me, register_ix));
+    }
+    return;
+  }
+
+  stats::kernel_run(kernel_table.instruction_set);
+  if (m_layout == RegisterLayout::packed4) {
+    merge_packed4(merge_me, kernel_table);
+  } else {
+    const auto merge = m_layout == RegisterLayout::packed6
+                           ? kernel_table.merge_packed6
+                           : kernel_table.merge_registers;
+    run_chunks(pool, chunk_count(pool, m_register_count), m_register_count,
+               [&](uint64_t, uint64_t first_register, uint64_t register_count) {
+                 const auto offset =
+                     llb::register_bytes(m_layout, first_register);
+                 merge(&m_registers[offset], &merge_me.registers[offset],
+                       register_count);
+               });
+  }
+
+  // the kernels don't report which registers they raised, and summing the
+  // merged registers costs about as much as the merge itself
+  sync_estimate(kernel_table, pool);
+}
+
+void llb::LogLogBeta::merge_folded(const DenseRegisters &merge_me,
+                                   uint32_t shift,
+                                   const kernels::KernelTable &kernel_table) {
+  stats::kernel_run(kernel_table.instruction_set);
+  if (m_layout == RegisterLayout::byte &&
+      merge_me.layout == RegisterLayout::byte) {
+    kernel_table.fold_registers(m_registers, merge_me.registers,
+                                m_register_count, shift);
+    return;
+  }
+
   for (auto register_ix = 0UL; register_ix < m_register_count;
        register_ix += 1) {
-    m_registers[register_ix] =
-        m_registers[register_ix] < merge_me.m_registers[register_ix]
-            ? merge_me.m_registers[register_ix]
-            : m_registers[register_ix];
+    raise_register(register_ix,
+                   folded_register_at(merge_me, register_ix, shift));
   }
 }
 
-#ifdef __AVX512F__
-void llb::LogLogBeta::merge(const LogLogBeta &merge_me) {
-  for (auto register_ix = 0UL; register_ix < m_register_count;
-       register_ix += 64) {
-    const auto this_registers =
-        *(reinterpret_cast<const __m512i *>(&m_registers[register_ix]));
-    const auto merge_me_registers = *(
-        reinterpret_cast<const __m512i *>(&merge_me.m_registers[register_ix]));
+const uint8_t *llb::LogLogBeta::byte_registers(const LogLogBeta &sketch,
+                                               uint32_t precision_bits,
+                                               LogLogBeta *scratch) {
+  if (sketch.m_registers != nullptr &&
+      sketch.m_layout == RegisterLayout::byte &&
+      sketch.m_precision_bits == precision_bits) {
+    return sketch.m_registers;
+  }
+
+  // merging folds sketch down to the scratch sketch's precision
+  scratch->reset(precision_bits, RegisterLayout::byte);
+  scratch->to_dense();
+  scratch->merge(sketch, kernels::active());
+  return scratch->m_registers;
+}
+
+void llb::LogLogBeta::joint_cardinality(const LogLogBeta &a,
+                                        const LogLogBeta &b,
+                                        JointEstimator estimator,
+                                        double *cardinalities) {
+  if (a.m_hasher != b.m_hasher) {
+    std::fill_n(cardinalities, 3, 0.0);
+    return;
+  }
 
-    const auto mask =
-        _mm512_cmp_epi8_mask(this_registers, merge_me_registers, _MM_CMPINT_LT);
-    *(reinterpret_cast<__m512i *>(&m_registers[register_ix])) =
-        _mm512_mask_blend_epi8(mask, this_registers, merge_me_registers);
+  const auto precision_bits = std::min(a.m_precision_bits, b.m_precision_bits);
+  LogLogBeta a_scratch{constants::k_default_error_rate,
+                       Representation::sparse};
+  LogLogBeta b_scratch{constants::k_default_error_rate,
+                       Representation::sparse};
+  const auto *a_registers = byte_registers(a, precision_bits, &a_scratch);
+  const auto *b_registers = byte_registers(b, precision_bits, &b_scratch);
+  const auto register_count = 1UL << precision_bits;
+
+  // |A|, |B| and |A u B| from one pass over both
+  double sums[3];
+  uint64_t zero_counts[3];
+  kernels::active().sum_joint(a_registers, b_registers, register_count, sums,
+                              zero_counts);
+  double estimates[3];
+  for (auto side = 0; side < 3; side += 1) {
+    estimates[side] = static_cast<double>(
+        estimate(register_count, sums[side], zero_counts[side]));
+  }
+  cardinalities[0] = std::max(estimates[2] - estimates[1], 0.0);
+  cardinalities[1] = std::max(estimates[2] - estimates[0], 0.0);
+  cardinalities[2] =
+      std::max(estimates[0] + estimates[1] - estimates[2], 0.0);
+
+  if (estimator == JointEstimator::maximum_likelihood) {
+    joint::Histograms histograms;
+    joint::histograms(a_registers, b_registers, register_count, &histograms);
+    joint::maximum_likelihood(histograms, register_count, precision_bits,
+                              cardinalities);
   }
 }
-#endif
+
+uint64_t llb::LogLogBeta::intersection_cardinality(const LogLogBeta &a,
+                                                   const LogLogBeta &b,
+                                                   JointEstimator estimator) {
+  double cardinalities[3];
+  joint_cardinality(a, b, estimator, cardinalities);
+  return static_cast<uint64_t>(std::llround(cardinalities[2]));
+}
+
+uint64_t llb::LogLogBeta::difference_cardinality(const LogLogBeta &a,
+                                                 const LogLogBeta &b,
+                                                 JointEstimator estimator) {
+  double cardinalities[3];
+  joint_cardinality(a, b, estimator, cardinalities);
+  return static_cast<uint64_t>(std::llround(cardinalities[0]));
+}
+
+bool llb::LogLogBeta::fold_to(uint32_t precision_bits) {
+  if (precision_bits > m_precision_bits ||
+      precision_bits < constants::k_minimum_precision) {
+    return false;
+  }
+  if (precision_bits == m_precision_bits) {
+    return true;
+  }
+  const auto shift = m_precision_bits - precision_bits;
+
+  if (m_registers == nullptr) {
+    auto entries = std::move(m_sparse);
+    reset(precision_bits, m_layout);
+    for (auto &entry : entries) {
+      entry = fold_entry(entry, shift);
+    }
+    m_sparse = std::move(entries);
+    compact_sparse();
+    mark_all_changed();
+    return true;
+  }
+
+  // fold the current registers into new ones of the lower precision
+  auto *registers = m_registers;
+  const auto bytes = allocation_bytes();
+  const auto overflow = std::move(m_overflow);
+  const DenseRegisters dense{m_layout,
+                             m_register_count,
+                             registers,
+                             m_base,
+                             reinterpret_cast<const uint8_t *>(overflow.data()),
+                             overflow.size()};
+  m_registers = nullptr;
+  reset(precision_bits, m_layout);
+  to_dense();
+  merge_dense(dense, kernels::active());
+  release_registers(registers, bytes);
+  mark_all_changed();
+  return true;
+}
+
+void llb::LogLogBeta::merge_packed4(const DenseRegisters &merge_me,
+                                    const kernels::KernelTable &kernel_table) {
+  const auto base = std::max(m_base, merge_me.base);
+
+  // the exact ranks of registers overflowed on either side, read before the
+  // kernel replaces them with overflow markers
+  std::vector<uint32_t> overflowed;
+  overflowed.reserve(m_overflow.size() + merge_me.overflow_count);
+  for (const auto entry : m_overflow) {
+    const auto index = entry >> constants::k_sparse_rank_bits;
+    overflowed.push_back(std::max(
+        entry, static_cast<uint32_t>(index << constants::k_sparse_rank_bits) |
+                   llb::register_at(merge_me, index)));
+  }
+  for (auto entry_ix = 0UL; entry_ix < merge_me.overflow_count;
+       entry_ix += 1) {
+    const auto entry = overflow_entry(merge_me, entry_ix);
+    const auto index = entry >> constants::k_sparse_rank_bits;
+    overflowed.push_back(std::max(
+        entry, static_cast<uint32_t>(index << constants::k_sparse_rank_bits) |
+                   register_at(index)));
+  }
+
+  m_zero_offsets = static_cast<uint32_t>(kernel_table.merge_packed4(
+      m_registers, merge_me.registers, m_register_count,
+      static_cast<uint8_t>(base - m_base),
+      static_cast<uint8_t>(base - merge_me.base)));
+  m_base = base;
+
+  compact_entries(&overflowed, 0);
+  m_overflow.clear();
+  for (const auto entry : overflowed) {
+    const auto offset = (entry & k_sparse_rank_mask) - m_base;
+    if (offset >= kernels::k_packed4_overflow) {
+      m_overflow.push_back(entry);
+    } else {
+      set_packed4_offset(entry >> constants::k_sparse_rank_bits,
+                         static_cast<uint8_t>(offset));
+      m_zero_offsets += offset == 0 ? 1 : 0;
+    }
+  }
+
+  if (m_zero_offsets == 0) {
+    rebase_packed4(kernel_table);
+  }
+}
+
+void llb::LogLogBeta::merge_byte_registers(uint8_t *registers,
+                                           const uint8_t *merge_me,
+                                           uint64_t register_count) {
+  kernels::active().merge_registers(registers, merge_me, register_count);
+}
+
+void llb::LogLogBeta::merge_byte_registers(const uint8_t *registers,
+                                           uint32_t precision_bits) {
+  merge_dense({RegisterLayout::byte, 1UL << precision_bits, registers, 0U,
+               nullptr, 0UL},
+              kernels::active());
+}
+
+bool llb::LogLogBeta::merge(const LogLogBetaView &merge_me) {
+  if (!merge_me.valid() || merge_me.hasher() != m_hasher ||
+      (merge_me.m_entries && !valid_entries(merge_me))) {
+    return false;
+  }
+  const stats::Timer timer{stats::merges};
+  if (merge_me.precision_bits() < m_precision_bits) {
+    fold_to(merge_me.precision_bits());
+  }
+
+  if (!merge_me.m_entries) {
+    merge_dense(merge_me.dense_registers(), kernels::active());
+    return true;
+  }
+
+  serialization::EntryReader reader{merge_me.m_payload,
+                                    merge_me.m_payload_bytes};
+  const auto shift = merge_me.precision_bits() - m_precision_bits;
+  uint32_t entry;
+  if (m_registers != nullptr && m_layout == RegisterLayout::byte &&
+      !m_incremental && !m_tracking) {
+    // a scatter-max straight into the registers, like serialize_changes()
+    // deltas are applied on replicas
+    while (reader.next(&entry)) {
+      entry = fold_entry(entry, shift);
+      auto &reg = m_registers[entry >> constants::k_sparse_rank_bits];
+      reg = std::max(reg, static_cast<uint8_t>(entry & k_sparse_rank_mask));
+    }
+    return true;
+  }
+
+  while (reader.next(&entry)) {
+    add_entry(fold_entry(entry, shift));
+  }
+  return true;
+}
+
+bool llb::LogLogBeta::valid_entries(const LogLogBetaView &view) {
+  serialization::EntryReader reader{view.m_payload, view.m_payload_bytes};
+  uint32_t entry;
+  while (reader.next(&entry)) {
+    if ((entry >> constants::k_sparse_rank_bits) >= view.register_count()) {
+      return false;
+    }
+  }
+  return reader.done();
+}
+
+bool llb::LogLogBeta::same_hasher(const LogLogBeta &first,
+                                  const LogLogBeta *const *sketches,
+                                  uint64_t count) {
+  return std::all_of(sketches, sketches + count,
+                     [&](const LogLogBeta *sketch) {
+                       return sketch->m_hasher == first.m_hasher;
+                     });
+}
+
+bool llb::LogLogBeta::merge_all(const LogLogBeta *const *sketches,
+                                uint64_t count) {
+  return merge_all(sketches, count, nullptr);
+}
+
+bool llb::LogLogBeta::merge_all(const LogLogBeta *const *sketches,
+                                uint64_t count, ThreadPool &pool) {
+  return merge_all(sketches, count, &pool);
+}
+
+bool llb::LogLogBeta::merge_all(const LogLogBeta *const *sketches,
+                                uint64_t count, ThreadPool *pool) {
+  if (!same_hasher(*this, sketches, count)) {
+    return false;
+  }
+
+  const auto &kernel_table = kernels::active();
+  for (auto sketch_ix = 0UL; sketch_ix < count; sketch_ix += 1) {
+    fold_to(std::min(m_precision_bits, sketches[sketch_ix]->m_precision_bits));
+  }
+
+  // packed4 merges move bases and overflow lists, and sparse or other layout
+  // sketches have no registers to tile, so those are merged one by one
+  std::vector<const uint8_t *> tiled;
+  for (auto sketch_ix = 0UL; sketch_ix < count; sketch_ix += 1) {
+    const auto &sketch = *sketches[sketch_ix];
+    if (sketch.m_registers != nullptr && sketch.m_layout == m_layout &&
+        sketch.m_register_count == m_register_count &&
+        m_layout != RegisterLayout::packed4 && !m_tracking) {
+      tiled.push_back(sketch.m_registers);
+    } else {
+      merge(sketch, kernel_table, pool);
+    }
+  }
+  if (tiled.empty()) {
+    return true;
+  }
+
+  if (m_registers == nullptr) {
+    to_dense();
+  }
+  run_chunks(pool, chunk_count(pool, m_register_count), m_register_count,
+             [&](uint64_t, uint64_t first_register, uint64_t register_count) {
+               const auto offset =
+                   llb::register_bytes(m_layout, first_register);
+               merge_tiles(kernel_table, m_layout, &m_registers[offset],
+                           register_count, tiled.data(), tiled.size(),
+                           offset);
+             });
+  sync_estimate(kernel_table, pool);
+  return true;
+}
+
+uint64_t llb::LogLogBeta::union_cardinality(const LogLogBeta *const *sketches,
+                                            uint64_t count) {
+  return union_cardinality(sketches, count, nullptr);
+}
+
+uint64_t llb::LogLogBeta::union_cardinality(const LogLogBeta *const *sketches,
+                                            uint64_t count, ThreadPool &pool) {
+  return union_cardinality(sketches, count, &pool);
+}
+
+uint64_t llb::LogLogBeta::union_cardinality(const LogLogBeta *const *sketches,
+                                            uint64_t count, ThreadPool *pool) {
+  if (count == 0 || !same_hasher(*sketches[0], sketches, count)) {
+    return 0UL;
+  }
+
+  const auto &first = *sketches[0];
+  const auto tiled =
+      first.m_layout != RegisterLayout::packed4 &&
+      std::all_of(sketches, sketches + count, [&](const LogLogBeta *sketch) {
+        return sketch->m_registers != nullptr &&
+               sketch->m_layout == first.m_layout &&
+               sketch->m_register_count == first.m_register_count;
+      });
+  if (!tiled) {
+    LogLogBeta merged{constants::k_default_error_rate,
+                      Representation::sparse, first.m_layout, first.m_hasher};
+    merged.reset(first.m_precision_bits, first.m_layout);
+    merged.merge_all(sketches, count, pool);
+    double sum = 0.0;
+    uint64_t zero_count = 0;
+    merged.sum_registers(kernels::active(), &sum, &zero_count, pool);
+    return estimate(merged.m_register_count, sum, zero_count);
+  }
+
+  // merges each tile into a scratch tile and sums it, instead of merging
+  // everything into a full register array first
+  const auto &kernel_table = kernels::active();
+  const auto sum_tile = first.m_layout == RegisterLayout::packed6
+                            ? kernel_table.sum_packed6
+                            : kernel_table.sum_registers;
+  const auto tile_registers = std::min<uint64_t>(
+      constants::k_merge_tile_registers, first.m_register_count);
+  const auto tile_bytes = llb::register_bytes(first.m_layout, tile_registers);
+  std::vector<const uint8_t *> inputs(count);
+  for (auto sketch_ix = 0UL; sketch_ix < count; sketch_ix += 1) {
+    inputs[sketch_ix] = sketches[sketch_ix]->m_registers;
+  }
+
+  const auto chunks = chunk_count(pool, first.m_register_count);
+  std::vector<double> sums(chunks);
+  std::vector<uint64_t> zero_counts(chunks);
+  run_chunks(pool, chunks, first.m_register_count,
+             [&](uint64_t chunk_ix, uint64_t first_register,
+                 uint64_t register_count) {
+               alignas(64) uint8_t tile[constants::k_merge_tile_registers +
+                                        kernels::k_register_padding];
+               const auto begin =
+                   llb::register_bytes(first.m_layout, first_register);
+               const auto end =
+                   begin + llb::register_bytes(first.m_layout, register_count);
+               for (auto tile_ix = begin; tile_ix < end;
+                    tile_ix += tile_bytes) {
+                 std::memcpy(tile, &inputs[0][tile_ix], tile_bytes);
+                 merge_tiles(kernel_table, first.m_layout, tile,
+                             tile_registers, &inputs[1], count - 1, tile_ix);
+
+                 double tile_sum = 0.0;
+                 uint64_t tile_zero_count = 0;
+                 sum_tile(tile, tile_registers, &tile_sum, &tile_zero_count);
+                 sums[chunk_ix] += tile_sum;
+                 zero_counts[chunk_ix] += tile_zero_count;
+               }
+             });
+
+  double sum = 0.0;
+  uint64_t zero_count = 0;
+  for (auto chunk_ix = 0UL; chunk_ix < chunks; chunk_ix += 1) {
+    sum += sums[chunk_ix];
+    zero_count += zero_counts[chunk_ix];
+  }
+  return estimate(first.m_register_count, sum, zero_count);
+}
+
+llb::serialization::Header llb::LogLogBeta::serialization_header() const {
+  serialization::Header header{};
+  header.magic = serialization::k_magic;
+  header.version = serialization::k_version;
+  header.precision_bits = static_cast<uint8_t>(m_precision_bits);
+  header.layout = static_cast<uint8_t>(m_layout);
+  header.hash_function = static_cast<uint8_t>(m_hasher.function());
+  header.hash_seed = m_hasher.seed();
+  return header;
+}
+
+std::vector<uint8_t> llb::LogLogBeta::serialize(bool compress) const {
+  auto header = serialization_header();
+  std::vector<uint8_t> out(sizeof(header));
+  std::vector<uint32_t> entries;
+  auto encoding = serialization::Encoding::entries;
+  if (m_registers == nullptr) {
+    entries = m_sparse;
+    compact_entries(&entries, m_sparse_sorted);
+    header.flags = serialization::k_flag_sparse;
+    serialization::write_entries(entries, &out);
+  } else {
+    const auto register_payload =
+        register_bytes() + m_overflow.size() * sizeof(uint32_t);
+    if (compress) {
+      for (auto register_ix = 0UL; register_ix < m_register_count;
+           register_ix += 1) {
+        const auto rank = register_at(register_ix);
+        if (rank != 0) {
+          entries.push_back(static_cast<uint32_t>(
+                                register_ix << constants::k_sparse_rank_bits) |
+                            rank);
+        }
+      }
+      serialization::write_entries(entries, &out);
+    }
+
+    if (!compress || out.size() - sizeof(header) >= register_payload) {
+      encoding = serialization::Encoding::registers;
+      entries.clear();
+      out.resize(sizeof(header));
+      out.insert(out.end(), m_registers, m_registers + register_bytes());
+      const auto *overflow =
+          reinterpret_cast<const uint8_t *>(m_overflow.data());
+      out.insert(out.end(), overflow,
+                 overflow + m_overflow.size() * sizeof(uint32_t));
+      header.base = m_base;
+      header.overflow_count = m_overflow.size();
+    }
+  }
+
+  header.encoding = static_cast<uint8_t>(encoding);
+  header.entry_count = entries.size();
+  header.payload_bytes = out.size() - sizeof(header);
+  header.checksum = serialization::checksum(header, &out[sizeof(header)]);
+  std::memcpy(out.data(), &header, sizeof(header));
+  return out;
+}
+
+std::vector<uint8_t> llb::LogLogBeta::serialize_changes() {
+  if (!m_tracking) {
+    return {};
+  }
+
+  std::vector<uint32_t> entries;
+  if (m_registers == nullptr) {
+    entries = m_sparse;
+    compact_entries(&entries, m_sparse_sorted);
+    entries.erase(std::remove_if(entries.begin(), entries.end(),
+                                 [&](uint32_t entry) {
+                                   return !changed(
+                                       entry >> constants::k_sparse_rank_bits);
+                                 }),
+                  entries.end());
+  } else {
+    // one word per 64 registers, so unchanged lines are skipped a word at a
+    // time
+    for (auto word_ix = 0UL; word_ix < m_changed.size(); word_ix += 1) {
+      for (auto word = m_changed[word_ix]; word != 0; word &= word - 1) {
+        const auto register_ix = word_ix * 64 + __builtin_ctzll(word);
+        const auto rank = register_at(register_ix);
+        if (rank != 0) {
+          entries.push_back(static_cast<uint32_t>(
+                                register_ix << constants::k_sparse_rank_bits) |
+                            rank);
+        }
+      }
+    }
+  }
+  std::fill(m_changed.begin(), m_changed.end(), 0UL);
+
+  auto header = serialization_header();
+  std::vector<uint8_t> out(sizeof(header));
+  serialization::write_entries(entries, &out);
+  header.flags = serialization::k_flag_sparse;
+  header.encoding = static_cast<uint8_t>(serialization::Encoding::entries);
+  header.entry_count = entries.size();
+  header.payload_bytes = out.size() - sizeof(header);
+  header.checksum = serialization::checksum(header, &out[sizeof(header)]);
+  std::memcpy(out.data(), &header, sizeof(header));
+  return out;
+}
+
+bool llb::LogLogBeta::deserialize(const uint8_t *buffer, uint64_t size) {
+  const LogLogBetaView view{buffer, size};
+  if (!view.verify_checksum() ||
+      (view.m_entries && !valid_entries(view))) {
+    return false;
+  }
+
+  reset(view.precision_bits(), view.layout());
+  m_hasher = view.hasher();
+  if (view.m_entries) {
+    serialization::EntryReader reader{view.m_payload, view.m_payload_bytes};
+    uint32_t entry;
+    while (reader.next(&entry)) {
+      m_sparse.push_back(entry);
+    }
+    m_sparse_sorted = static_cast<uint32_t>(m_sparse.size());
+    if (!view.is_sparse() ||
+        m_sparse.size() >
+            m_register_count / constants::k_sparse_promote_divisor) {
+      to_dense();
+    }
+    sync_estimate(kernels::active());
+    mark_all_changed();
+    return true;
+  }
+
+  to_dense();
+  const auto dense = view.dense_registers();
+  std::memcpy(m_registers, dense.registers, register_bytes());
+  if (m_layout == RegisterLayout::packed4) {
+    m_base = dense.base;
+    m_overflow.resize(dense.overflow_count);
+    if (dense.overflow_count != 0) {
+      std::memcpy(m_overflow.data(), dense.overflow,
+                  dense.overflow_count * sizeof(uint32_t));
+    }
+
+    double offset_sum = 0.0;
+    uint64_t zero_offsets = 0;
+    kernels::active().sum_packed4(m_registers, m_register_count, &offset_sum,
+                                  &zero_offsets);
+    m_zero_offsets = static_cast<uint32_t>(zero_offsets);
+  }
+  sync_estimate(kernels::active());
+  mark_all_changed();
+  return true;
+}
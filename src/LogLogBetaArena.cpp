@@ -0,0 +1,81 @@
+/**
+ * LogLogBetaArena.cpp
+ */
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+#include "LogLogBetaArena.h"
+
+namespace {
+uint64_t align_up(uint64_t bytes) {
+  return (bytes + llb::constants::k_arena_alignment - 1) &
+         ~(llb::constants::k_arena_alignment - 1);
+}
+} // namespace
+
+llb::LogLogBetaArena::LogLogBetaArena(uint64_t slab_bytes) noexcept
+    : m_slab_bytes{align_up(std::max<uint64_t>(slab_bytes, 1UL))},
+      m_slab_ix{0UL}, m_slab_offset{0UL}, m_reserved_bytes{0UL},
+      m_used_bytes{0UL} {}
+
+llb::LogLogBetaArena::~LogLogBetaArena() noexcept {
+  for (const auto &slab : m_slabs) {
+    free(slab.data);
+  }
+}
+
+uint8_t *llb::LogLogBetaArena::allocate(uint64_t bytes) {
+  bytes = align_up(bytes);
+  m_used_bytes += bytes;
+
+  for (auto &free_list : m_free_lists) {
+    if (free_list.bytes == bytes && free_list.head != nullptr) {
+      auto *block = free_list.head;
+      std::memcpy(&free_list.head, block, sizeof(uint8_t *));
+      return block;
+    }
+  }
+
+  // carve from the current slab, moving on to the next one that fits
+  while (m_slab_ix < m_slabs.size() &&
+         m_slabs[m_slab_ix].size - m_slab_offset < bytes) {
+    m_slab_ix += 1;
+    m_slab_offset = 0UL;
+  }
+  if (m_slab_ix == m_slabs.size()) {
+    const auto size = std::max(m_slab_bytes, bytes);
+    m_slabs.push_back({reinterpret_cast<uint8_t *>(std::aligned_alloc(
+                           constants::k_arena_alignment, size)),
+                       size});
+    m_reserved_bytes += size;
+    m_slab_offset = 0UL;
+  }
+
+  auto *block = m_slabs[m_slab_ix].data + m_slab_offset;
+  m_slab_offset += bytes;
+  return block;
+}
+
+void llb::LogLogBetaArena::deallocate(uint8_t *block, uint64_t bytes) {
+  bytes = align_up(bytes);
+  m_used_bytes -= bytes;
+
+  auto free_list =
+      std::find_if(m_free_lists.begin(), m_free_lists.end(),
+                   [&](const FreeList &list) { return list.bytes == bytes; });
+  if (free_list == m_free_lists.end()) {
+    m_free_lists.push_back({bytes, nullptr});
+    free_list = m_free_lists.end() - 1;
+  }
+  std::memcpy(block, &free_list->head, sizeof(uint8_t *));
+  free_list->head = block;
+}
+
+void llb::LogLogBetaArena::reset() {
+  m_slab_ix = 0UL;
+  m_slab_offset = 0UL;
+  m_free_lists.clear();
+  m_used_bytes = 0UL;
+}
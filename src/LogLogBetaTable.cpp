@@ -0,0 +1,275 @@
+/**
+ * LogLogBetaTable.cpp
+ */
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+#include "DenseRegisters.h"
+#include "Kernels.h"
+#include "LogLogBetaTable.h"
+
+namespace {
+constexpr uint32_t k_sparse_row = UINT32_MAX;
+constexpr uint32_t k_sparse_rank_mask =
+    (1U << llb::constants::k_sparse_rank_bits) - 1;
+// Slot bits a batch is grouped by per radix pass
+constexpr uint32_t k_radix_bits = 11U;
+
+// Groups (slot << 32 | entry) values by slot with a stable LSD radix sort over
+// the slot bits in use, the order within a slot doesn't matter
+void group_by_slot(std::vector<uint64_t> *batch, std::vector<uint64_t> *scratch,
+                   uint64_t slot_count) {
+  const auto slot_bits =
+      slot_count <= 1 ? 0U : 64U - __builtin_clzll(slot_count - 1);
+  uint32_t counts[1U << k_radix_bits];
+  scratch->resize(batch->size());
+  for (auto shift = 32U; shift < 32U + slot_bits; shift += k_radix_bits) {
+    std::fill(std::begin(counts), std::end(counts), 0U);
+    for (const auto value : *batch) {
+      counts[(value >> shift) & ((1U << k_radix_bits) - 1)] += 1;
+    }
+    auto offset = 0U;
+    for (auto &count : counts) {
+      const auto next = offset + count;
+      count = offset;
+      offset = next;
+    }
+    for (const auto value : *batch) {
+      (*scratch)[counts[(value >> shift) & ((1U << k_radix_bits) - 1)]++] =
+          value;
+    }
+    batch->swap(*scratch);
+  }
+}
+} // namespace
+
+llb::LogLogBetaTable::LogLogBetaTable(double error_rate,
+                                      Representation representation) noexcept
+    : m_precision_bits{LogLogBeta{error_rate, Representation::sparse}
+                           .precision_bits()},
+      m_register_count{1UL << m_precision_bits},
+      m_representation{representation}, m_registers{nullptr},
+      m_row_count{0U}, m_row_capacity{0U} {}
+
+llb::LogLogBetaTable::~LogLogBetaTable() noexcept { free(m_registers); }
+
+uint32_t llb::LogLogBetaTable::slot(uint64_t key) {
+  const auto it = m_slots.find(key);
+  if (it != m_slots.end()) {
+    return it->second;
+  }
+
+  const auto slot = static_cast<uint32_t>(m_keys.size());
+  m_slots.emplace(key, slot);
+  m_keys.push_back(key);
+  m_rows.push_back(k_sparse_row);
+  m_sparse.emplace_back();
+  m_sparse_sorted.push_back(0U);
+  if (m_representation == Representation::dense) {
+    to_dense(slot);
+  }
+  return slot;
+}
+
+void llb::LogLogBetaTable::to_dense(uint32_t slot) {
+  if (m_row_count == m_row_capacity) {
+    // rows are multiples of 256 bytes so every row stays 64 byte aligned
+    const auto capacity = std::max(m_row_capacity * 2, 1U);
+    // aligned_alloc() takes only multiples of the alignment
+    const auto alignment = constants::k_default_alignment;
+    const auto bytes =
+        capacity * m_register_count + kernels::k_register_padding;
+    auto *registers = reinterpret_cast<uint8_t *>(std::aligned_alloc(
+        alignment, (bytes + alignment - 1) / alignment * alignment));
+    if (m_registers != nullptr) {
+      std::memcpy(registers, m_registers, m_row_count * m_register_count);
+    }
+    free(m_registers);
+    m_registers = registers;
+    m_row_capacity = capacity;
+  }
+
+  m_rows[slot] = m_row_count;
+  m_row_count += 1;
+  auto *registers = row(slot);
+  std::memset(registers, 0, m_register_count);
+  for (const auto entry : m_sparse[slot]) {
+    const auto index = entry >> constants::k_sparse_rank_bits;
+    const auto rank = static_cast<uint8_t>(entry & k_sparse_rank_mask);
+    registers[index] = registers[index] < rank ? rank : registers[index];
+  }
+  std::vector<uint32_t>().swap(m_sparse[slot]);
+  m_sparse_sorted[slot] = 0U;
+}
+
+void llb::LogLogBetaTable::add_entries(uint32_t slot, const uint32_t *entries,
+                                       uint64_t count) {
+  if (m_rows[slot] != k_sparse_row) {
+    auto *registers = row(slot);
+    for (auto entry_ix = 0UL; entry_ix < count; entry_ix += 1) {
+      const auto index = entries[entry_ix] >> constants::k_sparse_rank_bits;
+      const auto rank =
+          static_cast<uint8_t>(entries[entry_ix] & k_sparse_rank_mask);
+      registers[index] = registers[index] < rank ? rank : registers[index];
+    }
+    return;
+  }
+
+  // buffered unsorted like a sparse LogLogBeta, so a key getting a few
+  // values per batch doesn't merge its whole list every batch
+  auto &sparse = m_sparse[slot];
+  sparse.insert(sparse.end(), entries, entries + count);
+  if (sparse.size() - m_sparse_sorted[slot] < constants::k_sparse_buffer_size) {
+    return;
+  }
+
+  compact_entries(&sparse, m_sparse_sorted[slot]);
+  m_sparse_sorted[slot] = static_cast<uint32_t>(sparse.size());
+  if (sparse.size() > m_register_count / constants::k_sparse_promote_divisor) {
+    to_dense(slot);
+  }
+}
+
+std::vector<uint32_t>
+llb::LogLogBetaTable::sorted_entries(uint32_t slot) const {
+  auto entries = m_sparse[slot];
+  compact_entries(&entries, m_sparse_sorted[slot]);
+  return entries;
+}
+
+void llb::LogLogBetaTable::add_hashes(const uint64_t *keys,
+                                      const uint64_t *hashes, uint64_t count) {
+  const auto &kernel_table = kernels::active();
+  uint32_t indices[constants::k_batch_size];
+  uint8_t ranks[constants::k_batch_size];
+
+  for (auto batch_ix = 0UL; batch_ix < count;
+       batch_ix += constants::k_table_batch_size) {
+    const auto batch_count =
+        std::min<uint64_t>(count - batch_ix, constants::k_table_batch_size);
+    m_batch.resize(batch_count);
+    for (auto hash_ix = 0UL; hash_ix < batch_count;
+         hash_ix += constants::k_batch_size) {
+      const auto index_count =
+          std::min<uint64_t>(batch_count - hash_ix, constants::k_batch_size);
+      kernel_table.index_ranks(&hashes[batch_ix + hash_ix], index_count,
+                               m_precision_bits, indices, ranks);
+      for (auto ix = 0UL; ix < index_count; ix += 1) {
+        m_batch[hash_ix + ix] =
+            static_cast<uint64_t>(slot(keys[batch_ix + hash_ix + ix])) << 32 |
+            indices[ix] << constants::k_sparse_rank_bits | ranks[ix];
+      }
+    }
+
+    // each key's entries end up together
+    group_by_slot(&m_batch, &m_scratch, m_keys.size());
+    uint32_t entries[constants::k_table_batch_size];
+    for (auto run_ix = 0UL; run_ix < batch_count;) {
+      const auto run_slot = static_cast<uint32_t>(m_batch[run_ix] >> 32);
+      auto entry_count = 0UL;
+      for (; run_ix < batch_count && m_batch[run_ix] >> 32 == run_slot;
+           run_ix += 1) {
+        entries[entry_count++] = static_cast<uint32_t>(m_batch[run_ix]);
+      }
+      add_entries(run_slot, entries, entry_count);
+    }
+  }
+}
+
+uint64_t llb::LogLogBetaTable::cardinality_of(uint32_t slot) const {
+  double sum = 0.0;
+  uint64_t zero_count = 0;
+  if (m_rows[slot] != k_sparse_row) {
+    kernels::active().sum_registers(row(slot), m_register_count, &sum,
+                                    &zero_count);
+  } else {
+    // every register without an entry is zero and adds 2^-0 to the sum
+    const auto entries = sorted_entries(slot);
+    zero_count = m_register_count - entries.size();
+    sum = static_cast<double>(zero_count);
+    for (const auto entry : entries) {
+      sum += 1.0 / (1UL << (entry & k_sparse_rank_mask));
+    }
+  }
+  return LogLogBeta::estimate(m_register_count, sum, zero_count);
+}
+
+uint64_t llb::LogLogBetaTable::cardinality(uint64_t key) const {
+  const auto it = m_slots.find(key);
+  return it == m_slots.end() ? 0UL : cardinality_of(it->second);
+}
+
+bool llb::LogLogBetaTable::merge(const LogLogBetaTable &merge_me) {
+  if (merge_me.m_precision_bits != m_precision_bits) {
+    return false;
+  }
+  // a table is its own max, and adding its sparse entries to themselves
+  // would read a row while growing it
+  if (&merge_me == this) {
+    return true;
+  }
+
+  const auto &kernel_table = kernels::active();
+  for (auto merge_slot = 0U; merge_slot < merge_me.m_keys.size();
+       merge_slot += 1) {
+    const auto this_slot = slot(merge_me.m_keys[merge_slot]);
+    if (merge_me.m_rows[merge_slot] == k_sparse_row) {
+      const auto &entries = merge_me.m_sparse[merge_slot];
+      // unsorted and repeated entries are fine to add as they are
+      add_entries(this_slot, entries.data(), entries.size());
+      continue;
+    }
+
+    if (m_rows[this_slot] == k_sparse_row) {
+      to_dense(this_slot);
+    }
+    kernel_table.merge_registers(row(this_slot), merge_me.row(merge_slot),
+                                 m_register_count);
+  }
+  return true;
+}
+
+std::vector<std::pair<uint64_t, uint64_t>>
+llb::LogLogBetaTable::top_k(uint64_t k) const {
+  std::vector<std::pair<uint64_t, uint64_t>> top;
+  top.reserve(m_keys.size());
+  for (auto slot = 0U; slot < m_keys.size(); slot += 1) {
+    top.emplace_back(m_keys[slot], cardinality_of(slot));
+  }
+
+  const auto by_cardinality = [](const std::pair<uint64_t, uint64_t> &lhs,
+                                 const std::pair<uint64_t, uint64_t> &rhs) {
+    return lhs.second != rhs.second ? lhs.second > rhs.second
+                                    : lhs.first < rhs.first;
+  };
+  k = std::min<uint64_t>(k, top.size());
+  std::partial_sort(top.begin(), top.begin() + k, top.end(), by_cardinality);
+  top.resize(k);
+  return top;
+}
+
+bool llb::LogLogBetaTable::is_sparse(uint64_t key) const {
+  const auto it = m_slots.find(key);
+  return it == m_slots.end() || m_rows[it->second] == k_sparse_row;
+}
+
+uint8_t llb::LogLogBetaTable::register_at(uint64_t key, uint64_t index) const {
+  const auto it = m_slots.find(key);
+  if (it == m_slots.end()) {
+    return 0U;
+  }
+  if (m_rows[it->second] != k_sparse_row) {
+    return row(it->second)[index];
+  }
+
+  const auto sparse = sorted_entries(it->second);
+  const auto entry = std::lower_bound(
+      sparse.begin(), sparse.end(),
+      static_cast<uint32_t>(index << constants::k_sparse_rank_bits));
+  return entry != sparse.end() &&
+                 *entry >> constants::k_sparse_rank_bits == index
+             ? static_cast<uint8_t>(*entry & k_sparse_rank_mask)
+             : 0U;
+}
@@ -0,0 +1,145 @@
+/**
+ * LogLogBetaView.cpp
+ */
+
+#include <cstring>
+
+#include "DenseRegisters.h"
+#include "Kernels.h"
+#include "LogLogBetaView.h"
+#include "Serialization.h"
+
+namespace {
+constexpr uint32_t k_rank_mask = (1U << llb::constants::k_sparse_rank_bits) - 1;
+} // namespace
+
+llb::LogLogBetaView::LogLogBetaView(const uint8_t *buffer,
+                                    uint64_t size) noexcept
+    : m_buffer{buffer}, m_payload{nullptr},
+      m_precision_bits{constants::k_minimum_precision},
+      m_layout{RegisterLayout::byte}, m_sparse{false}, m_base{0U},
+      m_payload_bytes{0UL}, m_overflow_count{0UL},
+      m_entries{false} {
+  serialization::Header header;
+  if (buffer == nullptr || size < sizeof(header)) {
+    return;
+  }
+  std::memcpy(&header, buffer, sizeof(header));
+
+  if (header.magic != serialization::k_magic ||
+      header.version != serialization::k_version ||
+      header.precision_bits < constants::k_minimum_precision ||
+      header.precision_bits > constants::k_maximum_precision ||
+      header.layout > static_cast<uint8_t>(RegisterLayout::packed4) ||
+      header.encoding >
+          static_cast<uint8_t>(serialization::Encoding::entries) ||
+      !Hasher::valid_function(header.hash_function) ||
+      header.payload_bytes > size - sizeof(header)) {
+    return;
+  }
+
+  const auto layout = static_cast<RegisterLayout>(header.layout);
+  const auto entries =
+      header.encoding == static_cast<uint8_t>(serialization::Encoding::entries);
+  // ranks are base plus an offset of up to k_packed4_overflow, and must
+  // shift a 64 bit word
+  if (layout == RegisterLayout::packed4 &&
+      static_cast<uint32_t>(header.base) + kernels::k_packed4_overflow >=
+          64U) {
+    return;
+  }
+  if (!entries) {
+    // sparse sketches are always written as entries. The overflow count is
+    // compared by division so a huge count can't wrap around to fit
+    const auto bytes = register_bytes(layout, 1UL << header.precision_bits);
+    if ((header.flags & serialization::k_flag_sparse) != 0 ||
+        header.payload_bytes < bytes ||
+        header.overflow_count >
+            (header.payload_bytes - bytes) / sizeof(uint32_t) ||
+        header.payload_bytes !=
+            bytes + header.overflow_count * sizeof(uint32_t) ||
+        (layout != RegisterLayout::packed4 &&
+         (header.base != 0 || header.overflow_count != 0))) {
+      return;
+    }
+  }
+
+  m_payload = buffer + sizeof(header);
+  m_precision_bits = header.precision_bits;
+  m_layout = layout;
+  m_sparse = (header.flags & serialization::k_flag_sparse) != 0;
+  m_base = header.base;
+  m_hasher = Hasher{static_cast<HashFunction>(header.hash_function),
+                    header.hash_seed};
+  m_payload_bytes = header.payload_bytes;
+  m_overflow_count = header.overflow_count;
+  m_entries = entries;
+}
+
+bool llb::LogLogBetaView::verify_checksum() const {
+  if (!valid()) {
+    return false;
+  }
+  serialization::Header header;
+  std::memcpy(&header, m_buffer, sizeof(header));
+  return serialization::checksum(header, m_payload) == header.checksum;
+}
+
+uint64_t llb::LogLogBetaView::serialized_size() const {
+  return valid() ? sizeof(serialization::Header) + m_payload_bytes : 0UL;
+}
+
+llb::DenseRegisters llb::LogLogBetaView::dense_registers() const {
+  return {m_layout,
+          register_count(),
+          m_payload,
+          m_base,
+          m_payload + register_bytes(m_layout, register_count()),
+          m_overflow_count};
+}
+
+uint64_t llb::LogLogBetaView::cardinality() const {
+  if (!valid()) {
+    return 0UL;
+  }
+
+  double sum = 0.0;
+  uint64_t zero_count = 0;
+  if (!m_entries) {
+    sum_registers(kernels::active(), dense_registers(), &sum, &zero_count);
+    return LogLogBeta::estimate(register_count(), sum, zero_count);
+  }
+
+  // every register without an entry is zero and adds 2^-0 to the sum
+  serialization::EntryReader reader{m_payload, m_payload_bytes};
+  uint64_t entry_count = 0;
+  uint32_t entry;
+  while (reader.next(&entry) &&
+         (entry >> constants::k_sparse_rank_bits) < register_count()) {
+    entry_count += 1;
+    sum += 1.0 / (1UL << (entry & k_rank_mask));
+  }
+  zero_count = register_count() - entry_count;
+  sum += static_cast<double>(zero_count);
+  return LogLogBeta::estimate(register_count(), sum, zero_count);
+}
+
+uint8_t llb::LogLogBetaView::register_at(uint64_t index) const {
+  if (!valid() || index >= register_count()) {
+    return 0U;
+  }
+  if (!m_entries) {
+    return llb::register_at(dense_registers(), index);
+  }
+
+  serialization::EntryReader reader{m_payload, m_payload_bytes};
+  uint32_t entry;
+  while (reader.next(&entry)) {
+    const auto entry_index = entry >> constants::k_sparse_rank_bits;
+    if (entry_index >= index) {
+      return entry_index == index ? static_cast<uint8_t>(entry & k_rank_mask)
+                                  : 0U;
+    }
+  }
+  return 0U;
+}
@@ -0,0 +1,181 @@
+/**
+ * MappedRegisterFile.cpp
+ */
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "DenseRegisters.h"
+#include "Kernels.h"
+#include "MappedRegisterFile.h"
+
+namespace {
+// "LLBM" read as a little endian word
+constexpr uint32_t k_magic = 0x4D424C4CU;
+constexpr uint8_t k_version = 1U;
+// Slots start a page into the file, after the header
+constexpr uint64_t k_header_bytes = 4096U;
+
+// Every field is little endian
+struct FileHeader {
+  uint32_t magic;
+  uint8_t version;
+  uint8_t precision_bits;
+  uint8_t layout;
+  uint8_t hash_function;
+  uint64_t hash_seed;
+  uint64_t slot_count;
+  uint64_t slot_bytes;
+};
+
+uint64_t align_up(uint64_t bytes, uint64_t alignment) {
+  return (bytes + alignment - 1) & ~(alignment - 1);
+}
+} // namespace
+
+llb::MappedRegisterFile::MappedRegisterFile() noexcept
+    : m_mapping{nullptr}, m_mapping_bytes{0UL}, m_slots{nullptr},
+      m_slot_bytes{0UL}, m_slot_count{0UL}, m_precision_bits{0U},
+      m_layout{RegisterLayout::byte}, m_fd{-1} {}
+
+llb::MappedRegisterFile::~MappedRegisterFile() noexcept { close(); }
+
+bool llb::MappedRegisterFile::open(const std::string &path,
+                                   uint32_t precision_bits,
+                                   uint64_t slot_count, RegisterLayout layout,
+                                   Hasher hasher) {
+  close();
+  if (precision_bits < constants::k_minimum_precision ||
+      precision_bits > constants::k_maximum_precision ||
+      layout == RegisterLayout::packed4) {
+    return false;
+  }
+
+  const auto slot_bytes =
+      align_up(llb::register_bytes(layout, 1UL << precision_bits) +
+                   kernels::k_register_padding,
+               64U);
+  const auto fd = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+  struct stat file_stat;
+  if (fd < 0 || fstat(fd, &file_stat) != 0) {
+    if (fd >= 0) {
+      ::close(fd);
+    }
+    return false;
+  }
+
+  FileHeader header{};
+  if (file_stat.st_size == 0) {
+    header.magic = k_magic;
+    header.version = k_version;
+    header.precision_bits = static_cast<uint8_t>(precision_bits);
+    header.layout = static_cast<uint8_t>(layout);
+    header.hash_function = static_cast<uint8_t>(hasher.function());
+    header.hash_seed = hasher.seed();
+    header.slot_bytes = slot_bytes;
+  } else if (pread(fd, &header, sizeof(header), 0) !=
+                 static_cast<ssize_t>(sizeof(header)) ||
+             header.magic != k_magic || header.version != k_version ||
+             header.precision_bits != precision_bits ||
+             header.layout != static_cast<uint8_t>(layout) ||
+             header.hash_function != static_cast<uint8_t>(hasher.function()) ||
+             header.hash_seed != hasher.seed() ||
+             header.slot_bytes != slot_bytes) {
+    ::close(fd);
+    return false;
+  }
+
+  // growing the file zeroes the new slots
+  header.slot_count = std::max(header.slot_count, slot_count);
+  const auto mapping_bytes = k_header_bytes + header.slot_count * slot_bytes;
+  if (static_cast<uint64_t>(file_stat.st_size) < mapping_bytes &&
+      ftruncate(fd, static_cast<off_t>(mapping_bytes)) != 0) {
+    ::close(fd);
+    return false;
+  }
+  auto *mapping = mmap(nullptr, mapping_bytes, PROT_READ | PROT_WRITE,
+                       MAP_SHARED, fd, 0);
+  if (mapping == MAP_FAILED) {
+    ::close(fd);
+    return false;
+  }
+
+  m_fd = fd;
+  m_mapping = reinterpret_cast<uint8_t *>(mapping);
+  m_mapping_bytes = mapping_bytes;
+  m_slots = m_mapping + k_header_bytes;
+  m_slot_bytes = slot_bytes;
+  m_slot_count = header.slot_count;
+  m_precision_bits = precision_bits;
+  m_layout = layout;
+  m_hasher = hasher;
+  std::memcpy(m_mapping, &header, sizeof(header));
+  return true;
+}
+
+void llb::MappedRegisterFile::close() {
+  if (m_mapping == nullptr) {
+    return;
+  }
+  munmap(m_mapping, m_mapping_bytes);
+  ::close(m_fd);
+  m_mapping = nullptr;
+  m_mapping_bytes = 0UL;
+  m_slots = nullptr;
+  m_slot_count = 0UL;
+  m_fd = -1;
+}
+
+bool llb::MappedRegisterFile::checkpoint() {
+  return m_mapping != nullptr &&
+         msync(m_mapping, m_mapping_bytes, MS_SYNC) == 0;
+}
+
+void llb::MappedRegisterFile::set_hot(uint64_t first_slot,
+                                      uint64_t slot_count) {
+#ifdef MADV_HUGEPAGE
+  advise(first_slot, slot_count, MADV_HUGEPAGE);
+#endif
+  advise(first_slot, slot_count, MADV_WILLNEED);
+}
+
+void llb::MappedRegisterFile::set_cold(uint64_t first_slot,
+                                       uint64_t slot_count) {
+#ifdef MADV_PAGEOUT
+  advise(first_slot, slot_count, MADV_PAGEOUT);
+#else
+  advise(first_slot, slot_count, MADV_DONTNEED);
+#endif
+}
+
+void llb::MappedRegisterFile::advise(uint64_t first_slot,
+                                     uint64_t slot_count, int advice) {
+  const auto page_bytes = static_cast<uint64_t>(sysconf(_SC_PAGESIZE));
+  const auto last_slot = std::min(first_slot + slot_count, m_slot_count);
+  if (m_mapping == nullptr || first_slot >= last_slot) {
+    return;
+  }
+  const auto begin = (k_header_bytes + first_slot * m_slot_bytes) /
+                     page_bytes * page_bytes;
+  const auto end = std::min(
+      align_up(k_header_bytes + last_slot * m_slot_bytes, page_bytes),
+      m_mapping_bytes);
+  madvise(m_mapping + begin, end - begin, advice);
+}
+
+uint8_t *llb::MappedRegisterFile::allocate(uint64_t bytes) {
+  return reinterpret_cast<uint8_t *>(
+      std::aligned_alloc(64U, align_up(bytes, 64U)));
+}
+
+void llb::MappedRegisterFile::deallocate(uint8_t *block, uint64_t) {
+  if (block < m_mapping || block >= m_mapping + m_mapping_bytes) {
+    free(block);
+  }
+}
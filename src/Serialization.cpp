@@ -0,0 +1,28 @@
+/**
+ * Serialization.cpp
+ */
+
+#include <cstddef>
+
+#include "Serialization.h"
+#include "xxhash.h"
+
+uint64_t llb::serialization::checksum(const Header &header,
+                                      const uint8_t *payload) {
+  return XXH3_64bits_withSeed(&header, offsetof(Header, checksum),
+                              XXH3_64bits(payload, header.payload_bytes));
+}
+
+void llb::serialization::write_entries(const std::vector<uint32_t> &entries,
+                                       std::vector<uint8_t> *out) {
+  uint32_t previous = 0;
+  for (const auto entry : entries) {
+    auto delta = entry - previous;
+    previous = entry;
+    while (delta >= 0x80) {
+      out->push_back(static_cast<uint8_t>(delta | 0x80));
+      delta >>= 7;
+    }
+    out->push_back(static_cast<uint8_t>(delta));
+  }
+}
@@ -0,0 +1,90 @@
+/**
+ * Serialization.h
+ */
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+namespace llb {
+namespace serialization {
+// "LLB1" read as a little endian word
+constexpr uint32_t k_magic = 0x31424C4CU;
+constexpr uint8_t k_version = 1U;
+
+// registers is the dense registers as they are in memory, followed by the
+// packed4 overflow entries. entries is the sorted (index << 6 | rank) entries
+// of every non zero register, each delta coded as a varint
+enum class Encoding : uint8_t { registers, entries };
+
+// The sketch was sparse when it was written
+constexpr uint8_t k_flag_sparse = 1U;
+
+// Every field is little endian. The header is 64 bytes so a 64 byte aligned
+// buffer gives 64 byte aligned registers
+struct Header {
+  uint32_t magic;
+  uint8_t version;
+  uint8_t precision_bits;
+  uint8_t layout;
+  uint8_t encoding;
+  uint8_t flags;
+  uint8_t base;
+  // A HashFunction, with the seed below
+  uint8_t hash_function;
+  uint8_t reserved[5];
+  uint64_t hash_seed;
+  uint64_t payload_bytes;
+  uint64_t overflow_count;
+  uint64_t entry_count;
+  uint64_t reserved_2;
+  // XXH3 of the payload, then of the header up to here seeded with that
+  uint64_t checksum;
+};
+static_assert(sizeof(Header) == 64, "serialized header must stay 64 bytes");
+
+uint64_t checksum(const Header &header, const uint8_t *payload);
+
+void write_entries(const std::vector<uint32_t> &entries,
+                   std::vector<uint8_t> *out);
+
+// Decodes delta coded entries, stopping at the end of the data or at
+// anything that isn't a strictly increasing 32 bit entry
+class EntryReader {
+public:
+  EntryReader(const uint8_t *data, uint64_t size)
+      : m_data{data}, m_end{data + size}, m_entry{0}, m_first{true} {}
+
+  // Inline, it runs once per entry of every view decode and delta apply
+  bool next(uint32_t *entry) {
+    uint64_t delta = 0;
+    for (auto shift = 0U; shift < 35U; shift += 7) {
+      if (m_data == m_end) {
+        return false;
+      }
+      const auto byte = *m_data++;
+      delta |= static_cast<uint64_t>(byte & 0x7F) << shift;
+      if ((byte & 0x80) == 0) {
+        if ((delta == 0 && !m_first) || m_entry + delta > UINT32_MAX) {
+          return false;
+        }
+        m_entry = static_cast<uint32_t>(m_entry + delta);
+        m_first = false;
+        *entry = m_entry;
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // True once every byte was decoded, false if next() stopped early
+  bool done() const { return m_data == m_end; }
+
+private:
+  const uint8_t *m_data;
+  const uint8_t *m_end;
+  uint32_t m_entry;
+  bool m_first;
+};
+} // namespace serialization
+} // namespace llb
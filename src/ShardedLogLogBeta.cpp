@@ -0,0 +1,166 @@
+/**
+ * ShardedLogLogBeta.cpp
+ */
+
+#include <algorithm>
+#include <chrono>
+
+#include "Kernels.h"
+#include "ShardedLogLogBeta.h"
+
+namespace {
+constexpr uint64_t k_ring_mask = llb::constants::k_shard_ring_size - 1;
+// Fewest registers a shard owns, so shards never share a cache line
+constexpr uint32_t k_minimum_shard_bits = 6U;
+// Empty polls a worker yields for before it starts sleeping between polls
+constexpr uint32_t k_idle_yields = 1024U;
+constexpr std::chrono::microseconds k_idle_sleep{50};
+} // namespace
+
+llb::ShardedLogLogBeta::ShardedLogLogBeta(double error_rate,
+                                         uint32_t shard_count,
+                                         uint32_t producer_count,
+                                         Hasher hasher) noexcept
+    : m_sketch{error_rate, Representation::dense, RegisterLayout::byte,
+               hasher},
+      m_shard_bits{0U}, m_producer_count{std::max(producer_count, 1U)},
+      m_stop{false} {
+  shard_count = std::min(shard_count, constants::k_maximum_shards);
+  while ((2U << m_shard_bits) <= shard_count &&
+         m_shard_bits + 1 + k_minimum_shard_bits <=
+             m_sketch.m_precision_bits) {
+    m_shard_bits += 1;
+  }
+
+  const auto ring_count = m_producer_count * this->shard_count();
+  m_rings.reset(new Ring[ring_count]);
+  for (auto ring_ix = 0U; ring_ix < ring_count; ring_ix += 1) {
+    m_rings[ring_ix].head.store(0UL);
+    m_rings[ring_ix].cached_tail = 0UL;
+    m_rings[ring_ix].tail.store(0UL);
+  }
+
+  for (auto shard_ix = 0U; shard_ix < this->shard_count(); shard_ix += 1) {
+    m_threads.emplace_back([this, shard_ix]() { work(shard_ix); });
+  }
+}
+
+llb::ShardedLogLogBeta::~ShardedLogLogBeta() noexcept {
+  m_stop.store(true);
+  for (auto &thread : m_threads) {
+    thread.join();
+  }
+}
+
+void llb::ShardedLogLogBeta::add_hashes(uint32_t producer_ix,
+                                        const uint64_t *hashes,
+                                        uint64_t count) {
+  auto *rings = &ring(producer_ix, 0U);
+  const auto shards = shard_count();
+  uint64_t heads[constants::k_maximum_shards];
+  for (auto shard_ix = 0U; shard_ix < shards; shard_ix += 1) {
+    heads[shard_ix] = rings[shard_ix].head.load(std::memory_order_relaxed);
+  }
+
+  for (auto hash_ix = 0UL; hash_ix < count;
+       hash_ix += constants::k_batch_size) {
+    const auto batch_count =
+        std::min<uint64_t>(count - hash_ix, constants::k_batch_size);
+
+    // Any ring may get the whole batch, so wait for room for all of it
+    for (auto shard_ix = 0U; shard_ix < shards; shard_ix += 1) {
+      auto &shard_ring = rings[shard_ix];
+      while (heads[shard_ix] + batch_count - shard_ring.cached_tail >
+             constants::k_shard_ring_size) {
+        shard_ring.cached_tail =
+            shard_ring.tail.load(std::memory_order_acquire);
+        if (heads[shard_ix] + batch_count - shard_ring.cached_tail >
+            constants::k_shard_ring_size) {
+          std::this_thread::yield();
+        }
+      }
+    }
+
+    // The top m_shard_bits of a hash are the top bits of its register
+    // index. Shifting twice keeps the shift below 64 with a single shard
+    for (auto ix = hash_ix; ix < hash_ix + batch_count; ix += 1) {
+      const auto hash = hashes[ix];
+      const auto shard_ix = (hash >> 1) >> (63U - m_shard_bits);
+      rings[shard_ix].hashes[heads[shard_ix] & k_ring_mask] = hash;
+      heads[shard_ix] += 1;
+    }
+
+    for (auto shard_ix = 0U; shard_ix < shards; shard_ix += 1) {
+      rings[shard_ix].head.store(heads[shard_ix], std::memory_order_release);
+    }
+  }
+}
+
+void llb::ShardedLogLogBeta::work(uint32_t shard_ix) {
+  auto idle_polls = 0U;
+  while (!m_stop.load(std::memory_order_relaxed)) {
+    auto applied = false;
+    for (auto producer_ix = 0U; producer_ix < m_producer_count;
+         producer_ix += 1) {
+      applied |= apply(&ring(producer_ix, shard_ix));
+    }
+
+    if (applied) {
+      idle_polls = 0U;
+    } else if (idle_polls < k_idle_yields) {
+      idle_polls += 1;
+      std::this_thread::yield();
+    } else {
+      std::this_thread::sleep_for(k_idle_sleep);
+    }
+  }
+}
+
+bool llb::ShardedLogLogBeta::apply(Ring *ring) {
+  const auto head = ring->head.load(std::memory_order_acquire);
+  auto tail = ring->tail.load(std::memory_order_relaxed);
+  if (tail == head) {
+    return false;
+  }
+
+  const auto &kernel_table = kernels::active();
+  uint32_t indices[constants::k_batch_size];
+  uint8_t ranks[constants::k_batch_size];
+  while (tail != head) {
+    // Batches stop at the end of the ring so the kernel reads one run
+    const auto slot = tail & k_ring_mask;
+    const auto batch_count = std::min<uint64_t>(
+        {head - tail, constants::k_batch_size,
+         constants::k_shard_ring_size - slot});
+    kernel_table.index_ranks(&ring->hashes[slot], batch_count,
+                             m_sketch.m_precision_bits, indices, ranks);
+    for (auto ix = 0UL; ix < batch_count; ix += 1) {
+      auto &reg = m_sketch.m_registers[indices[ix]];
+      reg = std::max(reg, ranks[ix]);
+    }
+    tail += batch_count;
+    ring->tail.store(tail, std::memory_order_release);
+  }
+  return true;
+}
+
+void llb::ShardedLogLogBeta::drain() const {
+  const auto ring_count = m_producer_count * shard_count();
+  for (auto ring_ix = 0U; ring_ix < ring_count; ring_ix += 1) {
+    const auto &drain_ring = m_rings[ring_ix];
+    while (drain_ring.tail.load(std::memory_order_acquire) !=
+           drain_ring.head.load(std::memory_order_acquire)) {
+      std::this_thread::yield();
+    }
+  }
+}
+
+uint64_t llb::ShardedLogLogBeta::cardinality() const {
+  drain();
+  return m_sketch.cardinality();
+}
+
+bool llb::ShardedLogLogBeta::merge_into(LogLogBeta *sketch) const {
+  drain();
+  return sketch->merge(m_sketch);
+}
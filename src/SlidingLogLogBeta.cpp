@@ -0,0 +1,210 @@
+/**
+ * SlidingLogLogBeta.cpp
+ */
+
+#include <algorithm>
+#include <cstring>
+
+#include "Kernels.h"
+#include "SlidingLogLogBeta.h"
+
+namespace {
+// Count of a register whose updates are in the spilled map
+constexpr uint8_t k_spilled = UINT8_MAX;
+} // namespace
+
+llb::SlidingLogLogBeta::SlidingLogLogBeta(uint64_t max_window,
+                                          double error_rate) noexcept
+    : m_max_window{std::max<uint64_t>(max_window, 1UL)},
+      m_error_rate{error_rate},
+      m_precision_bits{LogLogBeta{error_rate, Representation::sparse}
+                           .precision_bits()},
+      m_max_precision_bits{64U - m_precision_bits}, m_now{0UL},
+      m_timestamps(constants::k_sliding_slots << m_precision_bits),
+      m_ranks(constants::k_sliding_slots << m_precision_bits),
+      m_counts(1UL << m_precision_bits) {}
+
+void llb::SlidingLogLogBeta::add(const uint8_t *value, uint64_t length,
+                                 uint64_t timestamp) {
+  add_hash(Hasher{}.hash(value, length), timestamp);
+}
+
+void llb::SlidingLogLogBeta::add_hash(uint64_t hash, uint64_t timestamp) {
+  add_index_rank(hash >> m_max_precision_bits,
+                 kernels::hash_rank(hash, m_precision_bits), timestamp);
+}
+
+void llb::SlidingLogLogBeta::add_hashes(const uint64_t *hashes,
+                                        const uint64_t *timestamps,
+                                        uint64_t count) {
+  const auto &kernel_table = kernels::active();
+  uint32_t indices[constants::k_batch_size];
+  uint8_t ranks[constants::k_batch_size];
+  for (auto hash_ix = 0UL; hash_ix < count;
+       hash_ix += constants::k_batch_size) {
+    const auto batch_count =
+        std::min<uint64_t>(count - hash_ix, constants::k_batch_size);
+    kernel_table.index_ranks(&hashes[hash_ix], batch_count, m_precision_bits,
+                             indices, ranks);
+    for (auto ix = 0UL; ix < batch_count; ix += 1) {
+      add_index_rank(indices[ix], ranks[ix], timestamps[hash_ix + ix]);
+    }
+  }
+}
+
+void llb::SlidingLogLogBeta::add_index_rank(uint64_t index, uint8_t rank,
+                                            uint64_t timestamp) {
+  m_now = std::max(m_now, timestamp);
+  // already outside every window
+  if (m_now >= m_max_window && timestamp <= m_now - m_max_window) {
+    return;
+  }
+  const auto register_count = m_counts.size();
+
+  // ranks strictly fall as timestamps rise, so a register never has more
+  // updates than there are ranks
+  Update history[64];
+  auto count = 0UL;
+  if (m_counts[index] == k_spilled) {
+    const auto &spilled = m_spilled[index];
+    count = spilled.size();
+    std::copy(spilled.begin(), spilled.end(), history);
+  } else {
+    count = m_counts[index];
+    for (auto slot = 0UL; slot < count; slot += 1) {
+      history[slot] = {m_timestamps[slot * register_count + index],
+                       m_ranks[slot * register_count + index]};
+    }
+  }
+  auto *end = history + count;
+
+  // drop updates that have left the largest window
+  auto *first = history;
+  if (m_now >= m_max_window) {
+    while (first != end && first->timestamp <= m_now - m_max_window) {
+      ++first;
+    }
+  }
+
+  // a later update of at least this rank outlives this one in every window,
+  // and this one outlives the earlier updates of at most its rank
+  auto *later = std::upper_bound(first, end, timestamp,
+                                 [](uint64_t time, const Update &update) {
+                                   return time < update.timestamp;
+                                 });
+  const auto outlived =
+      (later != end && later->rank >= rank) ||
+      (later != first && (later - 1)->timestamp == timestamp &&
+       (later - 1)->rank >= rank);
+  if (outlived) {
+    if (first == history) {
+      return;
+    }
+  } else {
+    auto *earlier = later;
+    while (earlier != first && (earlier - 1)->rank <= rank) {
+      --earlier;
+    }
+    // the updates from later on move down to just after the new one
+    const auto moved = static_cast<uint64_t>(end - later);
+    // when the new update replaces just one, the later ones stay put
+    if (earlier == later) {
+      std::copy_backward(later, end, end + 1);
+    } else if (earlier + 1 != later) {
+      std::copy(later, end, earlier + 1);
+    }
+    *earlier = {timestamp, rank};
+    end = earlier + 1 + moved;
+  }
+
+  count = static_cast<uint64_t>(end - first);
+  if (count > constants::k_sliding_slots) {
+    m_spilled[index].assign(first, end);
+    m_counts[index] = k_spilled;
+    return;
+  }
+  if (m_counts[index] == k_spilled) {
+    m_spilled.erase(index);
+  }
+  for (auto slot = 0UL; slot < count; slot += 1) {
+    m_timestamps[slot * register_count + index] = first[slot].timestamp;
+    m_ranks[slot * register_count + index] = first[slot].rank;
+  }
+  m_counts[index] = static_cast<uint8_t>(count);
+}
+
+uint64_t llb::SlidingLogLogBeta::window_start(uint64_t window,
+                                             uint64_t now) const {
+  window = std::min(window, m_max_window);
+  now = std::max(now, m_now);
+  return now >= window ? now - window + 1 : 0UL;
+}
+
+void llb::SlidingLogLogBeta::window_registers(uint64_t since,
+                                              uint8_t *registers) const {
+  // most registers have an update from since on in their first slot, only
+  // the rest look further
+  const auto register_count = m_counts.size();
+  for (auto index = 0UL; index < register_count; index += 1) {
+    const auto take = m_counts[index] != 0 && m_timestamps[index] >= since;
+    registers[index] = take ? m_ranks[index] : 0U;
+  }
+
+  std::vector<uint32_t> pending;
+  for (auto index = 0UL; index < register_count; index += 1) {
+    if (registers[index] == 0 && m_counts[index] > 1 &&
+        m_counts[index] != k_spilled) {
+      pending.push_back(static_cast<uint32_t>(index));
+    }
+  }
+  // a slot at a time so each pass reads the slot's arrays in order
+  for (auto slot = 1UL; slot < constants::k_sliding_slots && !pending.empty();
+       slot += 1) {
+    const auto *timestamps = &m_timestamps[slot * register_count];
+    const auto *ranks = &m_ranks[slot * register_count];
+    auto still_pending = pending.begin();
+    for (const auto index : pending) {
+      if (timestamps[index] >= since) {
+        registers[index] = ranks[index];
+      } else if (slot + 1 < m_counts[index]) {
+        *still_pending++ = index;
+      }
+    }
+    pending.erase(still_pending, pending.end());
+  }
+
+  for (const auto &spilled : m_spilled) {
+    const auto update = std::find_if(
+        spilled.second.begin(), spilled.second.end(),
+        [&](const Update &update) { return update.timestamp >= since; });
+    registers[spilled.first] =
+        update == spilled.second.end() ? 0U : update->rank;
+  }
+}
+
+bool llb::SlidingLogLogBeta::merge_into(uint64_t window, uint64_t now,
+                                        LogLogBeta *sketch) const {
+  if (sketch->m_precision_bits != m_precision_bits ||
+      sketch->hasher() != Hasher{}) {
+    return false;
+  }
+
+  std::vector<uint8_t> registers(m_counts.size());
+  window_registers(window_start(window, now), registers.data());
+  for (auto index = 0UL; index < registers.size(); index += 1) {
+    if (registers[index] != 0) {
+      sketch->add_entry(
+          static_cast<uint32_t>(index << constants::k_sparse_rank_bits) |
+          registers[index]);
+    }
+  }
+  return true;
+}
+
+uint64_t llb::SlidingLogLogBeta::cardinality(uint64_t window,
+                                             uint64_t now) const {
+  // the window's registers summed with the active kernel
+  LogLogBeta sketch{m_error_rate};
+  window_registers(window_start(window, now), sketch.m_registers);
+  return sketch.cardinality();
+}
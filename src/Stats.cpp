@@ -0,0 +1,82 @@
+/**
+ * Stats.cpp
+ */
+
+#include <algorithm>
+#include <cstring>
+#include <mutex>
+#include <vector>
+
+#include "StatsCounters.h"
+
+static_assert(sizeof(llb::Stats) ==
+                  llb::stats::k_counter_count * sizeof(uint64_t),
+              "Stats has one field per counter");
+
+#ifdef LLB_STATS
+namespace {
+struct Registry {
+  std::mutex mutex;
+  std::vector<const llb::stats::ThreadCounters *> threads;
+  // Summed counters of the threads that have exited
+  uint64_t exited[llb::stats::k_counter_count] = {};
+};
+
+Registry &registry() {
+  static Registry threads;
+  return threads;
+}
+
+llb::Stats to_stats(const uint64_t *counts) {
+  llb::Stats stats;
+  std::memcpy(&stats, counts, sizeof(stats));
+  return stats;
+}
+} // namespace
+
+llb::stats::ThreadCounters::ThreadCounters() noexcept {
+  for (auto &count : counts) {
+    count.store(0UL, std::memory_order_relaxed);
+  }
+  auto &threads = registry();
+  std::lock_guard<std::mutex> lock{threads.mutex};
+  threads.threads.push_back(this);
+}
+
+llb::stats::ThreadCounters::~ThreadCounters() noexcept {
+  auto &threads = registry();
+  std::lock_guard<std::mutex> lock{threads.mutex};
+  for (auto counter = 0U; counter < k_counter_count; counter += 1) {
+    threads.exited[counter] += counts[counter].load(std::memory_order_relaxed);
+  }
+  threads.threads.erase(
+      std::find(threads.threads.begin(), threads.threads.end(), this));
+}
+
+llb::Stats llb::thread_stats() noexcept {
+  const auto &counters = stats::thread_counters();
+  uint64_t counts[stats::k_counter_count];
+  for (auto counter = 0U; counter < stats::k_counter_count; counter += 1) {
+    counts[counter] = counters.counts[counter].load(std::memory_order_relaxed);
+  }
+  return to_stats(counts);
+}
+
+llb::Stats llb::process_stats() noexcept {
+  auto &threads = registry();
+  std::lock_guard<std::mutex> lock{threads.mutex};
+  uint64_t counts[stats::k_counter_count];
+  std::copy_n(threads.exited, stats::k_counter_count, counts);
+  for (const auto *counters : threads.threads) {
+    for (auto counter = 0U; counter < stats::k_counter_count; counter += 1) {
+      counts[counter] +=
+          counters->counts[counter].load(std::memory_order_relaxed);
+    }
+  }
+  return to_stats(counts);
+}
+#else
+llb::Stats llb::thread_stats() noexcept { return Stats{}; }
+
+llb::Stats llb::process_stats() noexcept { return Stats{}; }
+#endif
@@ -0,0 +1,92 @@
+/**
+ * StatsCounters.h
+ */
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+#include "Dispatch.h"
+#include "Stats.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+namespace llb {
+namespace stats {
+// One per field of Stats, in the same order
+enum Counter : uint32_t {
+  hashes_added,
+  registers_raised,
+  merges,
+  merge_cycles,
+  cardinalities,
+  cardinality_cycles,
+  kernel_runs,
+  k_counter_count = kernel_runs + 4
+};
+
+#ifdef LLB_STATS
+// A thread's counters, written only by that thread. They are atomics so
+// process_stats() can read them while the thread runs, but the thread adds
+// with a plain load and store rather than a locked add
+struct ThreadCounters {
+  ThreadCounters() noexcept;
+  ~ThreadCounters() noexcept;
+
+  std::atomic<uint64_t> counts[k_counter_count];
+};
+
+inline ThreadCounters &thread_counters() {
+  static thread_local ThreadCounters counters;
+  return counters;
+}
+
+inline void add(Counter counter, uint64_t amount) {
+  auto &count = thread_counters().counts[counter];
+  count.store(count.load(std::memory_order_relaxed) + amount,
+              std::memory_order_relaxed);
+}
+
+inline uint64_t cycles() {
+#if defined(__x86_64__) || defined(__i386__)
+  return __rdtsc();
+#else
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+#endif
+}
+
+// Counts a call of calls and its cycles, which are counted right after it
+class Timer {
+public:
+  explicit Timer(Counter calls) : m_calls{calls}, m_start{cycles()} {}
+
+  ~Timer() {
+    add(m_calls, 1UL);
+    add(static_cast<Counter>(m_calls + 1), cycles() - m_start);
+  }
+
+private:
+  Counter m_calls;
+  uint64_t m_start;
+};
+#else
+inline void add(Counter, uint64_t) {}
+
+class Timer {
+public:
+  explicit Timer(Counter) {}
+};
+#endif
+
+inline void kernel_run(InstructionSet instruction_set) {
+  add(static_cast<Counter>(kernel_runs +
+                           static_cast<uint32_t>(instruction_set)),
+      1UL);
+}
+} // namespace stats
+} // namespace llb
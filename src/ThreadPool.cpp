@@ -0,0 +1,112 @@
+/**
+ * ThreadPool.cpp
+ */
+
+#include <algorithm>
+
+#include "ThreadPool.h"
+
+llb::ThreadPool::ThreadPool(uint32_t thread_count) noexcept
+    : m_min_parallel_registers{constants::k_parallel_min_registers},
+      m_generation{0UL}, m_active{0U}, m_stop{false}, m_task{nullptr},
+      m_task_count{0UL}, m_next_task{0UL} {
+  if (thread_count == 0) {
+    thread_count = std::max(std::thread::hardware_concurrency(), 1U);
+  }
+  for (auto thread_ix = 1U; thread_ix < thread_count; thread_ix += 1) {
+    m_threads.emplace_back([this]() { work(); });
+  }
+}
+
+llb::ThreadPool::~ThreadPool() noexcept {
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_stop = true;
+  }
+  m_wake.notify_all();
+  for (auto &thread : m_threads) {
+    thread.join();
+  }
+}
+
+llb::ThreadPool &llb::ThreadPool::shared() {
+  static ThreadPool pool;
+  return pool;
+}
+
+void llb::ThreadPool::run(uint64_t task_count,
+                          const std::function<void(uint64_t)> &task) {
+  if (m_threads.empty() || task_count <= 1) {
+    for (auto task_ix = 0UL; task_ix < task_count; task_ix += 1) {
+      task(task_ix);
+    }
+    return;
+  }
+
+  std::lock_guard<std::mutex> run_lock(m_run_mutex);
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_task = &task;
+    m_task_count = task_count;
+    m_next_task.store(0UL);
+    m_active = static_cast<uint32_t>(m_threads.size());
+    m_generation += 1;
+  }
+  m_wake.notify_all();
+
+  run_tasks();
+
+  std::unique_lock<std::mutex> lock(m_mutex);
+  m_done.wait(lock, [this]() { return m_active == 0; });
+  m_task = nullptr;
+}
+
+void llb::ThreadPool::work() {
+  auto generation = 0UL;
+  std::unique_lock<std::mutex> lock(m_mutex);
+  while (true) {
+    m_wake.wait(lock,
+                [&]() { return m_stop || m_generation != generation; });
+    if (m_stop) {
+      return;
+    }
+    generation = m_generation;
+
+    lock.unlock();
+    run_tasks();
+    lock.lock();
+
+    if (--m_active == 0) {
+      m_done.notify_one();
+    }
+  }
+}
+
+void llb::ThreadPool::run_tasks() {
+  for (auto task_ix = m_next_task.fetch_add(1UL); task_ix < m_task_count;
+       task_ix = m_next_task.fetch_add(1UL)) {
+    (*m_task)(task_ix);
+  }
+}
+
+uint64_t llb::chunk_count(const ThreadPool *pool, uint64_t register_count) {
+  if (pool == nullptr || pool->thread_count() == 1 ||
+      register_count < pool->min_parallel_registers()) {
+    return 1UL;
+  }
+  return std::max(register_count / constants::k_parallel_chunk_registers,
+                  1UL);
+}
+
+void llb::run_chunks(
+    ThreadPool *pool, uint64_t chunk_count, uint64_t register_count,
+    const std::function<void(uint64_t, uint64_t, uint64_t)> &task) {
+  const auto chunk_registers = register_count / chunk_count;
+  if (chunk_count == 1) {
+    task(0UL, 0UL, register_count);
+    return;
+  }
+  pool->run(chunk_count, [&](uint64_t chunk_ix) {
+    task(chunk_ix, chunk_ix * chunk_registers, chunk_registers);
+  });
+}
@@ -1,8 +1,27 @@
 #include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
 #include <functional>
+#include <memory>
+#include <random>
+#include <thread>
+#include <unordered_map>
 
+#include "ConcurrentLogLogBeta.h"
 #include "LogLogBeta.h"
+#include "LogLogBetaArena.h"
+#include "LogLogBetaFixed.h"
+#include "LogLogBetaTable.h"
+#include "LogLogBetaView.h"
+#include "MappedRegisterFile.h"
+#include "ShardedLogLogBeta.h"
+#include "SlidingLogLogBeta.h"
+#include "Stats.h"
+#include "ThreadPool.h"
 #include "gtest/gtest.h"
+#include "xxhash.h"
 
 int k_string_length = 256;
 double k_error_limit = 0.02; // 2% estimation error
@@ -112,3 +131,1615 @@ TEST(LogLogBetaMerge, Many) {
               k_error_limit)
       << "cardinality: " << main.cardinality();
 }
+
+std::vector<uint64_t> random_hashes(uint64_t count) {
+  std::vector<uint64_t> hashes;
+  hashes.reserve(count);
+  for (auto ix = 0UL; ix < count; ++ix) {
+    hashes.push_back((static_cast<uint64_t>(random()) << 33) ^
+                     (static_cast<uint64_t>(random()) << 11) ^
+                     static_cast<uint64_t>(random()));
+  }
+  return hashes;
+}
+
+std::vector<llb::InstructionSet> supported_instruction_sets() {
+  std::vector<llb::InstructionSet> instruction_sets;
+  for (auto instruction_set :
+       {llb::InstructionSet::scalar, llb::InstructionSet::sse41,
+        llb::InstructionSet::avx2, llb::InstructionSet::avx512}) {
+    if (instruction_set <= llb::detected_instruction_set()) {
+      instruction_sets.push_back(instruction_set);
+    }
+  }
+  return instruction_sets;
+}
+
+TEST(LogLogBetaDispatch, RejectsUnsupported) {
+  if (llb::detected_instruction_set() != llb::InstructionSet::avx512) {
+    ASSERT_FALSE(llb::set_instruction_set(llb::InstructionSet::avx512));
+  }
+  ASSERT_TRUE(llb::set_instruction_set(llb::InstructionSet::scalar));
+  ASSERT_EQ(llb::InstructionSet::scalar, llb::active_instruction_set());
+  ASSERT_TRUE(llb::set_instruction_set(llb::detected_instruction_set()));
+}
+
+TEST(LogLogBetaDispatch, CardinalityMatchesScalar) {
+  llb::LogLogBeta llb{};
+  for (const auto hash : random_hashes(100000)) {
+    llb.add_hash(hash);
+  }
+
+  const auto expected = llb.cardinality_nonavx();
+  for (const auto instruction_set : supported_instruction_sets()) {
+    ASSERT_TRUE(llb::set_instruction_set(instruction_set));
+    ASSERT_TRUE(estimate_error(expected, llb.cardinality()) < 0.001)
+        << llb::instruction_set_name(instruction_set)
+        << " cardinality: " << llb.cardinality();
+  }
+  llb::set_instruction_set(llb::detected_instruction_set());
+}
+
+TEST(LogLogBetaDispatch, MergeMatchesScalar) {
+  const auto hashes1 = random_hashes(10000);
+  const auto hashes2 = random_hashes(10000);
+
+  llb::LogLogBeta other{};
+  for (const auto hash : hashes2) {
+    other.add_hash(hash);
+  }
+
+  llb::LogLogBeta expected{};
+  for (const auto hash : hashes1) {
+    expected.add_hash(hash);
+  }
+  expected.merge_nonavx(other);
+
+  for (const auto instruction_set : supported_instruction_sets()) {
+    ASSERT_TRUE(llb::set_instruction_set(instruction_set));
+    llb::LogLogBeta llb{};
+    for (const auto hash : hashes1) {
+      llb.add_hash(hash);
+    }
+    llb.merge(other);
+    ASSERT_EQ(expected.cardinality_nonavx(), llb.cardinality_nonavx())
+        << llb::instruction_set_name(instruction_set);
+  }
+  llb::set_instruction_set(llb::detected_instruction_set());
+}
+
+TEST(LogLogBetaSparse, MatchesDense) {
+  llb::LogLogBeta sparse{llb::constants::k_default_error_rate,
+                         llb::Representation::sparse};
+  llb::LogLogBeta dense{};
+  for (const auto hash : random_hashes(500)) {
+    sparse.add_hash(hash);
+    dense.add_hash(hash);
+  }
+
+  ASSERT_TRUE(sparse.is_sparse());
+  ASSERT_FALSE(dense.is_sparse());
+  ASSERT_EQ(dense.cardinality_nonavx(), sparse.cardinality());
+  ASSERT_EQ(dense.cardinality_nonavx(), sparse.cardinality_nonavx());
+}
+
+TEST(LogLogBetaSparse, Promotes) {
+  llb::LogLogBeta sparse{llb::constants::k_default_error_rate,
+                         llb::Representation::sparse};
+  llb::LogLogBeta dense{};
+  for (const auto hash : random_hashes(100000)) {
+    sparse.add_hash(hash);
+    dense.add_hash(hash);
+  }
+
+  ASSERT_FALSE(sparse.is_sparse());
+  ASSERT_EQ(dense.cardinality_nonavx(), sparse.cardinality_nonavx());
+}
+
+TEST(LogLogBetaSparse, MergeCombinations) {
+  const auto hashes1 = random_hashes(300);
+  const auto hashes2 = random_hashes(300);
+
+  llb::LogLogBeta expected{};
+  for (const auto hash : hashes1) {
+    expected.add_hash(hash);
+  }
+  for (const auto hash : hashes2) {
+    expected.add_hash(hash);
+  }
+
+  for (const auto left : {llb::Representation::dense,
+                          llb::Representation::sparse}) {
+    for (const auto right : {llb::Representation::dense,
+                             llb::Representation::sparse}) {
+      llb::LogLogBeta llb1{llb::constants::k_default_error_rate, left};
+      llb::LogLogBeta llb2{llb::constants::k_default_error_rate, right};
+      for (const auto hash : hashes1) {
+        llb1.add_hash(hash);
+      }
+      for (const auto hash : hashes2) {
+        llb2.add_hash(hash);
+      }
+
+      llb1.merge(llb2);
+      ASSERT_EQ(expected.cardinality_nonavx(), llb1.cardinality_nonavx());
+      ASSERT_EQ(left == llb::Representation::sparse &&
+                    right == llb::Representation::sparse,
+                llb1.is_sparse());
+    }
+  }
+}
+
+void assert_same_registers(const llb::LogLogBeta &expected,
+                           const llb::LogLogBeta &actual) {
+  ASSERT_EQ(expected.register_count(), actual.register_count());
+  for (auto register_ix = 0UL; register_ix < expected.register_count();
+       ++register_ix) {
+    ASSERT_EQ(expected.register_at(register_ix),
+              actual.register_at(register_ix))
+        << "register: " << register_ix;
+  }
+}
+
+// Error rate the constructor turns into precision_bits
+double error_rate_for(uint32_t precision_bits) {
+  return 1.04 / std::sqrt(std::pow(2.0, precision_bits)) * 1.0001;
+}
+
+std::vector<llb::RegisterLayout> packed_layouts() {
+  return {llb::RegisterLayout::packed6, llb::RegisterLayout::packed4};
+}
+
+TEST(LogLogBetaLayout, MatchesByte) {
+  for (const auto count : {100UL, 10000UL, 1000000UL}) {
+    const auto hashes = random_hashes(count);
+    llb::LogLogBeta expected{};
+    for (const auto hash : hashes) {
+      expected.add_hash(hash);
+    }
+
+    for (const auto layout : packed_layouts()) {
+      llb::LogLogBeta llb{llb::constants::k_default_error_rate,
+                          llb::Representation::dense, layout};
+      for (const auto hash : hashes) {
+        llb.add_hash(hash);
+      }
+
+      assert_same_registers(expected, llb);
+      ASSERT_NEAR(expected.cardinality_nonavx(), llb.cardinality_nonavx(), 1)
+          << "count: " << count;
+      for (const auto instruction_set : supported_instruction_sets()) {
+        ASSERT_TRUE(llb::set_instruction_set(instruction_set));
+        ASSERT_NEAR(expected.cardinality_nonavx(), llb.cardinality(), 1)
+            << llb::instruction_set_name(instruction_set)
+            << " count: " << count;
+      }
+      llb::set_instruction_set(llb::detected_instruction_set());
+    }
+  }
+}
+
+TEST(LogLogBetaLayout, Merge) {
+  // the larger side raises the packed4 base well above the smaller one
+  const auto hashes1 = random_hashes(1000000);
+  const auto hashes2 = random_hashes(1000);
+
+  llb::LogLogBeta expected{};
+  for (const auto hash : hashes1) {
+    expected.add_hash(hash);
+  }
+  for (const auto hash : hashes2) {
+    expected.add_hash(hash);
+  }
+
+  for (const auto layout : packed_layouts()) {
+    for (const auto instruction_set : supported_instruction_sets()) {
+      ASSERT_TRUE(llb::set_instruction_set(instruction_set));
+
+      llb::LogLogBeta large{llb::constants::k_default_error_rate,
+                            llb::Representation::dense, layout};
+      llb::LogLogBeta small{llb::constants::k_default_error_rate,
+                            llb::Representation::dense, layout};
+      for (const auto hash : hashes1) {
+        large.add_hash(hash);
+      }
+      for (const auto hash : hashes2) {
+        small.add_hash(hash);
+      }
+
+      small.merge(large);
+      assert_same_registers(expected, small);
+      ASSERT_NEAR(expected.cardinality_nonavx(), small.cardinality_nonavx(), 1)
+          << llb::instruction_set_name(instruction_set);
+      large.merge(small);
+      assert_same_registers(expected, large);
+      ASSERT_NEAR(expected.cardinality_nonavx(), large.cardinality_nonavx(), 1)
+          << llb::instruction_set_name(instruction_set);
+    }
+    llb::set_instruction_set(llb::detected_instruction_set());
+  }
+}
+
+TEST(LogLogBetaLayout, MergeAcrossLayouts) {
+  const auto hashes1 = random_hashes(200000);
+  const auto hashes2 = random_hashes(200000);
+
+  llb::LogLogBeta expected{};
+  for (const auto hash : hashes1) {
+    expected.add_hash(hash);
+  }
+  for (const auto hash : hashes2) {
+    expected.add_hash(hash);
+  }
+
+  for (const auto left :
+       {llb::RegisterLayout::byte, llb::RegisterLayout::packed6,
+        llb::RegisterLayout::packed4}) {
+    for (const auto right :
+         {llb::RegisterLayout::byte, llb::RegisterLayout::packed6,
+          llb::RegisterLayout::packed4}) {
+      llb::LogLogBeta llb1{llb::constants::k_default_error_rate,
+                           llb::Representation::sparse, left};
+      llb::LogLogBeta llb2{llb::constants::k_default_error_rate,
+                           llb::Representation::dense, right};
+      for (const auto hash : hashes1) {
+        llb1.add_hash(hash);
+      }
+      for (const auto hash : hashes2) {
+        llb2.add_hash(hash);
+      }
+
+      llb1.merge(llb2);
+      ASSERT_EQ(left, llb1.layout());
+      assert_same_registers(expected, llb1);
+      ASSERT_NEAR(expected.cardinality_nonavx(), llb1.cardinality_nonavx(), 1);
+    }
+  }
+}
+
+TEST(LogLogBetaBatch, MatchesAddHash) {
+  // not a multiple of the batch or vector size
+  const auto hashes = random_hashes(100003);
+
+  for (const auto representation :
+       {llb::Representation::dense, llb::Representation::sparse}) {
+    for (const auto layout :
+         {llb::RegisterLayout::byte, llb::RegisterLayout::packed6,
+          llb::RegisterLayout::packed4}) {
+      llb::LogLogBeta expected{llb::constants::k_default_error_rate,
+                               representation, layout};
+      for (const auto hash : hashes) {
+        expected.add_hash(hash);
+      }
+
+      for (const auto instruction_set : supported_instruction_sets()) {
+        ASSERT_TRUE(llb::set_instruction_set(instruction_set));
+        llb::LogLogBeta llb{llb::constants::k_default_error_rate,
+                            representation, layout};
+        llb.add_hashes(hashes.data(), hashes.size());
+        assert_same_registers(expected, llb);
+      }
+      llb::set_instruction_set(llb::detected_instruction_set());
+    }
+  }
+}
+
+TEST(LogLogBetaBatch, StringsMatchAdd) {
+  std::vector<std::string> values;
+  for (auto ix = 0; ix < 5000; ++ix) {
+    values.push_back(random_string((random() % k_string_length) + 1));
+  }
+
+  llb::LogLogBeta expected{};
+  std::vector<const uint8_t *> pointers;
+  std::vector<uint64_t> lengths;
+  std::string buffer;
+  std::vector<uint64_t> offsets{0};
+  for (const auto &value : values) {
+    expected.add(value);
+    pointers.push_back(reinterpret_cast<const uint8_t *>(value.data()));
+    lengths.push_back(value.size());
+    buffer += value;
+    offsets.push_back(buffer.size());
+  }
+
+  llb::LogLogBeta spans{};
+  spans.add_many(pointers.data(), lengths.data(), values.size());
+  assert_same_registers(expected, spans);
+
+  llb::LogLogBeta contiguous{};
+  contiguous.add_many(reinterpret_cast<const uint8_t *>(buffer.data()),
+                      offsets.data(), values.size());
+  assert_same_registers(expected, contiguous);
+
+  llb::LogLogBeta strings{};
+  strings.add_many(values);
+  assert_same_registers(expected, strings);
+}
+
+TEST(LogLogBetaSerialize, RoundTrip) {
+  for (const auto count : {200UL, 100000UL}) {
+    const auto hashes = random_hashes(count);
+    for (const auto representation :
+         {llb::Representation::dense, llb::Representation::sparse}) {
+      for (const auto layout :
+           {llb::RegisterLayout::byte, llb::RegisterLayout::packed6,
+            llb::RegisterLayout::packed4}) {
+        for (const auto compress : {false, true}) {
+          llb::LogLogBeta expected{llb::constants::k_default_error_rate,
+                                   representation, layout};
+          expected.add_hashes(hashes.data(), hashes.size());
+
+          const auto buffer = expected.serialize(compress);
+          llb::LogLogBeta llb{};
+          ASSERT_TRUE(llb.deserialize(buffer.data(), buffer.size()));
+          ASSERT_EQ(expected.is_sparse(), llb.is_sparse());
+          ASSERT_EQ(layout, llb.layout());
+          assert_same_registers(expected, llb);
+          ASSERT_EQ(expected.cardinality(), llb.cardinality());
+
+          // adding after a round trip still matches
+          const auto more = random_hashes(1000);
+          expected.add_hashes(more.data(), more.size());
+          llb.add_hashes(more.data(), more.size());
+          assert_same_registers(expected, llb);
+        }
+      }
+    }
+  }
+}
+
+TEST(LogLogBetaSerialize, ViewInPlace) {
+  const auto hashes1 = random_hashes(100000);
+  const auto hashes2 = random_hashes(300);
+
+  for (const auto layout :
+       {llb::RegisterLayout::byte, llb::RegisterLayout::packed6,
+        llb::RegisterLayout::packed4}) {
+    for (const auto &hashes : {hashes1, hashes2}) {
+      llb::LogLogBeta sketch{llb::constants::k_default_error_rate,
+                             llb::Representation::sparse, layout};
+      sketch.add_hashes(hashes.data(), hashes.size());
+      const auto serialized = sketch.serialize();
+
+      // views don't need the buffer to be aligned
+      std::vector<uint8_t> buffer(serialized.size() + 1);
+      std::copy(serialized.begin(), serialized.end(), buffer.begin() + 1);
+      const llb::LogLogBetaView view{&buffer[1], serialized.size()};
+      ASSERT_TRUE(view.valid());
+      ASSERT_TRUE(view.verify_checksum());
+      ASSERT_EQ(serialized.size(), view.serialized_size());
+      ASSERT_EQ(sketch.is_sparse(), view.is_sparse());
+      ASSERT_EQ(sketch.cardinality(), view.cardinality());
+      for (auto register_ix = 0UL; register_ix < view.register_count();
+           register_ix += 97) {
+        ASSERT_EQ(sketch.register_at(register_ix),
+                  view.register_at(register_ix));
+      }
+
+      for (const auto instruction_set : supported_instruction_sets()) {
+        ASSERT_TRUE(llb::set_instruction_set(instruction_set));
+        llb::LogLogBeta expected{llb::constants::k_default_error_rate,
+                                 llb::Representation::dense, layout};
+        llb::LogLogBeta merged{llb::constants::k_default_error_rate,
+                               llb::Representation::dense, layout};
+        const auto other = random_hashes(5000);
+        expected.add_hashes(other.data(), other.size());
+        merged.add_hashes(other.data(), other.size());
+
+        expected.merge(sketch);
+        ASSERT_TRUE(merged.merge(view));
+        assert_same_registers(expected, merged);
+      }
+      llb::set_instruction_set(llb::detected_instruction_set());
+    }
+  }
+}
+
+TEST(LogLogBetaSerialize, RejectsCorrupt) {
+  llb::LogLogBeta sketch{};
+  const auto hashes = random_hashes(10000);
+  sketch.add_hashes(hashes.data(), hashes.size());
+  auto buffer = sketch.serialize();
+
+  llb::LogLogBeta llb{};
+  ASSERT_FALSE(llb.deserialize(buffer.data(), buffer.size() - 1));
+  ASSERT_FALSE(llb::LogLogBetaView(buffer.data(), 10).valid());
+
+  buffer[buffer.size() / 2] ^= 0x01;
+  ASSERT_TRUE(llb::LogLogBetaView(buffer.data(), buffer.size()).valid());
+  ASSERT_FALSE(
+      llb::LogLogBetaView(buffer.data(), buffer.size()).verify_checksum());
+  ASSERT_FALSE(llb.deserialize(buffer.data(), buffer.size()));
+}
+
+// Header fields views check without the checksum, so corruption there
+// must be caught by the checks themselves
+TEST(LogLogBetaSerialize, RejectsCorruptHeader) {
+  const uint64_t k_base_offset = 9;
+  const uint64_t k_precision_offset = 5;
+  const uint64_t k_overflow_count_offset = 32;
+  const auto hashes = random_hashes(10000);
+  llb::LogLogBeta sketch{error_rate_for(14), llb::Representation::dense,
+                         llb::RegisterLayout::packed4};
+  sketch.add_hashes(hashes.data(), hashes.size());
+  const auto buffer = sketch.serialize();
+  ASSERT_TRUE(llb::LogLogBetaView(buffer.data(), buffer.size()).valid());
+
+  // an overflow count whose size in bytes wraps around to the real size
+  auto corrupt = buffer;
+  uint64_t overflow_count;
+  std::memcpy(&overflow_count, &corrupt[k_overflow_count_offset],
+              sizeof(overflow_count));
+  overflow_count += 1UL << 62;
+  std::memcpy(&corrupt[k_overflow_count_offset], &overflow_count,
+              sizeof(overflow_count));
+  ASSERT_FALSE(llb::LogLogBetaView(corrupt.data(), corrupt.size()).valid());
+
+  // packed4 ranks past 63
+  corrupt = buffer;
+  corrupt[k_base_offset] = 49;
+  ASSERT_FALSE(llb::LogLogBetaView(corrupt.data(), corrupt.size()).valid());
+  corrupt[k_base_offset] = 48;
+  ASSERT_TRUE(llb::LogLogBetaView(corrupt.data(), corrupt.size()).valid());
+
+  // entries past the last register are rejected before anything is merged
+  llb::LogLogBeta sparse{error_rate_for(14), llb::Representation::sparse};
+  sparse.add_hashes(hashes.data(), 100);
+  corrupt = sparse.serialize();
+  corrupt[k_precision_offset] = 8;
+  llb::LogLogBeta merged{error_rate_for(10)};
+  merged.add_hashes(hashes.data(), hashes.size());
+  llb::LogLogBeta expected{error_rate_for(10)};
+  expected.add_hashes(hashes.data(), hashes.size());
+  ASSERT_FALSE(
+      merged.merge(llb::LogLogBetaView(corrupt.data(), corrupt.size())));
+  ASSERT_EQ(10U, merged.precision_bits());
+  assert_same_registers(expected, merged);
+}
+
+TEST(LogLogBetaChanges, Replicate) {
+  for (const auto representation :
+       {llb::Representation::sparse, llb::Representation::dense}) {
+    for (const auto layout :
+         {llb::RegisterLayout::byte, llb::RegisterLayout::packed6,
+          llb::RegisterLayout::packed4}) {
+      llb::LogLogBeta primary{error_rate_for(14), representation, layout};
+      primary.set_incremental_estimate(true);
+      primary.set_change_tracking(true);
+      llb::LogLogBeta replica{error_rate_for(14), representation, layout};
+
+      // adds, then a merge, then a fold, each shipped as a delta
+      for (auto round = 0UL; round < 4; ++round) {
+        const auto hashes = random_hashes(round == 0 ? 100 : 20000);
+        if (round == 2) {
+          llb::LogLogBeta other{error_rate_for(16)};
+          other.add_hashes(hashes.data(), hashes.size());
+          primary.merge(other);
+        } else {
+          primary.add_hashes(hashes.data(), hashes.size());
+        }
+        if (round == 3) {
+          primary.fold_to(12);
+        }
+
+        const auto changes = primary.serialize_changes();
+        ASSERT_EQ(0UL, primary.changed_register_count());
+        ASSERT_TRUE(
+            replica.merge(llb::LogLogBetaView(changes.data(), changes.size())));
+        assert_same_registers(primary, replica);
+        ASSERT_EQ(primary.cardinality(), replica.cardinality());
+      }
+
+      // nothing raised, nothing sent
+      primary.add_hashes(nullptr, 0);
+      const auto changes = primary.serialize_changes();
+      ASSERT_EQ(0UL, llb::LogLogBetaView(changes.data(), changes.size())
+                         .cardinality());
+    }
+  }
+
+  // a few changes cost a few bytes each
+  llb::LogLogBeta primary{error_rate_for(16)};
+  const auto hashes = random_hashes(1000000);
+  primary.add_hashes(hashes.data(), hashes.size());
+  primary.set_change_tracking(true);
+  const auto churn = random_hashes(100);
+  primary.add_hashes(churn.data(), churn.size());
+  ASSERT_GE(100UL, primary.changed_register_count());
+  ASSERT_GT(64 + 100 * 4, primary.serialize_changes().size());
+  ASSERT_TRUE(llb::LogLogBeta{}.serialize_changes().empty());
+}
+
+TEST(LogLogBetaConcurrent, MatchesSerial) {
+  const auto thread_count = 4UL;
+  const auto hashes = random_hashes(400000);
+
+  llb::LogLogBeta expected{};
+  expected.add_hashes(hashes.data(), hashes.size());
+
+  llb::ConcurrentLogLogBeta concurrent{};
+  std::atomic<bool> done{false};
+  std::thread reader([&]() {
+    auto previous = 0UL;
+    while (!done.load()) {
+      // registers only grow, so estimates can't go backwards
+      const auto estimate = concurrent.cardinality();
+      ASSERT_GE(estimate, previous);
+      previous = estimate;
+    }
+  });
+
+  // every thread adds half of the hashes, so threads race on registers
+  std::vector<std::thread> writers;
+  for (auto thread_ix = 0UL; thread_ix < thread_count; ++thread_ix) {
+    writers.emplace_back([&, thread_ix]() {
+      const auto begin = thread_ix * hashes.size() / thread_count / 2;
+      const auto end = begin + hashes.size() / 2;
+      if (thread_ix % 2 == 0) {
+        concurrent.add_hashes(&hashes[begin], end - begin);
+      } else {
+        for (auto hash_ix = begin; hash_ix < end; ++hash_ix) {
+          concurrent.add_hash(hashes[hash_ix]);
+        }
+      }
+    });
+  }
+  for (auto &writer : writers) {
+    writer.join();
+  }
+  // the last quarter of the hashes
+  concurrent.add_hashes(&hashes[hashes.size() * 3 / 4], hashes.size() / 4);
+  done.store(true);
+  reader.join();
+
+  ASSERT_EQ(expected.register_count(), concurrent.register_count());
+  for (auto register_ix = 0UL; register_ix < expected.register_count();
+       ++register_ix) {
+    ASSERT_EQ(expected.register_at(register_ix),
+              concurrent.register_at(register_ix));
+  }
+  ASSERT_EQ(expected.cardinality(), concurrent.cardinality());
+
+  llb::LogLogBeta snapshot{};
+  concurrent.merge_into(&snapshot);
+  assert_same_registers(expected, snapshot);
+}
+
+TEST(LogLogBetaConcurrent, Merge) {
+  const auto hashes1 = random_hashes(100000);
+  const auto hashes2 = random_hashes(200);
+
+  llb::LogLogBeta expected{};
+  expected.add_hashes(hashes1.data(), hashes1.size());
+  expected.add_hashes(hashes2.data(), hashes2.size());
+
+  llb::LogLogBeta dense{llb::constants::k_default_error_rate,
+                        llb::Representation::dense,
+                        llb::RegisterLayout::packed4};
+  dense.add_hashes(hashes1.data(), hashes1.size());
+  llb::LogLogBeta sparse{llb::constants::k_default_error_rate,
+                         llb::Representation::sparse};
+  sparse.add_hashes(hashes2.data(), hashes2.size());
+
+  llb::ConcurrentLogLogBeta concurrent{};
+  concurrent.merge(dense);
+  concurrent.merge(sparse);
+
+  llb::LogLogBeta snapshot{};
+  concurrent.merge_into(&snapshot);
+  assert_same_registers(expected, snapshot);
+}
+
+TEST(LogLogBetaSharded, MatchesSerial) {
+  const auto hashes = random_hashes(400000);
+  llb::LogLogBeta expected{error_rate_for(16)};
+  expected.add_hashes(hashes.data(), hashes.size());
+
+  // more hashes per producer than the rings hold, so producers wait on them
+  for (const auto shard_count : {1U, 3U, 4U}) {
+    llb::ShardedLogLogBeta sharded{error_rate_for(16), shard_count, 3};
+    // rounded down to a power of two
+    ASSERT_EQ(shard_count == 3 ? 2U : shard_count, sharded.shard_count());
+    std::vector<std::thread> producers;
+    for (auto producer_ix = 0U; producer_ix < 3; ++producer_ix) {
+      producers.emplace_back([&, producer_ix]() {
+        const auto begin = producer_ix * hashes.size() / 3;
+        const auto end = (producer_ix + 1) * hashes.size() / 3;
+        for (auto hash_ix = begin; hash_ix < end; hash_ix += 1000) {
+          sharded.add_hashes(producer_ix, &hashes[hash_ix],
+                             std::min<uint64_t>(1000, end - hash_ix));
+        }
+      });
+    }
+    for (auto &producer : producers) {
+      producer.join();
+    }
+
+    ASSERT_EQ(expected.cardinality(), sharded.cardinality());
+    for (auto register_ix = 0UL; register_ix < expected.register_count();
+         ++register_ix) {
+      ASSERT_EQ(expected.register_at(register_ix),
+                sharded.register_at(register_ix));
+    }
+    llb::LogLogBeta snapshot{error_rate_for(16)};
+    ASSERT_TRUE(sharded.merge_into(&snapshot));
+    assert_same_registers(expected, snapshot);
+  }
+
+  // a shard owns at least a cache line of registers
+  llb::ShardedLogLogBeta small{error_rate_for(8), 64};
+  ASSERT_EQ(4U, small.shard_count());
+}
+
+TEST(LogLogBetaIncremental, MatchesRescan) {
+  const auto hashes = random_hashes(1000000);
+  const auto merged_hashes = random_hashes(20000);
+
+  for (const auto layout :
+       {llb::RegisterLayout::byte, llb::RegisterLayout::packed6,
+        llb::RegisterLayout::packed4}) {
+    for (const auto representation :
+         {llb::Representation::sparse, llb::Representation::dense}) {
+      llb::LogLogBeta llb{llb::constants::k_default_error_rate,
+                          representation, layout};
+      llb.set_incremental_estimate(true);
+      ASSERT_TRUE(llb.incremental_estimate());
+      ASSERT_EQ(llb.cardinality_nonavx(), llb.cardinality());
+
+      // adds one value at a time and then in batches, checking along the way
+      auto hash_ix = 0UL;
+      for (; hash_ix < 5000; ++hash_ix) {
+        llb.add_hash(hashes[hash_ix]);
+        if (hash_ix % 97 == 0) {
+          ASSERT_NEAR(llb.cardinality_nonavx(), llb.cardinality(), 1)
+              << "count: " << hash_ix;
+        }
+      }
+      for (; hash_ix < hashes.size(); hash_ix += 99000) {
+        llb.add_hashes(&hashes[hash_ix],
+                       std::min(99000UL, hashes.size() - hash_ix));
+        ASSERT_NEAR(llb.cardinality_nonavx(), llb.cardinality(), 1)
+            << "count: " << hash_ix;
+      }
+
+      for (const auto merge_layout :
+           {llb::RegisterLayout::byte, llb::RegisterLayout::packed4}) {
+        for (const auto merge_representation :
+             {llb::Representation::sparse, llb::Representation::dense}) {
+          llb::LogLogBeta other{llb::constants::k_default_error_rate,
+                                merge_representation, merge_layout};
+          other.add_hashes(merged_hashes.data(), merged_hashes.size() / 4);
+          llb.merge(other);
+          ASSERT_NEAR(llb.cardinality_nonavx(), llb.cardinality(), 1);
+        }
+      }
+
+      // turning it on later picks up the registers as they are
+      llb::LogLogBeta late{llb::constants::k_default_error_rate,
+                           representation, layout};
+      late.add_hashes(hashes.data(), 10000);
+      late.set_incremental_estimate(true);
+      late.add_hashes(&hashes[10000], 10000);
+      ASSERT_NEAR(late.cardinality_nonavx(), late.cardinality(), 1);
+
+      // deserializing keeps the setting and resyncs
+      const auto serialized = llb.serialize();
+      ASSERT_TRUE(late.deserialize(serialized.data(), serialized.size()));
+      ASSERT_TRUE(late.incremental_estimate());
+      ASSERT_EQ(llb.cardinality(), late.cardinality());
+    }
+  }
+}
+
+TEST(LogLogBetaMergeAll, MatchesPairwise) {
+  for (const auto layout :
+       {llb::RegisterLayout::byte, llb::RegisterLayout::packed6,
+        llb::RegisterLayout::packed4}) {
+    // mixes sparse, dense and other layout sketches
+    std::vector<std::unique_ptr<llb::LogLogBeta>> sketches;
+    for (auto sketch_ix = 0UL; sketch_ix < 24; ++sketch_ix) {
+      const auto representation = sketch_ix % 5 == 0
+                                      ? llb::Representation::sparse
+                                      : llb::Representation::dense;
+      const auto sketch_layout =
+          sketch_ix % 7 == 0 ? llb::RegisterLayout::byte : layout;
+      sketches.emplace_back(new llb::LogLogBeta{
+          llb::constants::k_default_error_rate, representation,
+          sketch_layout});
+      const auto hashes = random_hashes(sketch_ix % 5 == 0 ? 500 : 20000);
+      sketches.back()->add_hashes(hashes.data(), hashes.size());
+    }
+    std::vector<const llb::LogLogBeta *> inputs;
+    for (const auto &sketch : sketches) {
+      inputs.push_back(sketch.get());
+    }
+
+    for (const auto instruction_set : supported_instruction_sets()) {
+      ASSERT_TRUE(llb::set_instruction_set(instruction_set));
+      for (const auto representation :
+           {llb::Representation::sparse, llb::Representation::dense}) {
+        llb::LogLogBeta expected{llb::constants::k_default_error_rate,
+                                 representation, layout};
+        llb::LogLogBeta merged{llb::constants::k_default_error_rate,
+                               representation, layout};
+        for (const auto &sketch : sketches) {
+          expected.merge(*sketch);
+        }
+        merged.merge_all(inputs);
+        assert_same_registers(expected, merged);
+      }
+
+      llb::LogLogBeta expected{llb::constants::k_default_error_rate,
+                               llb::Representation::dense, layout};
+      expected.merge_all(inputs);
+      ASSERT_NEAR(expected.cardinality(),
+                  llb::LogLogBeta::union_cardinality(inputs), 1)
+          << llb::instruction_set_name(instruction_set);
+
+      // all dense and of one layout takes the tiled path
+      std::vector<const llb::LogLogBeta *> dense;
+      llb::LogLogBeta dense_expected{llb::constants::k_default_error_rate,
+                                     llb::Representation::dense, layout};
+      for (const auto *sketch : inputs) {
+        if (!sketch->is_sparse() && sketch->layout() == layout) {
+          dense.push_back(sketch);
+          dense_expected.merge(*sketch);
+        }
+      }
+      ASSERT_NEAR(dense_expected.cardinality(),
+                  llb::LogLogBeta::union_cardinality(dense), 1)
+          << llb::instruction_set_name(instruction_set);
+    }
+    llb::set_instruction_set(llb::detected_instruction_set());
+  }
+  ASSERT_EQ(0UL, llb::LogLogBeta::union_cardinality(nullptr, 0));
+}
+
+TEST(LogLogBetaParallel, MatchesSerial) {
+  // four chunks per sketch
+  const auto error_rate = error_rate_for(18);
+  llb::ThreadPool pool{4};
+  pool.set_min_parallel_registers(0);
+  ASSERT_EQ(4U, pool.thread_count());
+
+  for (const auto layout :
+       {llb::RegisterLayout::byte, llb::RegisterLayout::packed6,
+        llb::RegisterLayout::packed4}) {
+    std::vector<std::unique_ptr<llb::LogLogBeta>> sketches;
+    std::vector<const llb::LogLogBeta *> inputs;
+    for (auto sketch_ix = 0UL; sketch_ix < 6; ++sketch_ix) {
+      sketches.emplace_back(new llb::LogLogBeta{
+          error_rate, llb::Representation::dense, layout});
+      const auto hashes = random_hashes(200000);
+      sketches.back()->add_hashes(hashes.data(), hashes.size());
+      inputs.push_back(sketches.back().get());
+    }
+    ASSERT_EQ(1UL << 18, sketches[0]->register_count());
+
+    ASSERT_NEAR(sketches[0]->cardinality(), sketches[0]->cardinality(pool), 1);
+
+    llb::LogLogBeta expected{error_rate, llb::Representation::dense, layout};
+    llb::LogLogBeta merged{error_rate, llb::Representation::dense, layout};
+    for (const auto *sketch : inputs) {
+      expected.merge(*sketch);
+      merged.merge(*sketch, pool);
+    }
+    assert_same_registers(expected, merged);
+
+    llb::LogLogBeta merged_all{error_rate, llb::Representation::sparse,
+                               layout};
+    merged_all.set_incremental_estimate(true);
+    merged_all.merge_all(inputs.data(), inputs.size(), pool);
+    assert_same_registers(expected, merged_all);
+    ASSERT_NEAR(expected.cardinality(), merged_all.cardinality(), 1);
+
+    ASSERT_NEAR(
+        llb::LogLogBeta::union_cardinality(inputs),
+        llb::LogLogBeta::union_cardinality(inputs.data(), inputs.size(), pool),
+        1);
+  }
+
+  // every task runs exactly once
+  std::atomic<uint64_t> tasks{0};
+  pool.run(100, [&](uint64_t) { tasks += 1; });
+  ASSERT_EQ(100UL, tasks.load());
+}
+
+TEST(LogLogBetaFold, MatchesLowerPrecision) {
+  for (const auto count : {300UL, 100000UL}) {
+    const auto hashes = random_hashes(count);
+    for (const auto layout :
+         {llb::RegisterLayout::byte, llb::RegisterLayout::packed6,
+          llb::RegisterLayout::packed4}) {
+      for (const auto representation :
+           {llb::Representation::sparse, llb::Representation::dense}) {
+        // folding by 1 bit up to folding by more than a 64 register group
+        for (const auto precision_bits : {15U, 12U, 9U}) {
+          llb::LogLogBeta expected{error_rate_for(precision_bits),
+                                   representation, layout};
+          expected.add_hashes(hashes.data(), hashes.size());
+
+          llb::LogLogBeta folded{error_rate_for(16), representation, layout};
+          folded.add_hashes(hashes.data(), hashes.size());
+          ASSERT_TRUE(folded.fold_to(precision_bits));
+          ASSERT_EQ(precision_bits, folded.precision_bits());
+          assert_same_registers(expected, folded);
+          ASSERT_EQ(expected.cardinality(), folded.cardinality());
+        }
+
+        llb::LogLogBeta llb{error_rate_for(12), representation, layout};
+        ASSERT_FALSE(llb.fold_to(13));
+        ASSERT_FALSE(llb.fold_to(llb::constants::k_minimum_precision - 1));
+        ASSERT_TRUE(llb.fold_to(12));
+      }
+    }
+  }
+}
+
+TEST(LogLogBetaFold, MergeAcrossPrecisions) {
+  const auto hashes1 = random_hashes(100000);
+  const auto hashes2 = random_hashes(2000);
+
+  for (const auto instruction_set : supported_instruction_sets()) {
+    ASSERT_TRUE(llb::set_instruction_set(instruction_set));
+    for (const auto layout :
+         {llb::RegisterLayout::byte, llb::RegisterLayout::packed4}) {
+      for (const auto representation :
+           {llb::Representation::sparse, llb::Representation::dense}) {
+        llb::LogLogBeta expected{error_rate_for(12),
+                                 llb::Representation::dense, layout};
+        expected.add_hashes(hashes1.data(), hashes1.size());
+        expected.add_hashes(hashes2.data(), hashes2.size());
+
+        for (const auto precise_bits : {13U, 16U, 20U}) {
+          llb::LogLogBeta coarse{error_rate_for(12),
+                                 llb::Representation::dense, layout};
+          coarse.add_hashes(hashes1.data(), hashes1.size());
+          llb::LogLogBeta precise{error_rate_for(precise_bits), representation,
+                                  layout};
+          precise.add_hashes(hashes2.data(), hashes2.size());
+
+          // folds the input on the fly
+          llb::LogLogBeta merged{error_rate_for(12),
+                                 llb::Representation::dense, layout};
+          merged.add_hashes(hashes1.data(), hashes1.size());
+          merged.merge(precise);
+          assert_same_registers(expected, merged);
+
+          // folds this sketch first
+          precise.merge(coarse);
+          ASSERT_EQ(12U, precise.precision_bits());
+          assert_same_registers(expected, precise);
+        }
+
+        // views of other precisions, registers or entries, and concurrent
+        // sketches fold their inputs the same way
+        llb::LogLogBeta precise{error_rate_for(18), representation, layout};
+        precise.add_hashes(hashes2.data(), hashes2.size());
+        for (const auto compress : {false, true}) {
+          const auto serialized = precise.serialize(compress);
+          const llb::LogLogBetaView view{serialized.data(), serialized.size()};
+          llb::LogLogBeta merged{error_rate_for(12),
+                                 llb::Representation::dense, layout};
+          merged.add_hashes(hashes1.data(), hashes1.size());
+          ASSERT_TRUE(merged.merge(view));
+          assert_same_registers(expected, merged);
+        }
+
+        llb::ConcurrentLogLogBeta concurrent{error_rate_for(12)};
+        concurrent.add_hashes(hashes1.data(), hashes1.size());
+        ASSERT_TRUE(concurrent.merge(precise));
+        llb::LogLogBeta snapshot{error_rate_for(20)};
+        concurrent.merge_into(&snapshot);
+        assert_same_registers(expected, snapshot);
+        ASSERT_FALSE(llb::ConcurrentLogLogBeta{error_rate_for(14)}.merge(
+            expected));
+      }
+    }
+  }
+  llb::set_instruction_set(llb::detected_instruction_set());
+}
+
+TEST(LogLogBetaMove, TakesRegisters) {
+  const auto hashes = random_hashes(20000);
+  for (const auto representation :
+       {llb::Representation::sparse, llb::Representation::dense}) {
+    llb::LogLogBeta expected{llb::constants::k_default_error_rate,
+                             representation, llb::RegisterLayout::packed4};
+    expected.add_hashes(hashes.data(), 300);
+    llb::LogLogBeta llb{llb::constants::k_default_error_rate, representation,
+                        llb::RegisterLayout::packed4};
+    llb.add_hashes(hashes.data(), 300);
+
+    llb::LogLogBeta moved{std::move(llb)};
+    assert_same_registers(expected, moved);
+    ASSERT_TRUE(llb.is_sparse());
+    ASSERT_EQ(0UL, llb.cardinality());
+
+    // the moved from sketch is still usable
+    llb.add_hashes(hashes.data(), hashes.size());
+    moved = std::move(llb);
+    expected.add_hashes(hashes.data(), hashes.size());
+    assert_same_registers(expected, moved);
+    ASSERT_EQ(expected.cardinality(), moved.cardinality());
+  }
+
+  // growing a vector of sketches moves them
+  llb::LogLogBeta expected;
+  expected.add_hashes(hashes.data(), 1000);
+  std::vector<llb::LogLogBeta> sketches;
+  for (auto sketch_ix = 0UL; sketch_ix < 100; ++sketch_ix) {
+    sketches.emplace_back();
+    sketches.back().add_hashes(hashes.data(), 1000);
+  }
+  for (const auto &sketch : sketches) {
+    assert_same_registers(expected, sketch);
+  }
+}
+
+TEST(LogLogBetaArena, MatchesHeap) {
+  const auto hashes = random_hashes(100000);
+  llb::LogLogBetaArena arena{1UL << 16};
+  for (const auto layout :
+       {llb::RegisterLayout::byte, llb::RegisterLayout::packed6,
+        llb::RegisterLayout::packed4}) {
+    for (const auto representation :
+         {llb::Representation::sparse, llb::Representation::dense}) {
+      llb::LogLogBeta expected{llb::constants::k_default_error_rate,
+                               representation, layout};
+      expected.add_hashes(hashes.data(), hashes.size());
+      llb::LogLogBeta llb{arena, llb::constants::k_default_error_rate,
+                          representation, layout};
+      llb.add_hashes(hashes.data(), hashes.size());
+      assert_same_registers(expected, llb);
+      ASSERT_EQ(expected.cardinality(), llb.cardinality());
+
+      llb::LogLogBeta merged{arena, error_rate_for(12), representation,
+                             layout};
+      merged.merge(llb);
+      expected.fold_to(12);
+      assert_same_registers(expected, merged);
+    }
+  }
+  ASSERT_EQ(0UL, arena.used_bytes());
+}
+
+TEST(LogLogBetaArena, ReusesBlocks) {
+  const auto hashes = random_hashes(100);
+  llb::LogLogBetaArena arena;
+  {
+    std::vector<llb::LogLogBeta> sketches;
+    for (auto sketch_ix = 0UL; sketch_ix < 1000; ++sketch_ix) {
+      sketches.emplace_back(arena, error_rate_for(10));
+      sketches.back().add_hash(sketch_ix);
+    }
+    ASSERT_LE(1000UL * 1024, arena.used_bytes());
+  }
+  ASSERT_EQ(0UL, arena.used_bytes());
+  const auto reserved_bytes = arena.reserved_bytes();
+
+  // freed blocks are reused by sketches of the same size
+  llb::LogLogBeta expected10{error_rate_for(10)};
+  expected10.add_hashes(hashes.data(), hashes.size());
+  for (auto window = 0; window < 3; ++window) {
+    std::vector<llb::LogLogBeta> sketches;
+    for (auto sketch_ix = 0UL; sketch_ix < 1000; ++sketch_ix) {
+      sketches.emplace_back(arena, error_rate_for(10));
+      sketches.back().add_hashes(hashes.data(), hashes.size());
+      ASSERT_EQ(expected10.cardinality(), sketches.back().cardinality());
+    }
+    ASSERT_EQ(reserved_bytes, arena.reserved_bytes());
+  }
+
+  // as are the slabs after a reset, whatever the sizes
+  arena.reset();
+  llb::LogLogBeta expected12{error_rate_for(12)};
+  expected12.add_hashes(hashes.data(), hashes.size());
+  std::vector<llb::LogLogBeta> sketches;
+  for (auto sketch_ix = 0UL; sketch_ix < 250; ++sketch_ix) {
+    sketches.emplace_back(arena, error_rate_for(12));
+    sketches.back().add_hashes(hashes.data(), hashes.size());
+    ASSERT_EQ(expected12.cardinality(), sketches.back().cardinality());
+  }
+  ASSERT_EQ(reserved_bytes, arena.reserved_bytes());
+}
+
+// keys drawing from 1 to 50000 values each, shuffled together
+std::vector<std::pair<uint64_t, uint64_t>> keyed_hashes(uint64_t key_count) {
+  std::vector<std::pair<uint64_t, uint64_t>> values;
+  for (auto key = 0UL; key < key_count; ++key) {
+    const auto hashes = random_hashes(key % 10 == 0 ? 50000 : key + 1);
+    for (const auto hash : hashes) {
+      values.emplace_back(key * 7919, hash);
+    }
+  }
+  std::mt19937_64 generator{42};
+  std::shuffle(values.begin(), values.end(), generator);
+  return values;
+}
+
+TEST(LogLogBetaMapped, Reopens) {
+  const auto path = testing::TempDir() + "llb_mapped_registers";
+  std::remove(path.c_str());
+  const auto hashes = random_hashes(100000);
+  const auto half = hashes.size() / 2;
+  llb::LogLogBeta expected{error_rate_for(12), llb::Representation::dense,
+                           llb::RegisterLayout::packed6};
+  expected.add_hashes(hashes.data(), half);
+  {
+    llb::MappedRegisterFile file;
+    ASSERT_TRUE(file.open(path, 12, 4, llb::RegisterLayout::packed6));
+    llb::LogLogBeta sketch{file, 2};
+    sketch.add_hashes(hashes.data(), half);
+    ASSERT_TRUE(file.checkpoint());
+  }
+
+  llb::MappedRegisterFile file;
+  ASSERT_FALSE(file.open(path, 14, 4, llb::RegisterLayout::packed6));
+  ASSERT_FALSE(file.open(path, 12, 4, llb::RegisterLayout::byte));
+  ASSERT_FALSE(file.open(path, 12, 4, llb::RegisterLayout::packed6,
+                         llb::Hasher{llb::HashFunction::xxh3, 1}));
+  ASSERT_FALSE(file.is_open());
+
+  // reopened with more slots, the sketch is back as it was
+  ASSERT_TRUE(file.open(path, 12, 8, llb::RegisterLayout::packed6));
+  ASSERT_EQ(8UL, file.slot_count());
+  {
+    llb::LogLogBeta sketch{file, 2};
+    assert_same_registers(expected, sketch);
+    sketch.add_hashes(&hashes[half], hashes.size() - half);
+    expected.add_hashes(&hashes[half], hashes.size() - half);
+    file.set_hot(0, 8);
+    file.set_cold(2, 1);
+    assert_same_registers(expected, sketch);
+    ASSERT_EQ(0UL, llb::LogLogBeta(file, 7).cardinality());
+
+    // folding moves the registers off the file, leaving the slot alone
+    llb::LogLogBeta folded{file, 2};
+    ASSERT_TRUE(folded.fold_to(10));
+    ASSERT_EQ(10U, folded.precision_bits());
+    assert_same_registers(expected, llb::LogLogBeta(file, 2));
+  }
+  file.close();
+  std::remove(path.c_str());
+}
+
+TEST(LogLogBetaStats, CountsOperations) {
+  const auto hashes = random_hashes(10000);
+  // raises counted by comparing registers before and after each add
+  llb::LogLogBeta reference{error_rate_for(12)};
+  auto raises = 0UL;
+  for (const auto hash : hashes) {
+    const auto index = hash >> 52;
+    const auto before = reference.register_at(index);
+    reference.add_hash(hash);
+    raises += reference.register_at(index) != before ? 1UL : 0UL;
+  }
+
+  const auto before = llb::thread_stats();
+  const auto process_before = llb::process_stats();
+  llb::LogLogBeta llb{error_rate_for(12)};
+  llb.add_hashes(hashes.data(), hashes.size());
+  llb.add_hash(hashes[0]);
+  llb::LogLogBeta merged{error_rate_for(12)};
+  merged.merge(llb);
+  merged.cardinality();
+  std::thread{[&hashes]() {
+    llb::LogLogBeta other{error_rate_for(12)};
+    other.add_hashes(hashes.data(), 100);
+  }}.join();
+  const auto after = llb::thread_stats();
+  const auto process_after = llb::process_stats();
+
+  if (!llb::k_stats_enabled) {
+    ASSERT_EQ(0UL, after.hashes_added);
+    ASSERT_EQ(0UL, process_after.merges);
+    return;
+  }
+  ASSERT_EQ(hashes.size() + 1, after.hashes_added - before.hashes_added);
+  ASSERT_EQ(raises, after.registers_raised - before.registers_raised);
+  ASSERT_EQ(1UL, after.merges - before.merges);
+  ASSERT_EQ(1UL, after.cardinalities - before.cardinalities);
+  ASSERT_LT(0UL, after.merge_cycles - before.merge_cycles);
+  ASSERT_LT(0UL, after.cardinality_cycles - before.cardinality_cycles);
+  const auto active = static_cast<uint32_t>(llb::active_instruction_set());
+  ASSERT_EQ(2UL, after.kernel_runs[active] - before.kernel_runs[active]);
+  // the exited thread's hashes are still counted
+  ASSERT_LE(hashes.size() + 101,
+            process_after.hashes_added - process_before.hashes_added);
+}
+
+TEST(LogLogBetaTable, MatchesSketchPerKey) {
+  const auto values = keyed_hashes(40);
+  for (const auto representation :
+       {llb::Representation::sparse, llb::Representation::dense}) {
+    llb::LogLogBetaTable table{error_rate_for(12), representation};
+    std::unordered_map<uint64_t, llb::LogLogBeta> expected;
+    std::vector<uint64_t> keys;
+    std::vector<uint64_t> hashes;
+    for (const auto &value : values) {
+      keys.push_back(value.first);
+      hashes.push_back(value.second);
+      expected.emplace(value.first, error_rate_for(12))
+          .first->second.add_hash(value.second);
+    }
+    table.add_hashes(keys.data(), hashes.data(), keys.size() / 2);
+    for (auto value_ix = keys.size() / 2; value_ix < keys.size(); ++value_ix) {
+      table.add_hash(keys[value_ix], hashes[value_ix]);
+    }
+
+    ASSERT_EQ(expected.size(), table.key_count());
+    for (const auto &key_sketch : expected) {
+      for (auto index = 0UL; index < table.register_count(); ++index) {
+        ASSERT_EQ(key_sketch.second.register_at(index),
+                  table.register_at(key_sketch.first, index));
+      }
+      ASSERT_EQ(key_sketch.second.cardinality(),
+                table.cardinality(key_sketch.first));
+    }
+    ASSERT_EQ(representation == llb::Representation::sparse,
+              table.is_sparse(7919));
+    ASSERT_FALSE(table.is_sparse(0));
+    ASSERT_FALSE(table.contains(1));
+    ASSERT_EQ(0UL, table.cardinality(1));
+  }
+}
+
+TEST(LogLogBetaTable, Merge) {
+  const auto values = keyed_hashes(30);
+  llb::LogLogBetaTable expected{error_rate_for(12)};
+  llb::LogLogBetaTable first{error_rate_for(12)};
+  llb::LogLogBetaTable second{error_rate_for(12)};
+  for (auto value_ix = 0UL; value_ix < values.size(); ++value_ix) {
+    const auto &value = values[value_ix];
+    expected.add_hash(value.first, value.second);
+    // the second table doesn't see every key
+    if (value_ix % 3 == 0 && value.first % 2 == 0) {
+      second.add_hash(value.first, value.second);
+    } else {
+      first.add_hash(value.first, value.second);
+    }
+  }
+
+  ASSERT_TRUE(first.merge(second));
+  // merging a table into itself changes nothing
+  ASSERT_TRUE(first.merge(first));
+  ASSERT_EQ(expected.key_count(), first.key_count());
+  for (const auto key : expected.keys()) {
+    for (auto index = 0UL; index < expected.register_count(); ++index) {
+      ASSERT_EQ(expected.register_at(key, index),
+                first.register_at(key, index));
+    }
+  }
+
+  llb::LogLogBetaTable other_precision{error_rate_for(14)};
+  ASSERT_FALSE(first.merge(other_precision));
+}
+
+TEST(LogLogBetaTable, TopK) {
+  const auto values = keyed_hashes(100);
+  llb::LogLogBetaTable table;
+  for (const auto &value : values) {
+    table.add_hash(value.first, value.second);
+  }
+
+  const auto top = table.top_k(10);
+  ASSERT_EQ(10UL, top.size());
+  for (const auto &key_cardinality : top) {
+    // every tenth key has 50000 values, the rest at most 100
+    ASSERT_EQ(0UL, key_cardinality.first / 7919 % 10);
+    ASSERT_EQ(table.cardinality(key_cardinality.first),
+              key_cardinality.second);
+  }
+  for (auto top_ix = 1UL; top_ix < top.size(); ++top_ix) {
+    ASSERT_GE(top[top_ix - 1].second, top[top_ix].second);
+  }
+  ASSERT_EQ(100UL, table.top_k(1000).size());
+}
+
+TEST(SlidingLogLogBeta, MatchesWindowSketch) {
+  // 100 values per tick for 1000 ticks, optionally added out of order
+  const auto hashes = random_hashes(100000);
+  std::vector<uint64_t> timestamps;
+  for (auto hash_ix = 0UL; hash_ix < hashes.size(); ++hash_ix) {
+    timestamps.push_back(hash_ix / 100);
+  }
+  std::vector<uint64_t> order(hashes.size());
+  for (auto ix = 0UL; ix < order.size(); ++ix) {
+    order[ix] = ix;
+  }
+
+  for (const auto shuffled : {false, true}) {
+    if (shuffled) {
+      std::mt19937_64 generator{7};
+      std::shuffle(order.begin(), order.end(), generator);
+    }
+    llb::SlidingLogLogBeta sliding{1000, error_rate_for(12)};
+    std::vector<uint64_t> ordered_hashes;
+    std::vector<uint64_t> ordered_timestamps;
+    for (const auto ix : order) {
+      ordered_hashes.push_back(hashes[ix]);
+      ordered_timestamps.push_back(timestamps[ix]);
+    }
+    sliding.add_hashes(ordered_hashes.data(), ordered_timestamps.data(),
+                       ordered_hashes.size() / 2);
+    for (auto ix = ordered_hashes.size() / 2; ix < ordered_hashes.size();
+         ++ix) {
+      sliding.add_hash(ordered_hashes[ix], ordered_timestamps[ix]);
+    }
+    ASSERT_EQ(999UL, sliding.latest_timestamp());
+
+    // later nows slide the window past the latest values
+    for (const auto now : {999UL, 1500UL}) {
+      for (const auto window : {1UL, 10UL, 100UL, 1000UL}) {
+        llb::LogLogBeta expected{error_rate_for(12)};
+        for (auto hash_ix = 0UL; hash_ix < hashes.size(); ++hash_ix) {
+          if (timestamps[hash_ix] <= now &&
+              timestamps[hash_ix] + window > now) {
+            expected.add_hash(hashes[hash_ix]);
+          }
+        }
+
+        llb::LogLogBeta merged{error_rate_for(12)};
+        ASSERT_TRUE(sliding.merge_into(window, now, &merged));
+        assert_same_registers(expected, merged);
+        ASSERT_EQ(expected.cardinality(), sliding.cardinality(window, now));
+      }
+    }
+    llb::LogLogBeta other_precision{error_rate_for(14)};
+    ASSERT_FALSE(sliding.merge_into(10, 999, &other_precision));
+  }
+}
+
+TEST(SlidingLogLogBeta, Expires) {
+  const auto hashes = random_hashes(100000);
+  llb::SlidingLogLogBeta sliding{10, error_rate_for(12)};
+  llb::LogLogBeta expected{error_rate_for(12)};
+  for (auto hash_ix = 0UL; hash_ix < hashes.size(); ++hash_ix) {
+    sliding.add_hash(hashes[hash_ix], hash_ix / 100);
+    if (hash_ix / 100 > 989) {
+      expected.add_hash(hashes[hash_ix]);
+    }
+  }
+
+  // windows past the largest one count from it
+  ASSERT_EQ(expected.cardinality(), sliding.cardinality(10));
+  ASSERT_EQ(expected.cardinality(), sliding.cardinality(1000));
+  ASSERT_EQ(0UL, sliding.cardinality(1000, 2000));
+  ASSERT_EQ(expected.cardinality(), sliding.cardinality(10, 0));
+}
+
+TEST(LogLogBetaJoint, InclusionExclusion) {
+  const auto shared = random_hashes(20000);
+  const auto a_only = random_hashes(50000);
+  const auto b_only = random_hashes(300);
+
+  for (const auto instruction_set : supported_instruction_sets()) {
+    ASSERT_TRUE(llb::set_instruction_set(instruction_set));
+    for (const auto layout :
+         {llb::RegisterLayout::byte, llb::RegisterLayout::packed4}) {
+      for (const auto b_precision : {14U, 16U}) {
+        llb::LogLogBeta a{error_rate_for(14), llb::Representation::dense,
+                          layout};
+        a.add_hashes(shared.data(), shared.size());
+        a.add_hashes(a_only.data(), a_only.size());
+        llb::LogLogBeta b{error_rate_for(b_precision),
+                          llb::Representation::sparse};
+        b.add_hashes(shared.data(), shared.size());
+        b.add_hashes(b_only.data(), b_only.size());
+
+        // the same as estimating each and the union separately
+        llb::LogLogBeta a_folded{error_rate_for(14)};
+        a_folded.merge(a);
+        llb::LogLogBeta b_folded{error_rate_for(14)};
+        b_folded.merge(b);
+        llb::LogLogBeta merged{error_rate_for(14)};
+        merged.merge(a);
+        merged.merge(b);
+        const auto a_cardinality = a_folded.cardinality();
+        const auto b_cardinality = b_folded.cardinality();
+        const auto union_cardinality = merged.cardinality();
+        ASSERT_EQ(a_cardinality + b_cardinality - union_cardinality,
+                  llb::LogLogBeta::intersection_cardinality(a, b));
+        ASSERT_EQ(union_cardinality - b_cardinality,
+                  llb::LogLogBeta::difference_cardinality(a, b));
+        ASSERT_EQ(union_cardinality - a_cardinality,
+                  llb::LogLogBeta::difference_cardinality(b, a));
+      }
+    }
+  }
+  llb::set_instruction_set(llb::detected_instruction_set());
+
+  // disjoint sketches clamp at 0 rather than going negative
+  llb::LogLogBeta a;
+  a.add_hashes(a_only.data(), a_only.size());
+  llb::LogLogBeta b;
+  b.add_hashes(shared.data(), shared.size());
+  const auto intersection = llb::LogLogBeta::intersection_cardinality(a, b);
+  ASSERT_LT(intersection, 2000UL);
+  const llb::LogLogBeta empty;
+  ASSERT_EQ(0UL, llb::LogLogBeta::intersection_cardinality(a, empty));
+}
+
+TEST(LogLogBetaJoint, MaximumLikelihood) {
+  // small overlaps of large sets, where inclusion exclusion is noisy
+  auto inclusion_exclusion_error = 0.0;
+  auto maximum_likelihood_error = 0.0;
+  auto difference_error = 0.0;
+  for (auto trial = 0; trial < 10; ++trial) {
+    const auto shared = random_hashes(2000);
+    const auto a_only = random_hashes(100000);
+    const auto b_only = random_hashes(50000);
+    llb::LogLogBeta a;
+    a.add_hashes(shared.data(), shared.size());
+    a.add_hashes(a_only.data(), a_only.size());
+    llb::LogLogBeta b;
+    b.add_hashes(shared.data(), shared.size());
+    b.add_hashes(b_only.data(), b_only.size());
+
+    inclusion_exclusion_error +=
+        std::abs(static_cast<double>(
+                     llb::LogLogBeta::intersection_cardinality(a, b)) -
+                 2000.0) /
+        2000.0;
+    maximum_likelihood_error +=
+        std::abs(static_cast<double>(llb::LogLogBeta::intersection_cardinality(
+                     a, b, llb::JointEstimator::maximum_likelihood)) -
+                 2000.0) /
+        2000.0;
+    difference_error +=
+        std::abs(static_cast<double>(llb::LogLogBeta::difference_cardinality(
+                     a, b, llb::JointEstimator::maximum_likelihood)) -
+                 100000.0) /
+        100000.0;
+  }
+  ASSERT_LT(maximum_likelihood_error, inclusion_exclusion_error);
+  ASSERT_LT(maximum_likelihood_error / 10, 0.25);
+  ASSERT_LT(difference_error / 10, 0.02);
+}
+
+TEST(LogLogBetaHistogram, MatchesRegisters) {
+  for (const auto count : {100UL, 10000UL, 1000000UL}) {
+    auto hashes = random_hashes(count);
+    // ranks far above the rest, counted outside the vector lanes
+    hashes.push_back(1UL << 63);
+    hashes.push_back(1UL << 20);
+    for (const auto layout :
+         {llb::RegisterLayout::byte, llb::RegisterLayout::packed6,
+          llb::RegisterLayout::packed4}) {
+      llb::LogLogBeta llb{llb::constants::k_default_error_rate,
+                          llb::Representation::sparse, layout};
+      llb.add_hashes(hashes.data(), hashes.size());
+
+      uint64_t expected[llb::constants::k_rank_histogram_size] = {};
+      for (auto register_ix = 0UL; register_ix < llb.register_count();
+           ++register_ix) {
+        expected[llb.register_at(register_ix)] += 1;
+      }
+      for (const auto instruction_set : supported_instruction_sets()) {
+        ASSERT_TRUE(llb::set_instruction_set(instruction_set));
+        uint64_t histogram[llb::constants::k_rank_histogram_size];
+        llb.rank_histogram(histogram);
+        for (auto rank = 0U; rank < llb::constants::k_rank_histogram_size;
+             ++rank) {
+          ASSERT_EQ(expected[rank], histogram[rank])
+              << llb::instruction_set_name(instruction_set)
+              << " count: " << count << " rank: " << rank;
+        }
+        ASSERT_NEAR(llb.cardinality_nonavx(),
+                    llb.cardinality(llb::Estimator::loglog_beta), 1);
+      }
+      llb::set_instruction_set(llb::detected_instruction_set());
+    }
+  }
+}
+
+TEST(LogLogBetaEstimator, Batch) {
+  // every representation and layout, more sketches than one batch
+  std::vector<std::unique_ptr<llb::LogLogBeta>> sketches;
+  std::vector<const llb::LogLogBeta *> inputs;
+  for (auto sketch_ix = 0UL; sketch_ix < 300; ++sketch_ix) {
+    const auto layout = static_cast<llb::RegisterLayout>(sketch_ix % 3);
+    const auto representation = sketch_ix % 5 == 0
+                                    ? llb::Representation::sparse
+                                    : llb::Representation::dense;
+    sketches.emplace_back(new llb::LogLogBeta{
+        error_rate_for(sketch_ix % 2 == 0 ? 12 : 16), representation,
+        layout});
+    sketches.back()->set_incremental_estimate(sketch_ix % 7 == 0);
+    const auto hashes = random_hashes(sketch_ix * 20);
+    sketches.back()->add_hashes(hashes.data(), hashes.size());
+    inputs.push_back(sketches.back().get());
+  }
+
+  std::vector<uint64_t> cardinalities(inputs.size());
+  llb::LogLogBeta::cardinality_batch(inputs, cardinalities.data());
+  for (auto sketch_ix = 0UL; sketch_ix < inputs.size(); ++sketch_ix) {
+    ASSERT_EQ(inputs[sketch_ix]->cardinality(), cardinalities[sketch_ix]);
+  }
+  llb::LogLogBeta::cardinality_batch(inputs.data(), 0, nullptr);
+}
+
+TEST(LogLogBetaEstimator, Ertl) {
+  for (const auto precision_bits : {10U, 14U, 18U}) {
+    // four standard errors
+    const auto error_limit = 4 * 1.04 / std::sqrt(1UL << precision_bits);
+    for (const auto count : {10UL, 1000UL, 100000UL, 10000000UL}) {
+      const auto hashes = random_hashes(count);
+      llb::LogLogBeta llb{error_rate_for(precision_bits)};
+      llb.add_hashes(hashes.data(), hashes.size());
+      const auto estimate = llb.cardinality(llb::Estimator::ertl);
+      ASSERT_LE(estimate_error(count, estimate), error_limit)
+          << "precision: " << precision_bits << " count: " << count
+          << " estimate: " << estimate;
+    }
+  }
+
+  llb::LogLogBeta empty;
+  ASSERT_EQ(0UL, empty.cardinality(llb::Estimator::ertl));
+}
+
+TEST(LogLogBetaFixed, MatchesRuntime) {
+  for (const auto count : {100UL, 10000UL, 1000000UL}) {
+    const auto hashes = random_hashes(count);
+    auto fixed = std::make_unique<llb::LogLogBetaFixed<14>>();
+    llb::LogLogBeta runtime{error_rate_for(14)};
+    fixed->add_hashes(hashes.data(), hashes.size() / 2);
+    for (auto ix = hashes.size() / 2; ix < hashes.size(); ++ix) {
+      fixed->add_hash(hashes[ix]);
+    }
+    runtime.add_hashes(hashes.data(), hashes.size());
+    for (auto register_ix = 0UL; register_ix < runtime.register_count();
+         ++register_ix) {
+      ASSERT_EQ(runtime.register_at(register_ix),
+                fixed->register_at(register_ix));
+    }
+    ASSERT_EQ(runtime.cardinality(), fixed->cardinality());
+
+    fixed->add("hello world");
+    runtime.add("hello world");
+    ASSERT_EQ(runtime.cardinality(), fixed->cardinality());
+  }
+}
+
+TEST(LogLogBetaFixed, Merge) {
+  const auto first_hashes = random_hashes(50000);
+  const auto second_hashes = random_hashes(50000);
+  auto first = std::make_unique<llb::LogLogBetaFixed<16>>();
+  auto second = std::make_unique<llb::LogLogBetaFixed<16>>();
+  first->add_hashes(first_hashes.data(), first_hashes.size());
+  second->add_hashes(second_hashes.data(), second_hashes.size());
+
+  llb::LogLogBeta expected{error_rate_for(16)};
+  expected.add_hashes(first_hashes.data(), first_hashes.size());
+  expected.add_hashes(second_hashes.data(), second_hashes.size());
+  first->merge(*second);
+  ASSERT_EQ(expected.cardinality(), first->cardinality());
+
+  // merged into a less precise runtime sketch, the fixed one is folded down
+  llb::LogLogBeta runtime{error_rate_for(12)};
+  first->merge_into(runtime);
+  ASSERT_TRUE(expected.fold_to(12));
+  for (auto register_ix = 0UL; register_ix < runtime.register_count();
+       ++register_ix) {
+    ASSERT_EQ(expected.register_at(register_ix),
+              runtime.register_at(register_ix));
+  }
+
+  first->clear();
+  ASSERT_EQ(0UL, first->cardinality());
+}
+
+TEST(LogLogBetaHasher, MatchesBytes) {
+  const auto keys = random_hashes(1003);
+  std::vector<llb::Uuid> uuids(keys.size() - 1);
+  const auto uuid_words = random_hashes(2 * uuids.size());
+  std::memcpy(uuids.data(), uuid_words.data(),
+              uuids.size() * sizeof(llb::Uuid));
+
+  for (const auto function :
+       {llb::HashFunction::xxh3, llb::HashFunction::xxh3_128_low,
+        llb::HashFunction::splitmix64}) {
+    for (const auto seed : {0UL, 12345UL, 0xFFFFFFFF00000001UL}) {
+      const llb::Hasher hasher{function, seed};
+      for (const auto instruction_set : supported_instruction_sets()) {
+        ASSERT_TRUE(llb::set_instruction_set(instruction_set));
+        std::vector<uint64_t> hashes(keys.size());
+        hasher.hash(keys.data(), keys.size(), hashes.data());
+        for (auto key_ix = 0UL; key_ix < keys.size(); ++key_ix) {
+          const auto *bytes =
+              reinterpret_cast<const uint8_t *>(&keys[key_ix]);
+          ASSERT_EQ(hasher.hash(bytes, 8), hashes[key_ix])
+              << llb::instruction_set_name(instruction_set);
+          ASSERT_EQ(hasher.hash(keys[key_ix]), hashes[key_ix]);
+        }
+
+        hasher.hash(uuids.data(), uuids.size(), hashes.data());
+        for (auto key_ix = 0UL; key_ix < uuids.size(); ++key_ix) {
+          ASSERT_EQ(hasher.hash(uuids[key_ix].bytes, 16), hashes[key_ix])
+              << llb::instruction_set_name(instruction_set);
+          ASSERT_EQ(hasher.hash(uuids[key_ix]), hashes[key_ix]);
+        }
+      }
+      llb::set_instruction_set(llb::detected_instruction_set());
+    }
+  }
+
+  const llb::Hasher xxh3{llb::HashFunction::xxh3, 7};
+  const llb::Hasher xxh3_128{llb::HashFunction::xxh3_128_low, 7};
+  for (const auto length : {1UL, 8UL, 16UL, 100UL}) {
+    const auto value = random_string(length);
+    ASSERT_EQ(XXH3_64bits_withSeed(value.data(), length, 7),
+              xxh3.hash(reinterpret_cast<const uint8_t *>(value.data()),
+                        length));
+    ASSERT_EQ(XXH3_128bits_withSeed(value.data(), length, 7).low64,
+              xxh3_128.hash(reinterpret_cast<const uint8_t *>(value.data()),
+                            length));
+  }
+}
+
+TEST(LogLogBetaHasher, TypedKeys) {
+  const auto keys = random_hashes(10000);
+  const llb::Hasher hasher{llb::HashFunction::splitmix64, 99};
+  llb::LogLogBeta batch{error_rate_for(12), llb::Representation::dense,
+                        llb::RegisterLayout::byte, hasher};
+  llb::LogLogBeta single{error_rate_for(12), llb::Representation::dense,
+                         llb::RegisterLayout::byte, hasher};
+  llb::LogLogBeta bytes{error_rate_for(12), llb::Representation::dense,
+                        llb::RegisterLayout::byte, hasher};
+  batch.add_keys(keys.data(), keys.size());
+  for (const auto key : keys) {
+    single.add(key);
+    bytes.add(reinterpret_cast<const uint8_t *>(&key), sizeof(key));
+  }
+  for (auto register_ix = 0UL; register_ix < batch.register_count();
+       ++register_ix) {
+    ASSERT_EQ(bytes.register_at(register_ix),
+              batch.register_at(register_ix));
+    ASSERT_EQ(bytes.register_at(register_ix),
+              single.register_at(register_ix));
+  }
+  ASSERT_LE(estimate_error(keys.size(), batch.cardinality()), 0.1);
+}
+
+TEST(LogLogBetaHasher, RejectsOtherHashers) {
+  const llb::Hasher seeded{llb::HashFunction::xxh3, 1};
+  llb::LogLogBeta plain{error_rate_for(12)};
+  llb::LogLogBeta other{error_rate_for(12), llb::Representation::dense,
+                        llb::RegisterLayout::byte, seeded};
+  for (auto ix = 0; ix < 1000; ++ix) {
+    plain.add(random_string(16));
+    other.add(random_string(16));
+  }
+  const auto plain_cardinality = plain.cardinality();
+
+  ASSERT_FALSE(plain.merge(other));
+  ASSERT_FALSE(plain.merge_all({&other}));
+  ASSERT_EQ(plain_cardinality, plain.cardinality());
+  ASSERT_EQ(0UL, llb::LogLogBeta::union_cardinality({&plain, &other}));
+  ASSERT_EQ(0UL, llb::LogLogBeta::intersection_cardinality(plain, other));
+
+  // the hasher travels with the serialized sketch
+  const auto serialized = other.serialize();
+  const llb::LogLogBetaView view{serialized.data(), serialized.size()};
+  ASSERT_TRUE(view.valid());
+  ASSERT_TRUE(view.hasher() == seeded);
+  ASSERT_FALSE(plain.merge(view));
+  llb::LogLogBeta loaded;
+  ASSERT_TRUE(loaded.deserialize(serialized.data(), serialized.size()));
+  ASSERT_TRUE(loaded.hasher() == seeded);
+  ASSERT_TRUE(loaded.merge(other));
+  ASSERT_TRUE(loaded.merge(view));
+  ASSERT_EQ(other.cardinality(), loaded.cardinality());
+
+  llb::ConcurrentLogLogBeta concurrent{error_rate_for(12)};
+  ASSERT_FALSE(concurrent.merge(other));
+  ASSERT_FALSE(concurrent.merge_into(&other));
+  ASSERT_TRUE(concurrent.merge_into(&plain));
+
+  llb::SlidingLogLogBeta sliding{10, error_rate_for(12)};
+  sliding.add(random_string(16), 1);
+  ASSERT_FALSE(sliding.merge_into(10, 1, &other));
+  ASSERT_TRUE(sliding.merge_into(10, 1, &plain));
+}
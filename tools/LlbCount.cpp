@@ -0,0 +1,444 @@
+/**
+ * LlbCount.cpp
+ */
+#include <fcntl.h>
+#include <getopt.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "LogLogBeta.h"
+#include "LogLogBetaView.h"
+#include "ThreadPool.h"
+
+namespace {
+// Values handed to add_many at a time by each thread
+constexpr uint64_t k_values_per_batch = 1024U;
+// Bytes of stdin read before they are split across the threads
+constexpr uint64_t k_stdin_block_bytes = 64UL << 20;
+
+struct Options {
+  uint32_t precision_bits = llb::constants::k_default_precision;
+  uint32_t thread_count = 0U;
+  // Records are lines unless record_width is set, and the whole record is
+  // the value unless field is set, counted from 1
+  uint64_t record_width = 0UL;
+  uint32_t field = 0U;
+  char delimiter = '\t';
+  std::string output;
+  std::vector<std::string> merges;
+  std::vector<std::string> inputs;
+  bool quiet = false;
+};
+
+// A read only mapping of a whole file, empty files map to nothing
+class MappedFile {
+public:
+  explicit MappedFile(const std::string &path) noexcept
+      : m_data{nullptr}, m_size{0UL}, m_ok{false} {
+    const auto fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+      return;
+    }
+    struct stat info;
+    if (::fstat(fd, &info) == 0) {
+      m_size = static_cast<uint64_t>(info.st_size);
+      m_ok = m_size == 0;
+      if (m_size != 0) {
+        auto *data = ::mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data != MAP_FAILED) {
+          ::madvise(data, m_size, MADV_SEQUENTIAL);
+          m_data = static_cast<const uint8_t *>(data);
+          m_ok = true;
+        }
+      }
+    }
+    ::close(fd);
+  }
+
+  ~MappedFile() noexcept {
+    if (m_data != nullptr) {
+      ::munmap(const_cast<uint8_t *>(m_data), m_size);
+    }
+  }
+
+  MappedFile(const MappedFile &) = delete;
+  MappedFile &operator=(const MappedFile &) = delete;
+
+  bool ok() const { return m_ok; }
+
+  const uint8_t *data() const { return m_data; }
+
+  uint64_t size() const { return m_size; }
+
+private:
+  const uint8_t *m_data;
+  uint64_t m_size;
+  bool m_ok;
+};
+
+// Error rate that gives a sketch of exactly precision_bits
+double error_rate_for(uint32_t precision_bits) {
+  return 1.04 / std::sqrt(std::pow(2.0, precision_bits)) * 1.0001;
+}
+
+// Start of the first record at or after position, position itself when a
+// record starts there
+const uint8_t *record_start(const Options &options, const uint8_t *begin,
+                            const uint8_t *end, const uint8_t *position) {
+  if (options.record_width != 0) {
+    const auto offset = static_cast<uint64_t>(position - begin);
+    const auto rounded = (offset + options.record_width - 1) /
+                         options.record_width * options.record_width;
+    return begin + std::min<uint64_t>(rounded, end - begin);
+  }
+  if (position == begin || position == end || position[-1] == '\n') {
+    return position;
+  }
+  const auto *newline = static_cast<const uint8_t *>(
+      std::memchr(position, '\n', static_cast<size_t>(end - position)));
+  return newline == nullptr ? end : newline + 1;
+}
+
+// Narrows a record to its selected field, false when it has too few fields
+bool select_field(const Options &options, const uint8_t **value,
+                  uint64_t *length) {
+  if (options.field == 0) {
+    return true;
+  }
+  const auto *field = *value;
+  const auto *record_end = *value + *length;
+  for (auto field_ix = 1U; field_ix < options.field; field_ix += 1) {
+    const auto *delimiter = static_cast<const uint8_t *>(std::memchr(
+        field, options.delimiter, static_cast<size_t>(record_end - field)));
+    if (delimiter == nullptr) {
+      return false;
+    }
+    field = delimiter + 1;
+  }
+  const auto *field_end = static_cast<const uint8_t *>(std::memchr(
+      field, options.delimiter, static_cast<size_t>(record_end - field)));
+  *value = field;
+  *length = static_cast<uint64_t>(
+      (field_end == nullptr ? record_end : field_end) - field);
+  return true;
+}
+
+// Adds every record of [begin, end) to sketch, returning the records read
+uint64_t add_records(const Options &options, const uint8_t *begin,
+                     const uint8_t *end, llb::LogLogBeta &sketch) {
+  const uint8_t *values[k_values_per_batch];
+  uint64_t lengths[k_values_per_batch];
+  auto value_count = 0UL;
+  auto record_count = 0UL;
+
+  for (const auto *record = begin; record < end;) {
+    const uint8_t *record_end;
+    const uint8_t *next;
+    if (options.record_width != 0) {
+      record_end = record + std::min<uint64_t>(options.record_width,
+                                               end - record);
+      next = record_end;
+    } else {
+      record_end = static_cast<const uint8_t *>(
+          std::memchr(record, '\n', static_cast<size_t>(end - record)));
+      record_end = record_end == nullptr ? end : record_end;
+      next = record_end + 1;
+      if (record_end != record && record_end[-1] == '\r') {
+        record_end -= 1;
+      }
+    }
+
+    const auto *value = record;
+    auto length = static_cast<uint64_t>(record_end - record);
+    record_count += 1;
+    record = next;
+    if (!select_field(options, &value, &length)) {
+      continue;
+    }
+
+    values[value_count] = value;
+    lengths[value_count] = length;
+    value_count += 1;
+    if (value_count == k_values_per_batch) {
+      sketch.add_many(values, lengths, value_count);
+      value_count = 0;
+    }
+  }
+  sketch.add_many(values, lengths, value_count);
+  return record_count;
+}
+
+// Splits [begin, end) on record boundaries into one part per sketch and adds
+// each part to its own sketch across pool
+uint64_t ingest(const Options &options, const uint8_t *begin,
+                const uint8_t *end, std::vector<llb::LogLogBeta> &sketches,
+                llb::ThreadPool &pool) {
+  const auto part_count = sketches.size();
+  const auto bytes = static_cast<uint64_t>(end - begin);
+  std::vector<uint64_t> record_counts(part_count, 0UL);
+  pool.run(part_count, [&](uint64_t part_ix) {
+    const auto *part_begin = record_start(
+        options, begin, end, begin + bytes * part_ix / part_count);
+    const auto *part_end = record_start(
+        options, begin, end, begin + bytes * (part_ix + 1) / part_count);
+    record_counts[part_ix] =
+        add_records(options, part_begin, part_end, sketches[part_ix]);
+  });
+
+  auto record_count = 0UL;
+  for (const auto count : record_counts) {
+    record_count += count;
+  }
+  return record_count;
+}
+
+// Reads stdin a block at a time, carrying the partial record at the end of
+// each block over to the next
+bool ingest_stdin(const Options &options,
+                  std::vector<llb::LogLogBeta> &sketches,
+                  llb::ThreadPool &pool, uint64_t *record_count,
+                  uint64_t *byte_count) {
+  std::vector<uint8_t> buffer(k_stdin_block_bytes);
+  auto filled = 0UL;
+  auto eof = false;
+  while (!eof) {
+    if (filled == buffer.size()) {
+      buffer.resize(buffer.size() * 2);
+    }
+    const auto read_bytes =
+        ::read(STDIN_FILENO, &buffer[filled], buffer.size() - filled);
+    if (read_bytes < 0) {
+      return false;
+    }
+    eof = read_bytes == 0;
+    filled += static_cast<uint64_t>(read_bytes);
+    *byte_count += static_cast<uint64_t>(read_bytes);
+    if (!eof && filled < buffer.size()) {
+      continue;
+    }
+
+    // Everything up to the last complete record, or all of it at the end
+    auto complete = filled;
+    if (!eof && options.record_width != 0) {
+      complete = filled / options.record_width * options.record_width;
+    } else if (!eof) {
+      while (complete != 0 && buffer[complete - 1] != '\n') {
+        complete -= 1;
+      }
+    }
+    *record_count += ingest(options, buffer.data(), buffer.data() + complete,
+                            sketches, pool);
+    std::memmove(buffer.data(), buffer.data() + complete, filled - complete);
+    filled -= complete;
+  }
+  return true;
+}
+
+void usage(std::ostream &out) {
+  out << "usage: llb-count [options] [file ...]\n"
+         "\n"
+         "Estimates the number of distinct records in the files, or in stdin\n"
+         "when there are none or a file is -. Records are lines unless\n"
+         "--width is given.\n"
+         "\n"
+         "  -p, --precision N   sketch precision, "
+      << llb::constants::k_minimum_precision << " to "
+      << llb::constants::k_maximum_precision << " (default "
+      << llb::constants::k_default_precision
+      << ")\n"
+         "  -t, --threads N     threads to count with (default one per "
+         "core)\n"
+         "  -w, --width N       fixed width records of N bytes\n"
+         "  -f, --field N       count field N of each record, from 1\n"
+         "  -d, --delimiter C   field delimiter, a character or tab "
+         "(default tab)\n"
+         "  -o, --output FILE   write the serialized sketch to FILE\n"
+         "  -m, --merge FILE    merge a serialized sketch, may repeat\n"
+         "  -q, --quiet         don't report throughput on stderr\n"
+         "  -h, --help          show this help\n";
+}
+
+bool parse_number(const char *text, uint64_t *number) {
+  char *end;
+  errno = 0;
+  *number = std::strtoull(text, &end, 10);
+  return errno == 0 && end != text && *end == '\0';
+}
+
+bool parse_options(int argc, char **argv, Options *options) {
+  const option long_options[] = {
+      {"precision", required_argument, nullptr, 'p'},
+      {"threads", required_argument, nullptr, 't'},
+      {"width", required_argument, nullptr, 'w'},
+      {"field", required_argument, nullptr, 'f'},
+      {"delimiter", required_argument, nullptr, 'd'},
+      {"output", required_argument, nullptr, 'o'},
+      {"merge", required_argument, nullptr, 'm'},
+      {"quiet", no_argument, nullptr, 'q'},
+      {"help", no_argument, nullptr, 'h'},
+      {nullptr, 0, nullptr, 0}};
+
+  for (auto option = 0; (option = getopt_long(argc, argv, "p:t:w:f:d:o:m:qh",
+                                              long_options, nullptr)) != -1;) {
+    uint64_t number = 0;
+    switch (option) {
+    case 'p':
+      if (!parse_number(optarg, &number) ||
+          number < llb::constants::k_minimum_precision ||
+          number > llb::constants::k_maximum_precision) {
+        std::cerr << "llb-count: invalid precision " << optarg << "\n";
+        return false;
+      }
+      options->precision_bits = static_cast<uint32_t>(number);
+      break;
+    case 't':
+      if (!parse_number(optarg, &number) || number > 4096) {
+        std::cerr << "llb-count: invalid thread count " << optarg << "\n";
+        return false;
+      }
+      options->thread_count = static_cast<uint32_t>(number);
+      break;
+    case 'w':
+      if (!parse_number(optarg, &number) || number == 0) {
+        std::cerr << "llb-count: invalid record width " << optarg << "\n";
+        return false;
+      }
+      options->record_width = number;
+      break;
+    case 'f':
+      if (!parse_number(optarg, &number) || number == 0 ||
+          number > UINT32_MAX) {
+        std::cerr << "llb-count: invalid field " << optarg << "\n";
+        return false;
+      }
+      options->field = static_cast<uint32_t>(number);
+      break;
+    case 'd':
+      if (std::strcmp(optarg, "tab") == 0 || std::strcmp(optarg, "\\t") == 0) {
+        options->delimiter = '\t';
+      } else if (std::strlen(optarg) == 1) {
+        options->delimiter = optarg[0];
+      } else {
+        std::cerr << "llb-count: invalid delimiter " << optarg << "\n";
+        return false;
+      }
+      break;
+    case 'o':
+      options->output = optarg;
+      break;
+    case 'm':
+      options->merges.emplace_back(optarg);
+      break;
+    case 'q':
+      options->quiet = true;
+      break;
+    case 'h':
+      usage(std::cout);
+      std::exit(0);
+    default:
+      usage(std::cerr);
+      return false;
+    }
+  }
+
+  for (auto arg_ix = optind; arg_ix < argc; arg_ix += 1) {
+    options->inputs.emplace_back(argv[arg_ix]);
+  }
+  if (options->inputs.empty() && options->merges.empty()) {
+    options->inputs.emplace_back("-");
+  }
+  return true;
+}
+} // namespace
+
+int main(int argc, char **argv) {
+  Options options;
+  if (!parse_options(argc, argv, &options)) {
+    return 2;
+  }
+
+  const auto start = std::chrono::steady_clock::now();
+  llb::ThreadPool pool{options.thread_count};
+  const auto error_rate = error_rate_for(options.precision_bits);
+  std::vector<llb::LogLogBeta> sketches;
+  for (auto thread_ix = 0U; thread_ix < pool.thread_count(); thread_ix += 1) {
+    sketches.emplace_back(error_rate);
+  }
+
+  auto record_count = 0UL;
+  auto byte_count = 0UL;
+  for (const auto &input : options.inputs) {
+    if (input == "-") {
+      if (!ingest_stdin(options, sketches, pool, &record_count,
+                        &byte_count)) {
+        std::cerr << "llb-count: failed to read stdin\n";
+        return 1;
+      }
+      continue;
+    }
+    MappedFile file{input};
+    if (!file.ok()) {
+      std::cerr << "llb-count: failed to map " << input << "\n";
+      return 1;
+    }
+    record_count += ingest(options, file.data(), file.data() + file.size(),
+                           sketches, pool);
+    byte_count += file.size();
+  }
+
+  llb::LogLogBeta sketch{error_rate};
+  std::vector<const llb::LogLogBeta *> merge_me;
+  for (const auto &thread_sketch : sketches) {
+    merge_me.push_back(&thread_sketch);
+  }
+  sketch.merge_all(merge_me);
+
+  for (const auto &path : options.merges) {
+    MappedFile file{path};
+    if (!file.ok() ||
+        !sketch.merge(llb::LogLogBetaView{file.data(), file.size()})) {
+      std::cerr << "llb-count: " << path << " is not a sketch\n";
+      return 1;
+    }
+  }
+
+  if (!options.output.empty()) {
+    const auto serialized = sketch.serialize(true);
+    std::ofstream out{options.output, std::ios::binary};
+    out.write(reinterpret_cast<const char *>(serialized.data()),
+              static_cast<std::streamsize>(serialized.size()));
+    if (!out) {
+      std::cerr << "llb-count: failed to write " << options.output << "\n";
+      return 1;
+    }
+  }
+
+  const auto cardinality = sketch.cardinality();
+  const std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+  std::cout << cardinality << "\n";
+
+  if (!options.quiet) {
+    const auto seconds = std::max(elapsed.count(), 1e-9);
+    std::cerr << std::fixed << std::setprecision(1) << "llb-count: "
+              << record_count << " records, " << byte_count / 1e6 << " MB in "
+              << std::setprecision(3) << seconds << " s, "
+              << std::setprecision(1) << byte_count / 1e6 / seconds
+              << " MB/s, " << record_count / 1e6 / seconds
+              << " M records/s, " << pool.thread_count() << " threads\n";
+  }
+  return 0;
+}
@@ -0,0 +1,27 @@
+#!/bin/bash
+# Times llb-count against sort -u | wc -l on generated lines
+# usage: tools/compare_sort.sh path/to/llb-count [lines] [distinct]
+set -e
+
+LLB_COUNT=${1:?usage: $0 path/to/llb-count [lines] [distinct]}
+LINES=${2:-10000000}
+DISTINCT=${3:-1000000}
+DATA=$(mktemp)
+trap 'rm -f "$DATA"' EXIT
+
+awk -v lines="$LINES" -v distinct="$DISTINCT" 'BEGIN {
+    srand(1)
+    for (ix = 0; ix < lines; ix++) {
+        printf "user-%d\n", int(rand() * distinct)
+    }
+}' > "$DATA"
+echo "$(wc -c < "$DATA") bytes, $LINES lines"
+
+echo "sort -u | wc -l"
+time (LC_ALL=C sort -u "$DATA" | wc -l)
+
+echo "llb-count"
+time "$LLB_COUNT" "$DATA"
+
+echo "llb-count from stdin"
+time (cat "$DATA" | "$LLB_COUNT")